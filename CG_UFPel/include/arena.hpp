@@ -0,0 +1,61 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <vector>
+#include <stddef.h>
+
+// Monotonic allocator for working data with a stack-like lifetime.
+//
+// Memory is handed out by bumping an offset in a chain of blocks, each at
+// least twice the size of the one before, so a run that allocates n bytes
+// makes O(log n) system allocations. Nothing is freed one by one : rewind()
+// drops everything allocated after a mark() and reset() drops everything,
+// and the blocks are kept for the next allocations.
+//
+// Only for trivially destructible types, no destructors are ever called.
+class Arena{
+public:
+	struct Mark{
+		size_t block;
+		size_t offset;
+	};
+
+	explicit Arena(size_t first_block = 64 * 1024);
+	~Arena();
+
+	void * allocate(size_t bytes, size_t align = sizeof(void *));
+
+	template <typename T>
+	T * allocateArray(size_t count){ return (T *)allocate(count * sizeof(T), alignof(T)); }
+
+	Mark mark() const;
+	void rewind(const Mark & mark);
+	void reset();
+
+	// Frees the blocks as well
+	void release();
+
+	size_t systemAllocations() const { return system_allocations; }  // blocks ever allocated
+	size_t allocations() const { return nb_allocations; }            // allocate() calls
+	size_t bytesUsed() const;
+	size_t bytesReserved() const;
+
+private:
+	Arena(const Arena &);
+	Arena & operator=(const Arena &);
+
+	struct Block{
+		char * data;
+		size_t size;
+		size_t filled;  // offset reached before moving on to the next block
+	};
+
+	std::vector<Block> blocks;
+	size_t current;
+	size_t offset;
+	size_t first_size;
+	size_t system_allocations;
+	size_t nb_allocations;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef CLUSTER_HPP
+#define CLUSTER_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "threadpool.hpp"
+
+struct ClusterOptions{
+	int grid_resolution;    // cells along the longest side of the bounding box
+	ThreadPool * pool;      // every pass runs over index ranges on it, NULL runs sequentially
+
+	ClusterOptions();
+};
+
+struct ClusterStats{
+	int triangles_before;
+	int triangles_after;
+	int vertices_before;
+	int vertices_after;
+	double seconds;
+};
+
+// Decimates an indexed mesh by vertex clustering on a uniform grid (Rossignac
+// & Borrel) : all the vertices of a cell are snapped to one representative
+// and the faces that collapse or end up duplicated are dropped. O(n) and
+// parallel, much faster than simplifyMesh() but with no control over the
+// error, meant for previews and far LODs.
+//
+// The representative of a cell takes the mean position and mean normal of
+// its vertices and the uv of its lowest numbered vertex. The result is
+// compacted and does not depend on the number of threads. uvs and normals
+// may be empty. Index is unsigned short or unsigned int.
+template <typename Index>
+bool clusterMesh(
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	const ClusterOptions & options,
+	ClusterStats * stats = NULL
+);
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef COLLAPSE_HPP
+#define COLLAPSE_HPP
+
+#include <vector>
+#include <float.h>
+
+#include <glm/glm.hpp>
+
+#include "halfedge.hpp"
+#include "indexedheap.hpp"
+#include "quadric.hpp"
+#include "threadpool.hpp"
+#include "arena.hpp"
+#include "positions.hpp"
+
+enum CollapseCost{
+	COLLAPSE_EDGE_LENGTH,  // shortest edge first, merged at its midpoint
+	COLLAPSE_QUADRIC       // Garland-Heckbert quadric error, merged at the quadric optimum
+};
+
+// Incremental edge-collapse driver.
+//
+// Every shared edge sits in an indexed min-heap keyed on its cost, under the
+// id of its lower half-edge. Costs are cached per edge : a collapse marks the
+// edges of the merged vertex dirty, re-scores only those, and re-inserts the
+// edges around its neighbours whose link condition may have changed. A step
+// is therefore O(log E) plus the size of the affected one-ring, instead of a
+// scan over the whole mesh.
+//
+// Collapses that would flip one of the remaining faces are skipped.
+//
+// Re-scoring runs in batches : the positions are mirrored in a
+// PositionStore and the lengths or quadric errors of a batch of edges are
+// computed by the SIMD kernels of positions.hpp, with the same results as
+// one edge at a time.
+//
+// step() keeps an undo log holding only the inverse of each collapse (the
+// renamed index slots, the two removed faces and the old position), so
+// undo() and redo() cost O(one-ring) in time and memory. The renamed slots
+// live in an arena that is rewound along with the log, so a long run makes
+// a logarithmic number of system allocations instead of one per step.
+//
+// stepParallel() is the batch variant : it takes the cheapest edges, keeps a
+// greedy set of them whose closed one-rings don't overlap, and collapses the
+// whole set at once on a thread pool. Edge costs are pure functions of the
+// mesh, the selection runs in (cost, id) order on one thread and collapses
+// in disjoint one-rings commute, so the result is the same for any number
+// of threads.
+class CollapseEngine{
+public:
+	// One undoable step : the mesh record plus the vertex data of v0 before
+	// the collapse, and its position after
+	struct HistoryEntry{
+		CollapseRecord mesh;
+		glm::vec3 position[2];
+		glm::vec2 uv;
+		glm::vec3 normal;
+		Quadric quadric;
+		Arena::Mark arena_mark;  // the undo arena before the collapse was recorded
+	};
+
+	CollapseEngine(HalfEdgeMesh & mesh, std::vector<glm::vec3> & vertices, CollapseCost mode = COLLAPSE_EDGE_LENGTH);
+
+	// Takes effect at the next init()
+	void setCost(CollapseCost mode) { cost_mode = mode; }
+	CollapseCost costMode() const { return cost_mode; }
+
+	// Optional per-vertex attributes kept in step with the positions : the
+	// surviving vertex gets them interpolated at its new position along the
+	// collapsed edge. Either may be NULL.
+	void setAttributes(std::vector<glm::vec2> * uvs, std::vector<glm::vec3> * normals);
+
+	// Scores every edge of the mesh, on the pool if there is one, and clears
+	// the undo log. Call again whenever the mesh is rebuilt.
+	void init(ThreadPool * pool = NULL);
+
+	// Collapses the cheapest collapsible edge and moves the surviving vertex
+	// to its new position. Returns false when nothing is left to collapse
+	// for at most max_cost.
+	bool step(float max_cost = FLT_MAX);
+
+	// Reverts the last step(), or redoes the last reverted one. A new step()
+	// drops the steps that could be redone. Return false when there is
+	// nothing to undo or redo.
+	bool undo();
+	bool redo();
+	int undoCount() const { return (int)done; }
+	int redoCount() const { return (int)(history.size() - done); }
+	const HistoryEntry & historyEntry(int i) const { return history[i]; }
+
+	// Collapses up to max_collapses independent low-cost edges in parallel.
+	// Returns how many were collapsed, 0 when nothing is left. These are not
+	// recorded and clear the undo log.
+	int stepParallel(ThreadPool & pool, int max_collapses, float max_cost = FLT_MAX);
+
+	// Number of edge costs computed since init()
+	int edgesEvaluated() const { return evaluated; }
+
+	// Highest cost among the edges collapsed since init()
+	float maxCollapsedCost() const { return max_collapsed; }
+
+	// Holds the undo records, for allocation statistics
+	const Arena & undoArena() const { return undo_arena; }
+
+private:
+	int canonical(int h) const;
+	void computeCosts(const int * edges, int count);
+	void placement(int h, int & oriented, glm::vec3 & target) const;
+	bool flips(int oriented, const glm::vec3 & target);
+	void touchAround(unsigned int v, bool moved);
+	void touchCollapsed(unsigned int v);
+	void flushTouched(ThreadPool * pool);
+	void moveVertex(unsigned int v0, unsigned int v1, const glm::vec3 & target);
+	void applyCollapse(int oriented, const glm::vec3 & target, HistoryEntry & entry);
+
+	HalfEdgeMesh & mesh;
+	std::vector<glm::vec3> & vertices;
+	PositionStore positions;            // copy of vertices for the cost kernels
+	std::vector<glm::vec2> * uvs;
+	std::vector<glm::vec3> * normals;
+	CollapseCost cost_mode;
+
+	IndexedMinHeap heap;
+	std::vector<float> cost_cache;      // per canonical half-edge
+	std::vector<glm::vec3> target_cache; // quadric optimum, per canonical half-edge
+	std::vector<Quadric> quadrics;      // per vertex
+	std::vector<unsigned char> dirty;   // cost_cache must be recomputed
+	int evaluated;
+	float max_collapsed;
+
+	std::vector<HistoryEntry> history;
+	size_t done;                        // entries [0, done) are applied
+	Arena undo_arena;                   // renamed half-edges of the history entries
+
+	std::vector<int> touched;           // half-edges whose heap entry must be refreshed
+	std::vector<int> pending;           // canonical edges going back in the heap
+	std::vector<int> scoring;           // the dirty ones among them
+	std::vector<int> candidates;
+	std::vector<int> selected;
+	std::vector<glm::vec3> selected_targets;
+	std::vector<unsigned int> stamp;    // per vertex, == pass when claimed by a collapse
+	unsigned int pass;
+
+	std::vector<int> ring;
+	std::vector<unsigned int> neighbours;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef COMPACT_HPP
+#define COMPACT_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "threadpool.hpp"
+
+// Exclusive prefix sum of flags into offsets (offsets[i] = sum of flags[0..i-1])
+// and returns the total. Runs as a two-level block scan on the pool if there
+// is one.
+unsigned int exclusiveScan(const std::vector<unsigned int> & flags, std::vector<unsigned int> & offsets, ThreadPool * pool = NULL);
+
+// Drops degenerate triangles (two equal corners), then the vertices no
+// triangle uses, and renumbers the indices to match. Vertex order is kept.
+// uvs and normals may be empty, otherwise they follow the positions.
+// Returns the number of vertices left. Index is unsigned short or unsigned int.
+template <typename Index>
+unsigned int compactMesh(
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	ThreadPool * pool = NULL
+);
+
+// Work arrays of compactMeshInto(), kept by the caller between calls
+struct CompactScratch{
+	std::vector<unsigned int> face_keep;
+	std::vector<unsigned int> face_offsets;
+	std::vector<unsigned int> vertex_keep;
+	std::vector<unsigned int> remap;
+};
+
+// compactMesh() that leaves its input alone and writes the compacted mesh to
+// the out_ vectors. The outputs and scratch are only resized, so once they
+// have grown to fit, compacting the same mesh again doesn't allocate.
+template <typename Index>
+unsigned int compactMeshInto(
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	std::vector<Index> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	CompactScratch & scratch,
+	ThreadPool * pool = NULL
+);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef COUNTERS_HPP
+#define COUNTERS_HPP
+
+#include <vector>
+#include <chrono>
+#include <stddef.h>
+
+// Per-frame performance counters of the viewer.
+//
+// Work done during a frame is added up as it happens (collapse time, edge
+// costs computed, bytes uploaded) and nextFrame() turns the totals into one
+// sample per counter. Each counter keeps a sliding window of its recent
+// samples, summarised as min / average / 99th percentile for display, and
+// the whole session for writeJson().
+class PerfCounters{
+public:
+	enum Counter{
+		FRAME_MS,          // time between two nextFrame() calls
+		COLLAPSE_MS,       // time spent collapsing, undoing and re-scoring
+		EDGES_EVALUATED,   // edge costs computed
+		LIVE_TRIANGLES,    // triangles drawn
+		LIVE_VERTICES,     // vertices drawn
+		UPLOADED_BYTES,    // bytes passed to glBufferData
+		COUNTER_COUNT
+	};
+
+	// Refreshed by nextFrame(), so their addresses can be handed to a GUI
+	struct Summary{
+		float min;
+		float avg;
+		float p99;
+	};
+
+	explicit PerfCounters(int window = 240);
+
+	// Closes the current frame, if one was started, and starts the next one
+	void nextFrame();
+
+	void addCollapseTime(double ms) { collapse_ms += ms; }
+	void addEdgesEvaluated(int count) { edges_evaluated += count; }
+	void addUploadedBytes(size_t bytes) { uploaded_bytes += (double)bytes; }
+	void setLive(int triangles, int vertices) { live_triangles = triangles; live_vertices = vertices; }
+
+	const Summary & summary(Counter c) const { return summaries[c]; }
+	int frames() const { return (int)history[FRAME_MS].size(); }
+
+	static const char * name(Counter c);
+
+	// Session totals, and min / avg / p99 / max over the last window and the
+	// whole session for every counter. Returns false if the file can't be written.
+	bool writeJson(const char * path) const;
+
+private:
+	struct Stats{
+		double min, avg, p99, max, total;
+	};
+	static Stats statsOf(const float * samples, size_t count, std::vector<float> & scratch);
+
+	int window;
+	std::vector<float> history[COUNTER_COUNT];  // every sample since the start
+	Summary summaries[COUNTER_COUNT];
+	std::vector<float> scratch;
+
+	bool started;
+	std::chrono::steady_clock::time_point frame_start;
+	double collapse_ms;
+	double edges_evaluated;
+	double uploaded_bytes;
+	int live_triangles;
+	int live_vertices;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef DISTANCE_HPP
+#define DISTANCE_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "threadpool.hpp"
+
+// Bounding volume hierarchy over the triangles of a mesh, for closest point
+// queries. Built top-down with median splits on the longest axis of the
+// centroids. Degenerate triangles are left out. Queries are const and can
+// run from several threads at once.
+class TriangleBVH{
+public:
+	TriangleBVH();
+
+	// Index is unsigned short or unsigned int
+	template <typename Index>
+	void build(const std::vector<Index> & indices, const std::vector<glm::vec3> & vertices);
+
+	// Squared distance from p to the closest triangle, its closest point and
+	// the triangle it lies on. Returns a negative distance if the tree is empty.
+	float closestPoint(const glm::vec3 & p, glm::vec3 & closest, int * triangle = NULL) const;
+
+	int triangleCount() const { return (int)corners.size() / 3; }
+
+private:
+	struct Node{
+		glm::vec3 box_min, box_max;
+		int first;      // first triangle of a leaf, or the left child of an inner node
+		int count;      // triangles in a leaf, 0 for an inner node (right child is first + 1)
+	};
+
+	void split(int node, int begin, int end, std::vector<glm::vec3> & centroids, int depth);
+
+	std::vector<Node> nodes;
+	std::vector<glm::vec3> corners;   // three per triangle, in leaf order
+	std::vector<int> face_of;         // input face of each triangle
+};
+
+struct DistanceStats{
+	int samples;
+	double mean;
+	double rms;
+	double max;
+};
+
+struct SurfaceDistance{
+	DistanceStats forward;    // from samples on a to the surface of b
+	DistanceStats backward;   // from samples on b to the surface of a
+	double hausdorff;         // max of both directions
+	double seconds;
+};
+
+// Symmetric distance between two meshes, typically an original and its
+// simplification (Metro, Cignoni et al.). Each side is sampled at all its
+// vertices plus samples_per_side points spread over its area, and every
+// sample is matched to the closest point of the other surface through a
+// TriangleBVH. Samples are drawn from a fixed seed per sample, so the
+// result is the same with any pool. Index is unsigned short or unsigned int.
+template <typename Index>
+SurfaceDistance measureSurfaceDistance(
+	const std::vector<Index> & indices_a,
+	const std::vector<glm::vec3> & vertices_a,
+	const std::vector<Index> & indices_b,
+	const std::vector<glm::vec3> & vertices_b,
+	int samples_per_side = 100000,
+	ThreadPool * pool = NULL
+);
+
+#endif
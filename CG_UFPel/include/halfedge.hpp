@@ -0,0 +1,116 @@
+#ifndef HALFEDGE_HPP
+#define HALFEDGE_HPP
+
+#include <vector>
+#include <atomic>
+
+#include "arena.hpp"
+
+// Everything collapse() changed, so uncollapse() can put it back. Its size
+// is O(valence) of the merged vertex.
+struct CollapseRecord{
+	int h, t;                 // collapsed half-edge and its twin
+	unsigned int v0, v1;      // v1 was merged into v0
+	unsigned int a, b;        // opposite corners of the faces of h and t
+	int outer[4];             // old twins of next(h), prev(h), next(t), prev(t)
+	int out_v0, out_v1, out_a, out_b;
+	unsigned char flags_v0, flags_v1;
+	const int * renamed;      // half-edges whose origin went from v1 to v0, in the arena
+	int renamed_count;
+};
+
+// Half-edge connectivity for an indexed triangle mesh.
+//
+// Half-edges are stored implicitly in face order : half-edge h belongs to
+// face h/3 and goes from corner h%3 to the next corner of that face, so
+// next/prev/face are plain arithmetic and origin(3*f+k) is exactly
+// indices[3*f+k]. Only the twin of each half-edge and one outgoing
+// half-edge per vertex are stored explicitly.
+//
+// Edges shared by more than two faces and vertices whose faces do not form
+// a single fan are flagged as locked, and are never touched by collapse().
+//
+// The queries use internal scratch buffers and are not thread-safe, but
+// collapse() is : edges whose closed one-rings don't overlap can be
+// collapsed concurrently.
+class HalfEdgeMesh{
+public:
+	HalfEdgeMesh();
+
+	// Builds the connectivity from an index buffer of unsigned short or
+	// unsigned int. Degenerate triangles (two equal corners) are kept in
+	// place but marked as removed.
+	template <typename Index>
+	void build(const std::vector<Index> & indices, unsigned int vertex_count);
+
+	// Writes the current faces back as an index buffer. Removed faces are
+	// emitted as degenerate triangles so face numbering stays stable.
+	template <typename Index>
+	void writeIndices(std::vector<Index> & indices) const;
+
+	int halfedgeCount() const { return (int)vertex_of.size(); }
+	int faceCount() const { return (int)vertex_of.size() / 3; }
+	int liveFaceCount() const { return live_faces; }
+	unsigned int vertexCount() const { return (unsigned int)out_of.size(); }
+
+	static int face(int h) { return h / 3; }
+	static int next(int h) { return (h % 3 == 2) ? h - 2 : h + 1; }
+	static int prev(int h) { return (h % 3 == 0) ? h + 2 : h - 1; }
+	int twin(int h) const { return twin_of[h]; }
+	unsigned int origin(int h) const { return vertex_of[h]; }
+	unsigned int target(int h) const { return vertex_of[next(h)]; }
+	int outgoing(unsigned int v) const { return out_of[v]; }
+
+	bool isBorder(int h) const { return twin_of[h] < 0; }
+	bool isFaceRemoved(int f) const { return face_removed[f] != 0; }
+	bool isVertexRemoved(unsigned int v) const { return (vertex_flags[v] & VERTEX_REMOVED) != 0; }
+	bool isBorderVertex(unsigned int v) const { return (vertex_flags[v] & VERTEX_BORDER) != 0; }
+	bool isLockedVertex(unsigned int v) const { return (vertex_flags[v] & VERTEX_LOCKED) != 0; }
+
+	// One-ring queries, all O(valence). The output vectors are cleared first.
+	void vertexOutgoing(unsigned int v, std::vector<int> & out) const;
+	void vertexNeighbours(unsigned int v, std::vector<unsigned int> & out) const;
+	void vertexFaces(unsigned int v, std::vector<int> & out) const;
+	int valence(unsigned int v) const;
+
+	// True if the edge of h is shared by two faces and collapsing it keeps
+	// the mesh manifold (link condition, no valence-2 vertices left behind).
+	bool canCollapse(int h) const;
+
+	// Collapses the edge of h : target(h) is merged into origin(h) and the
+	// two faces adjacent to the edge are removed. canCollapse(h) must hold.
+	// Only touches the one-rings of the two ends. If record is given it gets
+	// what is needed to undo the collapse, with the renamed half-edges
+	// allocated from arena. Recording uses a scratch buffer, so only
+	// collapses without a record may run concurrently.
+	void collapse(int h, CollapseRecord * record = NULL, Arena * arena = NULL);
+
+	// Reverts a collapse. Collapses must be reverted in the reverse order
+	// they were done in.
+	void uncollapse(const CollapseRecord & record);
+
+private:
+	enum {
+		VERTEX_BORDER  = 1,
+		VERTEX_LOCKED  = 2,
+		VERTEX_REMOVED = 4
+	};
+
+	void removeFace(int f, unsigned int v);
+	void renameOutgoing(unsigned int from, unsigned int to, std::vector<int> * renamed);
+
+	std::vector<unsigned int> vertex_of;     // origin of each half-edge
+	std::vector<int> twin_of;                // opposite half-edge, -1 on borders
+	std::vector<int> out_of;                 // one outgoing half-edge per vertex, -1 if isolated
+	std::vector<unsigned char> face_removed;
+	std::vector<unsigned char> vertex_flags;
+	std::atomic<int> live_faces;
+
+	// Scratch buffers so the one-ring queries do not allocate
+	mutable std::vector<int> ring_a, ring_b;
+	mutable std::vector<unsigned int> near_a, near_b;
+	mutable std::vector<unsigned int> vertex_mark;  // == mark_stamp for the ring being tested
+	mutable unsigned int mark_stamp;
+};
+
+#endif
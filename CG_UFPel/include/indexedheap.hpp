@@ -0,0 +1,40 @@
+#ifndef INDEXEDHEAP_HPP
+#define INDEXEDHEAP_HPP
+
+#include <vector>
+
+// Binary min-heap over the ids [0, capacity) keyed on a float.
+// Each id knows its slot in the heap, so changing or removing the key of
+// an arbitrary id is O(log n) instead of a rebuild. Equal keys are ordered
+// by id so the pop order never depends on insertion history.
+class IndexedMinHeap{
+public:
+	void reset(int capacity);
+	void clear();
+
+	bool empty() const { return heap.empty(); }
+	int size() const { return (int)heap.size(); }
+	bool contains(int id) const { return slot[id] >= 0; }
+
+	int top() const { return heap[0]; }
+	int at(int i) const { return heap[i]; }  // i-th id in heap order, i < size()
+	float topKey() const { return key[heap[0]]; }
+	float keyOf(int id) const { return key[id]; }
+
+	// Inserts id, or moves it to its new place if it is already in the heap
+	void update(int id, float k);
+	void remove(int id);
+	int pop();
+
+private:
+	bool less(int a, int b) const { return key[a] < key[b] || (key[a] == key[b] && a < b); }
+	void place(int i, int id) { heap[i] = id; slot[id] = i; }
+	void siftUp(int i);
+	void siftDown(int i);
+
+	std::vector<int> heap;   // ids in heap order
+	std::vector<int> slot;   // position of each id in heap, -1 if absent
+	std::vector<float> key;
+};
+
+#endif
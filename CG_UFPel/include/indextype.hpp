@@ -0,0 +1,27 @@
+#ifndef INDEXTYPE_HPP
+#define INDEXTYPE_HPP
+
+#include <vector>
+#include <limits>
+#include <stddef.h>
+
+// Index buffers are templated on their element type : unsigned short keeps
+// index bandwidth low, unsigned int lifts the 65,536 vertex limit.
+
+// True if every vertex of a mesh with vertex_count vertices can be addressed
+// with an Index
+template <typename Index>
+inline bool indexFits(size_t vertex_count){
+	return vertex_count <= (size_t)std::numeric_limits<Index>::max() + 1;
+}
+
+// Copies indices into a buffer of another width. Narrowing is only valid
+// if indexFits<To>() holds for the mesh.
+template <typename To, typename From>
+inline void convertIndices(const std::vector<From> & in, std::vector<To> & out){
+	out.resize(in.size());
+	for (size_t i = 0; i < in.size(); i++)
+		out[i] = (To)in[i];
+}
+
+#endif
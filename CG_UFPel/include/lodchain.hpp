@@ -0,0 +1,86 @@
+#ifndef LODCHAIN_HPP
+#define LODCHAIN_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "collapse.hpp"
+#include "threadpool.hpp"
+
+// A set of discrete LODs cut from one simplification run.
+//
+// The collapses go down once through every target and the live faces are
+// snapshotted as each one is reached, so the whole chain costs about as
+// much as its coarsest level. All the levels index into one shared vertex
+// buffer : a vertex is only appended again when a collapse moved it since
+// the level that last used it, and level i is the index range
+// [firstIndex(i), firstIndex(i) + indexCount(i)). Level 0 is the input.
+class LodChain{
+public:
+	LodChain();
+
+	// ratios are fractions of the input triangles, in any order, and each
+	// gives one level after level 0. A level that can't be reached gets as
+	// far as the collapses go. uvs and normals may be empty. Index is
+	// unsigned short or unsigned int.
+	template <typename Index>
+	bool build(
+		const std::vector<Index> & indices,
+		const std::vector<glm::vec3> & vertices,
+		const std::vector<glm::vec2> & uvs,
+		const std::vector<glm::vec3> & normals,
+		const std::vector<float> & ratios,
+		CollapseCost cost = COLLAPSE_QUADRIC,
+		ThreadPool * pool = NULL
+	);
+
+	// Same, with each level given as a number of triangles. No collapse
+	// costing more than max_error is made when it is >= 0 : the levels it
+	// stops short of keep the triangles left at that point.
+	template <typename Index>
+	bool build(
+		const std::vector<Index> & indices,
+		const std::vector<glm::vec3> & vertices,
+		const std::vector<glm::vec2> & uvs,
+		const std::vector<glm::vec3> & normals,
+		const std::vector<int> & triangles,
+		CollapseCost cost = COLLAPSE_QUADRIC,
+		ThreadPool * pool = NULL,
+		float max_error = -1.0f
+	);
+
+	bool save(const char * path) const;
+	bool load(const char * path);
+
+	int levelCount() const { return (int)levels.size(); }
+	unsigned int firstIndex(int level) const { return levels[level].first_index; }
+	unsigned int indexCount(int level) const { return levels[level].index_count; }
+	int triangleCount(int level) const { return (int)levels[level].index_count / 3; }
+	// Highest collapse cost paid to get down to the level
+	float maxError(int level) const { return levels[level].max_error; }
+
+	// Indices are 32-bit like in the file, narrow them with convertIndices()
+	// when indexFits<unsigned short>(vertices().size())
+	const std::vector<unsigned int> & indices() const { return index_buffer; }
+	const std::vector<glm::vec3> & vertices() const { return positions; }
+	const std::vector<glm::vec2> & uvs() const { return texcoords; }
+	const std::vector<glm::vec3> & normals() const { return vertex_normals; }
+
+private:
+	struct Level{
+		unsigned int first_index;
+		unsigned int index_count;
+		float max_error;
+	};
+
+	void clear();
+
+	std::vector<Level> levels;
+	std::vector<unsigned int> index_buffer;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> texcoords;
+	std::vector<glm::vec3> vertex_normals;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <stddef.h>
+
+// Read-only view of a whole file, mapped into memory so it can be parsed in
+// place without copying it through stdio buffers. The view stays valid until
+// close() or the destructor. An empty file opens fine with data() == NULL.
+class MappedFile{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// False if the file can't be opened or mapped
+	bool open(const char * path);
+	void close();
+
+	const char * data() const { return view; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+
+	const char * view;
+	size_t length;
+#ifdef _WIN32
+	void * file;
+	void * mapping;
+#endif
+};
+
+#endif
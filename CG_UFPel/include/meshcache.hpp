@@ -0,0 +1,96 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "threadpool.hpp"
+
+// Indexed mesh in a binary file laid out to be used straight from a memory
+// mapping : the arrays are read in place, there is nothing to parse.
+//
+// The header records the size, modification time and a hash of the source
+// file the mesh was made from, so a cache written next to an OBJ can tell
+// whether that OBJ changed since.
+class MeshCache{
+public:
+	MeshCache();
+
+	// Maps the file and checks its header, its size and its indices. The
+	// arrays below stay valid until close() or the destructor.
+	bool open(const char * path);
+	void close();
+
+	// True if the source is the same size, has the same modification time
+	// and hashes to the same value as when the cache was written
+	bool matches(const char * source_path) const;
+
+	int vertexCount() const { return (int)nb_vertices; }
+	int indexCount() const { return (int)nb_indices; }
+
+	// Point into the mapping. uvs() and normals() are NULL if the mesh has none.
+	const glm::vec3 * vertices() const { return positions; }
+	const glm::vec2 * uvs() const { return texcoords; }
+	const glm::vec3 * normals() const { return vertex_normals; }
+	const unsigned int * indices() const { return index_buffer; }
+
+	const glm::vec3 & boundsMin() const { return bounds_min; }
+	const glm::vec3 & boundsMax() const { return bounds_max; }
+
+	// Writes an indexed mesh made from source_path, NULL if it doesn't come
+	// from a file. uvs and normals may be empty. Index is unsigned short or
+	// unsigned int.
+	template <typename Index>
+	static bool save(
+		const char * path,
+		const std::vector<Index> & indices,
+		const std::vector<glm::vec3> & vertices,
+		const std::vector<glm::vec2> & uvs,
+		const std::vector<glm::vec3> & normals,
+		const char * source_path
+	);
+
+private:
+	MappedFile file;
+	unsigned int nb_vertices;
+	unsigned int nb_indices;
+	unsigned long long source_size;
+	long long source_time;
+	unsigned long long source_hash;
+	glm::vec3 bounds_min;
+	glm::vec3 bounds_max;
+	const glm::vec3 * positions;
+	const glm::vec2 * texcoords;
+	const glm::vec3 * vertex_normals;
+	const unsigned int * index_buffer;
+};
+
+// loadOBJIndexed(), through the cache path + ".meshcache" : the
+// cache is used when it matches the OBJ, and written after loading the OBJ
+// otherwise. Index is unsigned short or unsigned int.
+template <typename Index>
+bool loadOBJCached(
+	const char * path,
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	ThreadPool * pool = NULL
+);
+
+// saveOBJ(), then the cache path + ".meshcache" made from the new OBJ as
+// parsed back, so that loadOBJCached() later returns exactly what parsing
+// it would, without parsing it. Index is unsigned short or unsigned int.
+template <typename Index>
+bool saveOBJCached(
+	const char * path,
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	ThreadPool * pool = NULL
+);
+
+#endif
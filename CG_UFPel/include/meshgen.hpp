@@ -0,0 +1,43 @@
+#ifndef MESHGEN_HPP
+#define MESHGEN_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Parametric meshes of any size, with uvs and normals, for benchmarks and
+// for trying the simplifier on inputs larger than the bundled models. Each
+// has about the requested number of triangles (never fewer than a small
+// minimum) and is the same for the same arguments. UV seams are duplicated
+// vertices, as an OBJ export would have them, and V is flipped the way
+// loadOBJ() flips it.
+//
+// Index is unsigned short or unsigned int. They return false if the
+// vertices don't fit in an Index.
+
+// UV sphere of radius 1, one vertex per segment at each pole
+template <typename Index>
+bool generateSphere(int triangles,
+	std::vector<Index> & indices, std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs, std::vector<glm::vec3> & normals);
+
+// Torus around the y axis, radii 1 and 0.35
+template <typename Index>
+bool generateTorus(int triangles,
+	std::vector<Index> & indices, std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs, std::vector<glm::vec3> & normals);
+
+// Height field over [-1, 1] x [-1, 1] in the xz plane, with fractal value
+// noise heights up to about 0.25. An open grid, so it has a border.
+template <typename Index>
+bool generateTerrain(int triangles, unsigned int seed,
+	std::vector<Index> & indices, std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs, std::vector<glm::vec3> & normals);
+
+// One vertex per corner, the layout loadOBJ() returns and indexVBO() takes
+template <typename Index>
+void expandCorners(const std::vector<Index> & indices, const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs, const std::vector<glm::vec3> & normals,
+	std::vector<glm::vec3> & out_vertices, std::vector<glm::vec2> & out_uvs, std::vector<glm::vec3> & out_normals);
+
+#endif
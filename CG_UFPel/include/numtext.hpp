@@ -0,0 +1,29 @@
+#ifndef NUMTEXT_HPP
+#define NUMTEXT_HPP
+
+// Numbers in text mesh formats, scanned in place from a buffer that doesn't
+// have to be null-terminated. Both functions skip leading spaces and tabs,
+// read no further than end, and on success leave p just past the number.
+// On failure p is left unchanged.
+
+// Decimal float with an optional exponent, rounded correctly : the result is
+// the one strtof() gives in the "C" locale. Common inputs such as "-0.447220"
+// take an exact fast path, the rest go through strtof().
+bool scanFloat(const char * & p, const char * end, float & out);
+
+// Decimal integer with an optional sign, false if it doesn't fit in an int
+bool scanInt(const char * & p, const char * end, int & out);
+
+// Numbers written for text mesh formats. Both functions write at out without
+// a terminating null and return the end of what they wrote.
+
+// Longest text formatFloat() writes, "-FLT_MAX" with six decimals
+enum { FLOAT_TEXT_MAX = 48 };
+
+// Same text as printf("%.6f"), rounding included. Values below 1e12 in
+// magnitude are formatted with integer arithmetic, the rest with snprintf().
+char * formatFloat(char * out, float value);
+
+char * formatUInt(char * out, unsigned int value);
+
+#endif
@@ -1,18 +1,77 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "threadpool.hpp"
+
+// Appends one vertex, uv and normal per triangle corner. Large files are
+// parsed in chunks on the pool if there is one.
 bool loadOBJ(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
 	std::vector<glm::vec2> & out_uvs, 
-	std::vector<glm::vec3> & out_normals
+	std::vector<glm::vec3> & out_normals,
+	ThreadPool * pool = NULL
+);
+
+// Loads the mesh already indexed, the way indexVBO() would index what
+// loadOBJ() returns, without the per-corner copy : each distinct (v, vt, vn)
+// triple of the faces becomes one vertex, in order of first use. Unlike
+// indexVBO(), duplicate v (or vt, vn) lines with equal values are kept
+// apart. Replaces the contents of the vectors. Index is unsigned short or
+// unsigned int.
+template <typename Index>
+bool loadOBJIndexed(
+	const char * path,
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	ThreadPool * pool = NULL
+);
+
+
+// Writes an indexed mesh with one v/vt/vn face per triangle, readable by
+// loadOBJ(). V is flipped back, as loadOBJ() flips it. uvs and normals may
+// be empty. Numbers are printed as "%.6f" and "%u" would print them. With
+// a pool, the lines are formatted in parallel chunks. Index is unsigned
+// short or unsigned int.
+template <typename Index>
+bool saveOBJ(
+	const char * path,
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	ThreadPool * pool = NULL
 );
 
+// Area-weighted vertex normals, which loadOBJ() and loadPLY() give the
+// vertices read without one. addFaceNormals() adds the normal of every
+// triangle of corners to its three vertices, vertex_of(corner) being the
+// position a corner uses ; faces add to shared vertices, so the sums are
+// done on one thread. normalizeNormals() then scales them to unit length.
+template <typename Corner, typename VertexOf>
+inline void addFaceNormals(const std::vector<Corner> & corners, VertexOf vertex_of,
+	const std::vector<glm::vec3> & positions, std::vector<glm::vec3> & normals){
+	for (size_t t = 0; t + 2 < corners.size(); t += 3){
+		const glm::vec3 & a = positions[vertex_of(corners[t])];
+		glm::vec3 n = glm::cross(positions[vertex_of(corners[t + 1])] - a, positions[vertex_of(corners[t + 2])] - a);
+		for (int k = 0; k < 3; k++)
+			normals[vertex_of(corners[t + k])] += n;
+	}
+}
 
+void normalizeNormals(std::vector<glm::vec3> & normals, ThreadPool * pool = NULL);
 
+// Index is unsigned short or unsigned int
+template <typename Index>
 bool loadAssImp(
 	const char * path, 
-	std::vector<unsigned short> & indices,
+	std::vector<Index> & indices,
 	std::vector<glm::vec3> & vertices,
 	std::vector<glm::vec2> & uvs,
 	std::vector<glm::vec3> & normals
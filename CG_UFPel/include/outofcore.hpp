@@ -0,0 +1,114 @@
+#ifndef OUTOFCORE_HPP
+#define OUTOFCORE_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+#include "quadric.hpp"
+#include "threadpool.hpp"
+
+// Out-of-core vertex clustering (Lindstrom, 2000). Triangles are streamed
+// through a uniform grid over a known bounding box : every cell keeps the
+// sum of the plane quadrics of the triangles touching it, and a triangle
+// survives only if its three corners land in three different cells.
+//
+// The grid's memory is bounded by the number of occupied cells and output
+// triangles, never by the input triangle count, so the source can be read
+// in batches.
+class ClusterStream{
+public:
+	// resolution is the number of cells along the longest side of the box
+	ClusterStream(const glm::vec3 & box_min, const glm::vec3 & box_max, int resolution);
+
+	// Adds count triangles, three corners each. The per-triangle work runs
+	// on the pool if one is given, the cell bookkeeping stays sequential.
+	void addTriangles(const glm::vec3 * corners, int count, ThreadPool * pool = NULL);
+
+	// Writes the surviving triangles with one vertex per occupied cell, at
+	// the quadric optimum of the cell, or at the mean of its corners when the
+	// optimum is singular or strays more than a cell away.
+	void finish(std::vector<unsigned int> & indices, std::vector<glm::vec3> & vertices) const;
+
+	int cellCount() const { return (int)cells.size(); }
+	int triangleCount() const { return (int)faces.size(); }
+
+	// Rough size of the cell table and the output faces
+	size_t memoryBytes() const;
+
+private:
+	struct Cell{
+		Quadric quadric;
+		double sum[3];
+		unsigned int count;
+		unsigned long long key;
+	};
+
+	struct Face{
+		int c[3];
+		bool operator==(const Face & other) const { return c[0] == other.c[0] && c[1] == other.c[1] && c[2] == other.c[2]; }
+	};
+	struct FaceHash{
+		size_t operator()(const Face & f) const;
+	};
+
+	unsigned long long cellKey(const glm::vec3 & p) const;
+	int cellSlot(unsigned long long key);
+
+	glm::vec3 origin;
+	float cell_size;
+	int dim[3];
+
+	std::vector<Cell> cells;
+	std::unordered_map<unsigned long long, int> slot_of;
+	std::unordered_set<Face, FaceHash> faces;
+
+	// Batch scratch : cell key of each corner and quadric of each triangle
+	std::vector<unsigned long long> batch_keys;
+	std::vector<Quadric> batch_quadrics;
+};
+
+struct OutOfCoreOptions{
+	int grid_resolution;    // cells along the longest side of the bounding box
+	int batch_triangles;    // triangles read before they are handed to the grid
+	ThreadPool * pool;      // per-triangle work of a batch runs on it, NULL runs sequentially
+	const char * spill_path; // temporary file for the positions, NULL keeps them in memory
+
+	OutOfCoreOptions();
+};
+
+struct OutOfCoreStats{
+	long long vertices_before;
+	long long triangles_before;
+	int vertices_after;
+	int triangles_after;
+	size_t peak_bytes;      // heap : positions unless spilled, batch and grid at the end of the stream
+	size_t spilled_bytes;   // positions written to spill_path and mapped, 0 if kept in memory
+	double seconds;
+};
+
+// Simplifies an OBJ file without loading it. A first pass finds the
+// bounding box and collects the positions, 12 bytes a vertex. A second
+// pass streams the faces through a ClusterStream in batches. uvs and
+// normals are ignored, polygons are fanned into triangles. The result is
+// an indexed mesh in one piece.
+//
+// Faces refer to positions by index, so the positions have to stay
+// reachable. Without spill_path they are kept in a vector, and memory
+// grows by 12 bytes per input vertex on top of the grid. With spill_path
+// they are written there during the first pass and memory mapped for the
+// second. The heap then only holds the grid, the output faces and one
+// batch, whatever the size of the input. The mapped positions are file
+// pages the system can evict. The file is removed before returning.
+bool simplifyOutOfCore(
+	const char * path,
+	const OutOfCoreOptions & options,
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	OutOfCoreStats * stats = NULL
+);
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef PLYFILE_HPP
+#define PLYFILE_HPP
+
+#include <vector>
+#include <string>
+#include <string.h>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "threadpool.hpp"
+
+// Strided view of count values of T inside a mapped file. Records in a PLY
+// body have no alignment, so values are copied out instead of referenced.
+template <typename T>
+struct PlyView{
+	const char * data;  // first value, NULL if the file doesn't lay it out as T
+	size_t count;
+	size_t stride;      // bytes from one value to the next
+
+	T operator[](size_t i) const { T value; memcpy(&value, data + i * stride, sizeof(T)); return value; }
+};
+
+// Corners of a triangle as stored in the file
+struct PlyTriangle{
+	unsigned int v[3];
+};
+
+// Triangle mesh in a binary little-endian PLY file.
+//
+// open() maps the file, reads the header and finds where each element's
+// records are, without decoding them. When the vertex properties are floats
+// in the usual order and every face is a uchar count of 3 followed by 32-bit
+// indices, the views below point straight into the mapping. read() works
+// with any layout : other property types are converted and polygons are
+// split in fans.
+class PlyMesh{
+public:
+	PlyMesh();
+
+	bool open(const char * path);
+	void close();
+
+	int vertexCount() const { return (int)vertex_count; }
+	int faceCount() const { return (int)face_count; }
+
+	// data is NULL unless x y z (nx ny nz ; s t, u v or texture_u texture_v)
+	// are consecutive floats of the vertex element. V is as stored.
+	PlyView<glm::vec3> positions() const { return position_view; }
+	PlyView<glm::vec3> normals() const { return normal_view; }
+	PlyView<glm::vec2> uvs() const { return uv_view; }
+
+	// data is NULL unless every face is exactly a uchar 3 and three int or
+	// uint indices. Indices aren't checked against vertexCount().
+	PlyView<PlyTriangle> triangles() const { return triangle_view; }
+
+	// Replaces the contents of the vectors with the mesh. V is flipped like
+	// loadOBJ() does, missing uvs are (0, 0) and missing normals are
+	// area-weighted vertex normals. Index is unsigned short or unsigned int.
+	template <typename Index>
+	bool read(
+		std::vector<Index> & indices,
+		std::vector<glm::vec3> & vertices,
+		std::vector<glm::vec2> & uvs,
+		std::vector<glm::vec3> & normals,
+		ThreadPool * pool = NULL
+	) const;
+
+private:
+	PlyMesh(const PlyMesh &);
+	PlyMesh & operator=(const PlyMesh &);
+
+	struct Property{
+		std::string name;
+		int type;          // PlyType of the value, or of the list items
+		int count_type;    // PlyType of the list length, 0 if not a list
+		size_t offset;     // in the record, when the element has no list
+	};
+
+	struct Element{
+		std::string name;
+		size_t count;
+		std::vector<Property> properties;
+		size_t stride;     // record size, 0 if the element has a list
+		const char * begin;
+		const char * end;
+	};
+
+	bool parseHeader(const char * path);
+	bool locateElements(const char * path);
+	const Property * findProperty(const Element & element, const char * name) const;
+	template <typename T>
+	PlyView<T> floatView(const Element & element, const char * const * names, int count) const;
+
+	MappedFile file;
+	std::vector<Element> elements;
+	const char * body;  // first byte after the header
+	int vertex_element;
+	int face_element;
+	size_t vertex_count;
+	size_t face_count;
+	PlyView<glm::vec3> position_view;
+	PlyView<glm::vec3> normal_view;
+	PlyView<glm::vec2> uv_view;
+	PlyView<PlyTriangle> triangle_view;
+};
+
+// PlyMesh::open() then read()
+template <typename Index>
+bool loadPLY(
+	const char * path,
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	ThreadPool * pool = NULL
+);
+
+// Writes a binary little-endian PLY with float x y z, nx ny nz and s t
+// vertices (uvs and normals may be empty) and uchar / uint triangles,
+// readable in place by PlyMesh. V is flipped back, as read() flips it.
+// Index is unsigned short or unsigned int.
+template <typename Index>
+bool savePLY(
+	const char * path,
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals
+);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef POSITIONS_HPP
+#define POSITIONS_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "quadric.hpp"
+
+// Vertex positions as three separate coordinate arrays (structure of
+// arrays), each aligned to 32 bytes and padded to a multiple of eight
+// floats, so the cost kernels below load whole SIMD registers of x, y or z
+// without shuffling. Kept in step with the glm::vec3 positions by whoever
+// owns them.
+class PositionStore{
+public:
+	PositionStore();
+	~PositionStore();
+
+	void assign(const std::vector<glm::vec3> & positions);
+	void clear();
+
+	int size() const { return count; }
+
+	void set(unsigned int i, const glm::vec3 & p){ xs[i] = p.x; ys[i] = p.y; zs[i] = p.z; }
+	glm::vec3 get(unsigned int i) const { return glm::vec3(xs[i], ys[i], zs[i]); }
+
+	const float * x() const { return xs; }
+	const float * y() const { return ys; }
+	const float * z() const { return zs; }
+
+private:
+	PositionStore(const PositionStore &);
+	PositionStore & operator=(const PositionStore &);
+
+	float * xs;
+	float * ys;
+	float * zs;
+	int count;
+	int capacity;
+};
+
+// Instruction sets the kernels can use, picked at run time from what the
+// CPU and the OS support
+enum SimdLevel{
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX2,
+	SIMD_AVX512
+};
+
+// Best level available on this machine, or the one forced by setSimdLevel()
+SimdLevel simdLevel();
+const char * simdLevelName(SimdLevel level);
+
+// Caps the level the kernels use, mostly to compare them. Levels above
+// what the machine supports are lowered to it.
+void setSimdLevel(SimdLevel level);
+
+// out[i] = distance between positions v0[i] and v1[i], as glm::distance
+// would compute it
+void edgeLengths(const PositionStore & positions, const unsigned int * v0, const unsigned int * v1, int count, float * out);
+
+// out[i] = quadricError(quadrics[i], (x[i], y[i], z[i])), evaluated in
+// double precision in the same order, so the results are bit for bit those
+// of quadricError
+void quadricErrors(const Quadric * quadrics, const float * x, const float * y, const float * z, int count, float * out);
+
+#endif
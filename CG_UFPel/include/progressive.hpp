@@ -0,0 +1,116 @@
+#ifndef PROGRESSIVE_HPP
+#define PROGRESSIVE_HPP
+
+#include <vector>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+
+#include "collapse.hpp"
+
+// Progressive mesh (Hoppe 96) : a base mesh plus an ordered list of vertex
+// splits, each undoing one edge collapse.
+//
+// Vertices and faces are renumbered in refinement order. The base mesh uses
+// vertices [0, base) and faces [0, base_faces), and split i brings in
+// vertex base + i and faces base_faces + 2i and base_faces + 2i + 1. The
+// faces sit in the index buffer from the start, so applying a split only
+// renames the corners that move to the new vertex and restores the old
+// position of v0 : moving between levels only touches the splits in between.
+//
+// The file format follows the same order (header, base mesh, then one
+// record per split) so a reader can draw the base mesh as soon as it has it
+// and refine while the rest streams in.
+class ProgressiveMesh{
+public:
+	ProgressiveMesh();
+	~ProgressiveMesh();
+
+	// Simplifies the mesh down to min_triangles (or as far as it goes) and
+	// records the collapses. uvs and normals may be empty. Index is
+	// unsigned short or unsigned int.
+	template <typename Index>
+	bool build(
+		const std::vector<Index> & indices,
+		const std::vector<glm::vec3> & vertices,
+		const std::vector<glm::vec2> & uvs,
+		const std::vector<glm::vec3> & normals,
+		CollapseCost cost = COLLAPSE_QUADRIC,
+		int min_triangles = 0
+	);
+
+	// Writes the base mesh and every split
+	bool save(const char * path);
+
+	// Reads the header and the base mesh, and leaves the file open for
+	// readSplits(). The mesh is at level 0 afterwards. Counts that don't fit
+	// in the file and base indices out of range fail like a missing file.
+	bool open(const char * path);
+
+	// Reads up to count more splits from the file opened by open(). Returns
+	// how many were read; the file is closed once they have all been read.
+	// A split that is cut short, refers to a vertex, face or corner the
+	// mesh doesn't have yet, or renames corners that don't hold its v0
+	// rejects the whole file : the mesh is cleared and -1 is returned.
+	int readSplits(int count);
+
+	// open() then readSplits() until the end
+	bool load(const char * path);
+
+	// Applies or reverts splits to get to level (clamped to the splits loaded)
+	void setLevel(int level);
+
+	int level() const { return current; }
+	int levelCount() const { return (int)splits.size(); }
+	int splitCount() const { return total_splits; }
+	int triangleCount() const { return base_faces + 2 * current; }
+	int vertexCount() const { return base_vertices + current; }
+
+	// The buffers hold every loaded face and vertex. Only the first
+	// 3 * triangleCount() indices and vertexCount() vertices make up the
+	// current level; the rest is ready for the next splits. Indices are
+	// 32-bit like in the file, narrow them with convertIndices() when
+	// indexFits<unsigned short>(vertices().size()).
+	const std::vector<unsigned int> & indices() const { return index_buffer; }
+	const std::vector<glm::vec3> & vertices() const { return positions; }
+	const std::vector<glm::vec2> & uvs() const { return texcoords; }
+	const std::vector<glm::vec3> & normals() const { return vertex_normals; }
+
+private:
+	struct VertexSplit{
+		unsigned int v0;               // split into v0 and base + i
+		glm::vec3 position;            // v0 before the collapse
+		glm::vec2 uv;
+		glm::vec3 normal;
+		unsigned int renamed_first;        // corners going from v0 to the new vertex,
+		unsigned int renamed_count;        // a range of renamed_corners
+
+		// v0 as it was before the split was applied, to revert it
+		glm::vec3 coarse_position;
+		glm::vec2 coarse_uv;
+		glm::vec3 coarse_normal;
+	};
+
+	void clear();
+	void refine();
+	void coarsen();
+
+	int base_vertices;
+	int base_faces;
+	int total_splits;
+	int current;
+	bool has_uvs;
+	bool has_normals;
+
+	std::vector<unsigned int> index_buffer;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> texcoords;
+	std::vector<glm::vec3> vertex_normals;
+	std::vector<VertexSplit> splits;
+	std::vector<unsigned int> renamed_corners;  // pooled for all the splits
+	std::vector<unsigned int> refined_indices;  // at the last level read, while streaming
+
+	FILE * stream;                     // open between open() and the last readSplits()
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef QUADRIC_HPP
+#define QUADRIC_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "halfedge.hpp"
+
+// Symmetric 4x4 error quadric (Garland & Heckbert), stored as its ten
+// distinct coefficients
+//     a2 ab ac ad | b2 bc bd c2 | cd d2 - -
+// and padded to twelve floats so it adds up with three SSE registers.
+struct Quadric{
+	float m[12];
+};
+
+void quadricZero(Quadric & q);
+void quadricAdd(Quadric & q, const Quadric & other);
+
+// Squared distance-like error of point p against the quadric
+float quadricError(const Quadric & q, const glm::vec3 & p);
+
+// Position minimising the quadric. Returns false if the system is singular
+// (flat or linear neighbourhoods), in which case the caller picks a fallback.
+bool quadricOptimum(const Quadric & q, glm::vec3 & out);
+
+// Adds the area weighted plane quadric of triangle (p0, p1, p2) to q.
+// Degenerate triangles add nothing.
+void quadricAddTriangle(Quadric & q, const glm::vec3 & p0, const glm::vec3 & p1, const glm::vec3 & p2);
+
+// Sums the area weighted plane quadric of every live face into its three
+// corners. quadrics is resized to the vertex count.
+void computeVertexQuadrics(
+	const HalfEdgeMesh & mesh,
+	const std::vector<glm::vec3> & vertices,
+	std::vector<Quadric> & quadrics
+);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "collapse.hpp"
+#include "threadpool.hpp"
+
+// What simplifyMesh() aims for. It stops at whichever limit is hit first.
+struct SimplifyOptions{
+	CollapseCost cost;
+	int target_triangles;   // stop at this many triangles, 0 for no limit
+	float target_ratio;     // or at this fraction of the input triangles, 0 for no limit
+	float max_error;        // never collapse an edge costing more than this, < 0 for no limit
+	ThreadPool * pool;      // collapses independent edges in batches on it, NULL runs sequentially
+	float weld_epsilon;     // weld positions closer than this before collapsing, < 0 to keep seams as borders
+
+	SimplifyOptions();
+};
+
+struct SimplifyStats{
+	int triangles_before;
+	int triangles_after;
+	int vertices_before;
+	int vertices_after;
+	int topology_vertices;  // vertices the collapses ran on, after welding
+	int collapses;
+	int edges_evaluated;
+	float max_error;        // highest cost actually collapsed, in the units of the cost mode
+	int undo_blocks;        // system allocations made by the undo log's arena, the only ones per collapse
+	int undo_records;       // renamed half-edge records the undo log took from those blocks
+	double seconds;
+};
+
+// Decimates an indexed mesh in one call, without any window or GL context.
+// The result is compacted : the index buffer only holds the remaining
+// triangles, and positions, uvs and normals only the vertices they use.
+// uvs and normals may be empty. Index is unsigned short or unsigned int.
+//
+// With weld_epsilon >= 0 the collapses run on positions alone, so uv and
+// normal seams no longer show up as borders. Each attribute vertex follows
+// the welded vertex it maps to and keeps its own uv and normal.
+//
+// max_error is an edge length in COLLAPSE_EDGE_LENGTH mode and a quadric
+// error (area-weighted squared distance) in COLLAPSE_QUADRIC mode.
+template <typename Index>
+bool simplifyMesh(
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	const SimplifyOptions & options,
+	SimplifyStats * stats = NULL
+);
+
+#endif
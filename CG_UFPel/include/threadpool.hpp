@@ -0,0 +1,43 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Fixed set of worker threads for data-parallel loops.
+//
+// parallelFor() splits [0, count) into contiguous chunks and blocks until
+// all of them have run. The calling thread works on chunks too while it
+// waits, so parallelFor() may be called from inside another parallelFor().
+class ThreadPool{
+public:
+	// 0 threads means one per hardware thread. A pool of 1 runs everything
+	// on the calling thread.
+	explicit ThreadPool(unsigned int threads = 0);
+	~ThreadPool();
+
+	unsigned int size() const { return (unsigned int)workers.size() + 1; }
+
+	// Calls fn(begin, end) on disjoint ranges covering [0, count). Ranges are
+	// at least grain long, a count below grain runs as a single range.
+	void parallelFor(int count, const std::function<void(int, int)> & fn, int grain = 1);
+
+private:
+	bool runOne();
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque< std::function<void()> > tasks;
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping;
+};
+
+// Runs fn(begin, end) over [0, count) on the pool, or inline without one
+void parallelFor(ThreadPool * pool, int count, const std::function<void(int, int)> & fn, int grain = 1);
+
+#endif
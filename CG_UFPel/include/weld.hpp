@@ -0,0 +1,23 @@
+#ifndef WELD_HPP
+#define WELD_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Merges vertices whose positions are within epsilon of each other, ignoring
+// uvs and normals, on a hashed uniform grid of cell size epsilon : O(n)
+// expected. An epsilon of 0 only merges identical positions.
+//
+// remap[i] is the welded vertex of input vertex i. Welded vertices are
+// numbered in order of first appearance and take the position of that first
+// vertex, so the result does not depend on hash order. Returns the number
+// of welded vertices.
+unsigned int weldPositions(
+	const std::vector<glm::vec3> & vertices,
+	float epsilon,
+	std::vector<unsigned int> & remap,
+	std::vector<glm::vec3> & welded
+);
+
+#endif
@@ -0,0 +1,95 @@
+#include <vector>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "arena.hpp"
+
+Arena::Arena(size_t first_block)
+	: current(0), offset(0), first_size(first_block > 0 ? first_block : 1), system_allocations(0), nb_allocations(0){
+}
+
+Arena::~Arena(){
+	release();
+}
+
+void * Arena::allocate(size_t bytes, size_t align){
+	nb_allocations++;
+	for (;;){
+		if (current < blocks.size()){
+			Block & block = blocks[current];
+			size_t start = (offset + align - 1) & ~(align - 1);
+			if (start + bytes <= block.size){
+				offset = start + bytes;
+				return block.data + start;
+			}
+			block.filled = offset;
+
+			// Move on to the next block if it is kept from before and big enough
+			if (current + 1 < blocks.size() && blocks[current + 1].size >= bytes + align){
+				current++;
+				offset = 0;
+				continue;
+			}
+		}
+
+		// Blocks after this one are too small to be worth keeping
+		while (blocks.size() > current + 1){
+			free(blocks.back().data);
+			blocks.pop_back();
+		}
+
+		size_t size = blocks.empty() ? first_size : 2 * blocks.back().size;
+		while (size < bytes + align)
+			size *= 2;
+		Block block;
+		block.data = (char *)malloc(size);
+		block.size = size;
+		block.filled = 0;
+		if (block.data == NULL)
+			return NULL;
+		system_allocations++;
+		if (!blocks.empty())
+			current++;
+		blocks.push_back(block);
+		offset = 0;
+	}
+}
+
+Arena::Mark Arena::mark() const{
+	Mark m = { current, offset };
+	return m;
+}
+
+void Arena::rewind(const Mark & m){
+	if (m.block < current || (m.block == current && m.offset < offset)){
+		current = m.block;
+		offset = m.offset;
+	}
+}
+
+void Arena::reset(){
+	current = 0;
+	offset = 0;
+}
+
+void Arena::release(){
+	for (size_t i = 0; i < blocks.size(); i++)
+		free(blocks[i].data);
+	blocks.clear();
+	current = 0;
+	offset = 0;
+}
+
+size_t Arena::bytesUsed() const{
+	size_t used = 0;
+	for (size_t i = 0; i < current && i < blocks.size(); i++)
+		used += blocks[i].filled;
+	return used + offset;
+}
+
+size_t Arena::bytesReserved() const{
+	size_t reserved = 0;
+	for (size_t i = 0; i < blocks.size(); i++)
+		reserved += blocks[i].size;
+	return reserved;
+}
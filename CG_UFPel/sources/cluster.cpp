@@ -0,0 +1,246 @@
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+
+#include "compact.hpp"
+#include "cluster.hpp"
+
+static const unsigned long long EMPTY_KEY = ~0ull;
+static const int AXIS_BITS = 21;
+
+// first[i] = lowest j with keys[j] == keys[i], through a lock-free open
+// addressing table so it runs in parallel. Entries with EMPTY_KEY are their
+// own first. Taking the minimum makes the result independent of the order
+// the threads insert in.
+static void first_of_key(const std::vector<unsigned long long> & keys, std::vector<unsigned int> & first, ThreadPool * pool){
+	int n = (int)keys.size();
+	size_t size = 16;
+	while (size < 2 * (size_t)n)
+		size *= 2;
+	size_t mask = size - 1;
+
+	std::unique_ptr<std::atomic<unsigned long long>[]> slot_key(new std::atomic<unsigned long long>[size]);
+	std::unique_ptr<std::atomic<unsigned int>[]> slot_first(new std::atomic<unsigned int>[size]);
+	parallelFor(pool, (int)size, [&](int begin, int end){
+		for (int s = begin; s < end; s++){
+			slot_key[s].store(EMPTY_KEY, std::memory_order_relaxed);
+			slot_first[s].store(0xFFFFFFFFu, std::memory_order_relaxed);
+		}
+	}, 16384);
+
+	std::vector<unsigned int> slot_of(n);
+	parallelFor(pool, n, [&](int begin, int end){
+		for (int i = begin; i < end; i++){
+			unsigned long long key = keys[i];
+			if (key == EMPTY_KEY)
+				continue;
+			size_t s = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 20) & mask;
+			for (;;){
+				unsigned long long found = slot_key[s].load(std::memory_order_relaxed);
+				if (found == EMPTY_KEY && slot_key[s].compare_exchange_strong(found, key))
+					break;
+				if (found == key)
+					break;
+				s = (s + 1) & mask;
+			}
+			slot_of[i] = (unsigned int)s;
+
+			unsigned int cur = slot_first[s].load(std::memory_order_relaxed);
+			while ((unsigned int)i < cur && !slot_first[s].compare_exchange_weak(cur, (unsigned int)i))
+				;
+		}
+	}, 4096);
+
+	first.resize(n);
+	parallelFor(pool, n, [&](int begin, int end){
+		for (int i = begin; i < end; i++)
+			first[i] = keys[i] == EMPTY_KEY ? (unsigned int)i : slot_first[slot_of[i]].load(std::memory_order_relaxed);
+	}, 4096);
+}
+
+ClusterOptions::ClusterOptions()
+	: grid_resolution(64), pool(NULL){
+}
+
+template <typename Index>
+bool clusterMesh(
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	const ClusterOptions & options,
+	ClusterStats * stats
+){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if ((!uvs.empty() && uvs.size() != vertices.size()) || (!normals.empty() && normals.size() != vertices.size())){
+		printf("clusterMesh : attributes don't match the %d vertices\n", (int)vertices.size());
+		return false;
+	}
+
+	ThreadPool * pool = options.pool;
+	int nb_vertices = (int)vertices.size();
+	int nb_faces = (int)indices.size() / 3;
+	if (stats){
+		stats->triangles_before = nb_faces;
+		stats->vertices_before = nb_vertices;
+	}
+
+	// Bounding box, one partial box per block so the reduction is fixed
+	const int block_size = 16384;
+	int blocks = std::max(1, (nb_vertices + block_size - 1) / block_size);
+	std::vector<glm::vec3> block_min(blocks, glm::vec3(FLT_MAX)), block_max(blocks, glm::vec3(-FLT_MAX));
+	parallelFor(pool, blocks, [&](int begin, int end){
+		for (int b = begin; b < end; b++)
+			for (int i = b * block_size; i < std::min(nb_vertices, (b + 1) * block_size); i++){
+				block_min[b] = glm::min(block_min[b], vertices[i]);
+				block_max[b] = glm::max(block_max[b], vertices[i]);
+			}
+	}, 1);
+	glm::vec3 box_min = block_min[0], box_max = block_max[0];
+	for (int b = 1; b < blocks; b++){
+		box_min = glm::min(box_min, block_min[b]);
+		box_max = glm::max(box_max, block_max[b]);
+	}
+
+	int resolution = std::min(std::max(options.grid_resolution, 1), 1 << AXIS_BITS);
+	glm::vec3 extent = box_max - box_min;
+	float longest = fmaxf(extent.x, fmaxf(extent.y, extent.z));
+	float scale = longest > 0.0f ? resolution / longest : 0.0f;
+
+	// Cell of every vertex, then the lowest numbered vertex of each cell
+	std::vector<unsigned long long> keys(nb_vertices);
+	parallelFor(pool, nb_vertices, [&](int begin, int end){
+		for (int i = begin; i < end; i++){
+			unsigned long long key = 0;
+			for (int k = 0; k < 3; k++){
+				int c = std::min((int)((vertices[i][k] - box_min[k]) * scale), resolution - 1);
+				key = (key << AXIS_BITS) | (unsigned long long)std::max(c, 0);
+			}
+			keys[i] = key;
+		}
+	}, 4096);
+
+	std::vector<unsigned int> representative;
+	first_of_key(keys, representative, pool);
+
+	// Clusters are numbered in the order of their representatives
+	std::vector<unsigned int> is_representative(nb_vertices), cluster_of;
+	parallelFor(pool, nb_vertices, [&](int begin, int end){
+		for (int i = begin; i < end; i++)
+			is_representative[i] = representative[i] == (unsigned int)i ? 1 : 0;
+	}, 4096);
+	unsigned int nb_clusters = exclusiveScan(is_representative, cluster_of, pool);
+	parallelFor(pool, nb_vertices, [&](int begin, int end){
+		for (int i = begin; i < end; i++)
+			cluster_of[i] = cluster_of[representative[i]];
+	}, 4096);
+
+	// Means in fixed point, so the sums are exact whatever the order the
+	// threads add in : positions relative to the box on 30 bits, normals on 20
+	const double position_one = (double)(1 << 30), normal_one = (double)(1 << 20);
+	double to_fixed = longest > 0.0f ? position_one / longest : 0.0;
+	std::unique_ptr<std::atomic<long long>[]> sums(new std::atomic<long long>[6 * (size_t)nb_clusters]);
+	std::unique_ptr<std::atomic<unsigned int>[]> counts(new std::atomic<unsigned int>[nb_clusters]);
+	parallelFor(pool, (int)nb_clusters, [&](int begin, int end){
+		for (int c = begin; c < end; c++){
+			for (int k = 0; k < 6; k++)
+				sums[6*c+k].store(0, std::memory_order_relaxed);
+			counts[c].store(0, std::memory_order_relaxed);
+		}
+	}, 4096);
+	parallelFor(pool, nb_vertices, [&](int begin, int end){
+		for (int i = begin; i < end; i++){
+			unsigned int c = cluster_of[i];
+			for (int k = 0; k < 3; k++)
+				sums[6*c+k].fetch_add((long long)((vertices[i][k] - box_min[k]) * to_fixed), std::memory_order_relaxed);
+			if (!normals.empty())
+				for (int k = 0; k < 3; k++)
+					sums[6*c+3+k].fetch_add((long long)(normals[i][k] * normal_one), std::memory_order_relaxed);
+			counts[c].fetch_add(1, std::memory_order_relaxed);
+		}
+	}, 4096);
+
+	std::vector<glm::vec3> cluster_vertices(nb_clusters), cluster_normals(normals.empty() ? 0 : nb_clusters);
+	std::vector<glm::vec2> cluster_uvs(uvs.empty() ? 0 : nb_clusters);
+	parallelFor(pool, nb_vertices, [&](int begin, int end){
+		for (int i = begin; i < end; i++){
+			if (!is_representative[i])
+				continue;
+			unsigned int c = cluster_of[i];
+			double n = (double)counts[c].load(std::memory_order_relaxed);
+			cluster_vertices[c] = vertices[i];
+			if (to_fixed > 0.0)
+				for (int k = 0; k < 3; k++)
+					cluster_vertices[c][k] = box_min[k] + (float)(sums[6*c+k].load(std::memory_order_relaxed) / n / to_fixed);
+			if (!normals.empty()){
+				glm::vec3 sum;
+				for (int k = 0; k < 3; k++)
+					sum[k] = (float)(sums[6*c+3+k].load(std::memory_order_relaxed) / normal_one);
+				float len = glm::length(sum);
+				cluster_normals[c] = len > 0.0f ? sum / len : normals[i];
+			}
+			if (!uvs.empty())
+				cluster_uvs[c] = uvs[i];
+		}
+	}, 4096);
+	sums.reset();
+	counts.reset();
+
+	// Faces on clusters : drop the collapsed ones and all but the first of
+	// each duplicate. Duplicates are only looked for while three cluster
+	// numbers fit in a key.
+	bool dedupe = nb_clusters <= (1u << AXIS_BITS);
+	std::vector<unsigned long long> face_keys(nb_faces);
+	parallelFor(pool, nb_faces, [&](int begin, int end){
+		for (int f = begin; f < end; f++){
+			unsigned int s[3];
+			for (int k = 0; k < 3; k++){
+				s[k] = cluster_of[indices[3*f+k]];
+				indices[3*f+k] = (Index)s[k];
+			}
+			if (!dedupe || s[0] == s[1] || s[1] == s[2] || s[0] == s[2]){
+				face_keys[f] = EMPTY_KEY;
+				continue;
+			}
+			// Rotate the smallest first, keeping the winding
+			int r = (s[0] < s[1] && s[0] < s[2]) ? 0 : (s[1] < s[2] ? 1 : 2);
+			face_keys[f] = ((unsigned long long)s[r] << (2 * AXIS_BITS))
+			             | ((unsigned long long)s[(r + 1) % 3] << AXIS_BITS)
+			             | (unsigned long long)s[(r + 2) % 3];
+		}
+	}, 4096);
+
+	std::vector<unsigned int> first_face;
+	first_of_key(face_keys, first_face, pool);
+	parallelFor(pool, nb_faces, [&](int begin, int end){
+		for (int f = begin; f < end; f++)
+			if (first_face[f] != (unsigned int)f)
+				indices[3*f+1] = indices[3*f+2] = indices[3*f];
+	}, 4096);
+
+	vertices.swap(cluster_vertices);
+	uvs.swap(cluster_uvs);
+	normals.swap(cluster_normals);
+	compactMesh(indices, vertices, uvs, normals, pool);
+
+	if (stats){
+		stats->triangles_after = (int)indices.size() / 3;
+		stats->vertices_after = (int)vertices.size();
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return true;
+}
+
+template bool clusterMesh<unsigned short>(std::vector<unsigned short> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &, const ClusterOptions &, ClusterStats *);
+template bool clusterMesh<unsigned int>(std::vector<unsigned int> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &, const ClusterOptions &, ClusterStats *);
@@ -0,0 +1,422 @@
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "collapse.hpp"
+
+CollapseEngine::CollapseEngine(HalfEdgeMesh & mesh, std::vector<glm::vec3> & vertices, CollapseCost mode)
+	: mesh(mesh), vertices(vertices), uvs(NULL), normals(NULL), cost_mode(mode), evaluated(0), max_collapsed(0.0f), done(0){
+}
+
+void CollapseEngine::setAttributes(std::vector<glm::vec2> * uvs, std::vector<glm::vec3> * normals){
+	this->uvs = uvs;
+	this->normals = normals;
+}
+
+void CollapseEngine::init(ThreadPool * pool){
+	int n = mesh.halfedgeCount();
+	heap.reset(n);
+	cost_cache.assign(n, 0.0f);
+	dirty.assign(n, 1);
+	stamp.assign(mesh.vertexCount(), 0);
+	pass = 0;
+	evaluated = 0;
+	max_collapsed = 0.0f;
+	history.clear();
+	done = 0;
+	undo_arena.reset();
+	positions.assign(vertices);
+
+	if (cost_mode == COLLAPSE_QUADRIC){
+		target_cache.assign(n, glm::vec3(0.0f));
+		computeVertexQuadrics(mesh, vertices, quadrics);
+	}else{
+		target_cache.clear();
+		quadrics.clear();
+	}
+
+	touched.resize(n);
+	for (int h = 0; h < n; h++)
+		touched[h] = h;
+	flushTouched(pool);
+}
+
+// An edge is known by the lower of its two half-edges
+int CollapseEngine::canonical(int h) const{
+	int t = mesh.twin(h);
+	return (t >= 0 && t < h) ? t : h;
+}
+
+static const int COST_BATCH = 256;
+
+// Only writes the cache entries of the given edges, so disjoint sets of edges
+// can be scored concurrently. The edges go through the kernels COST_BATCH at
+// a time, with their inputs gathered on the stack.
+void CollapseEngine::computeCosts(const int * edges, int count){
+	unsigned int v0[COST_BATCH], v1[COST_BATCH];
+	float x[COST_BATCH], y[COST_BATCH], z[COST_BATCH], costs[COST_BATCH];
+	Quadric q[COST_BATCH];
+
+	for (int first = 0; first < count; first += COST_BATCH){
+		int n = std::min(COST_BATCH, count - first);
+		for (int i = 0; i < n; i++){
+			v0[i] = mesh.origin(edges[first + i]);
+			v1[i] = mesh.target(edges[first + i]);
+		}
+
+		if (cost_mode == COLLAPSE_EDGE_LENGTH){
+			edgeLengths(positions, v0, v1, n, costs);
+		}else{
+			for (int i = 0; i < n; i++){
+				q[i] = quadrics[v0[i]];
+				quadricAdd(q[i], quadrics[v1[i]]);
+
+				// Border vertices don't move; otherwise solve for the optimum and fall
+				// back to the best of the two ends and the midpoint if it is singular.
+				const glm::vec3 & p0 = vertices[v0[i]];
+				const glm::vec3 & p1 = vertices[v1[i]];
+				glm::vec3 p;
+				if (mesh.isBorderVertex(v0[i]))
+					p = p0;
+				else if (mesh.isBorderVertex(v1[i]))
+					p = p1;
+				else if (!quadricOptimum(q[i], p)){
+					glm::vec3 candidates[3] = { p0, p1, (p0 + p1) * 0.5f };
+					p = candidates[0];
+					for (int k = 1; k < 3; k++)
+						if (quadricError(q[i], candidates[k]) < quadricError(q[i], p))
+							p = candidates[k];
+				}
+				target_cache[edges[first + i]] = p;
+				x[i] = p.x;
+				y[i] = p.y;
+				z[i] = p.z;
+			}
+			quadricErrors(q, x, y, z, n, costs);
+		}
+
+		for (int i = 0; i < n; i++){
+			cost_cache[edges[first + i]] = costs[i];
+			dirty[edges[first + i]] = 0;
+		}
+	}
+}
+
+// Picks which end survives and where it goes : the midpoint or the quadric
+// optimum, unless one end is on a border, in which case that end stays put so
+// the seam doesn't open. h is the canonical half-edge of the edge.
+void CollapseEngine::placement(int h, int & oriented, glm::vec3 & target) const{
+	oriented = mesh.isBorderVertex(mesh.target(h)) ? mesh.twin(h) : h;
+
+	unsigned int v0 = mesh.origin(oriented), v1 = mesh.target(oriented);
+	if (mesh.isBorderVertex(v0))
+		target = vertices[v0];
+	else if (cost_mode == COLLAPSE_QUADRIC)
+		target = target_cache[h];
+	else
+		target = (vertices[v0] + vertices[v1]) * 0.5f;
+}
+
+// True if moving both ends of the edge to target turns a remaining face over
+bool CollapseEngine::flips(int oriented, const glm::vec3 & target){
+	unsigned int ends[2] = { mesh.origin(oriented), mesh.target(oriented) };
+	int f0 = HalfEdgeMesh::face(oriented);
+	int f1 = HalfEdgeMesh::face(mesh.twin(oriented));
+
+	for (int e = 0; e < 2; e++){
+		mesh.vertexOutgoing(ends[e], ring);
+		for (size_t i = 0; i < ring.size(); i++){
+			int f = HalfEdgeMesh::face(ring[i]);
+			if (f == f0 || f == f1)
+				continue;
+
+			glm::vec3 before[3], after[3];
+			for (int k = 0; k < 3; k++){
+				unsigned int v = mesh.origin(3*f+k);
+				before[k] = vertices[v];
+				after[k] = (v == ends[0] || v == ends[1]) ? target : vertices[v];
+			}
+			glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(n0, n1) < 0.0f)
+				return true;
+		}
+	}
+	return false;
+}
+
+// Queues every edge around v for a heap refresh. If v has moved their cached
+// costs are stale too.
+void CollapseEngine::touchAround(unsigned int v, bool moved){
+	mesh.vertexOutgoing(v, ring);
+	for (size_t i = 0; i < ring.size(); i++){
+		int h = ring[i];
+		int p = HalfEdgeMesh::prev(h);
+		if (moved){
+			dirty[canonical(h)] = 1;
+			dirty[canonical(p)] = 1;
+		}
+		touched.push_back(h);
+		touched.push_back(p);
+	}
+}
+
+// After a collapse into v : the edges of v get new costs, and the edges of
+// its neighbours go back in the heap since their link condition may now hold.
+void CollapseEngine::touchCollapsed(unsigned int v){
+	touchAround(v, true);
+	mesh.vertexNeighbours(v, neighbours);
+	for (size_t i = 0; i < neighbours.size(); i++)
+		touchAround(neighbours[i], false);
+}
+
+// Re-scores the dirty touched edges, on the pool if there is one, then puts
+// every live shared edge among them back in the heap.
+void CollapseEngine::flushTouched(ThreadPool * pool){
+	pending.clear();
+	for (size_t i = 0; i < touched.size(); i++){
+		int h = touched[i];
+		int t = mesh.twin(h);
+
+		// Border edges and half-edges of removed faces (which have no twin)
+		if (t < 0){
+			heap.remove(h);
+			continue;
+		}
+
+		// Stitching may have changed which half-edge is canonical
+		int c = canonical(h);
+		heap.remove(c == h ? t : h);
+		pending.push_back(c);
+	}
+	touched.clear();
+
+	std::sort(pending.begin(), pending.end());
+	pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+	scoring.clear();
+	for (size_t i = 0; i < pending.size(); i++)
+		if (dirty[pending[i]])
+			scoring.push_back(pending[i]);
+	evaluated += (int)scoring.size();
+
+	if (pool){
+		pool->parallelFor((int)scoring.size(), [this](int begin, int end){
+			computeCosts(scoring.data() + begin, end - begin);
+		}, COST_BATCH);
+	}else{
+		computeCosts(scoring.data(), (int)scoring.size());
+	}
+
+	for (size_t i = 0; i < pending.size(); i++)
+		heap.update(pending[i], cost_cache[pending[i]]);
+}
+
+// Moves v0 to target, v1 being merged into it. Attributes are blended by
+// where target projects on the edge. Only writes v0, so it is safe to call
+// for disjoint collapses concurrently.
+void CollapseEngine::moveVertex(unsigned int v0, unsigned int v1, const glm::vec3 & target){
+	if (uvs || normals){
+		glm::vec3 e = vertices[v1] - vertices[v0];
+		float len2 = glm::dot(e, e);
+		float t = len2 > 0.0f ? glm::dot(target - vertices[v0], e) / len2 : 0.0f;
+		t = std::min(1.0f, std::max(0.0f, t));
+		if (uvs)
+			(*uvs)[v0] = glm::mix((*uvs)[v0], (*uvs)[v1], t);
+		if (normals){
+			glm::vec3 n = glm::mix((*normals)[v0], (*normals)[v1], t);
+			if (glm::dot(n, n) > 0.0f)
+				(*normals)[v0] = glm::normalize(n);
+		}
+	}
+	vertices[v0] = target;
+	positions.set(v0, target);
+	if (cost_mode == COLLAPSE_QUADRIC)
+		quadricAdd(quadrics[v0], quadrics[v1]);
+}
+
+bool CollapseEngine::step(float max_cost){
+	while (!heap.empty()){
+		if (heap.topKey() > max_cost)
+			return false;
+		float cost = heap.topKey();
+		int h = heap.pop();
+
+		// Not collapsible right now. It comes back when its neighbourhood changes.
+		if (!mesh.canCollapse(h))
+			continue;
+
+		int oriented;
+		glm::vec3 target;
+		placement(h, oriented, target);
+		if (flips(oriented, target))
+			continue;
+
+		// The records of the steps that could have been redone are dropped too
+		if (done < history.size())
+			undo_arena.rewind(history[done].arena_mark);
+		history.resize(done + 1);
+		applyCollapse(oriented, target, history[done]);
+		done++;
+		max_collapsed = std::max(max_collapsed, cost);
+		return true;
+	}
+	return false;
+}
+
+// Collapses oriented into its origin at target and refreshes the heap,
+// filling entry with what undo() needs.
+void CollapseEngine::applyCollapse(int oriented, const glm::vec3 & target, HistoryEntry & entry){
+	unsigned int v0 = mesh.origin(oriented);
+	unsigned int v1 = mesh.target(oriented);
+	int f0 = HalfEdgeMesh::face(oriented);
+	int f1 = HalfEdgeMesh::face(mesh.twin(oriented));
+
+	// The half-edges of the two removed faces leave the heap
+	for (int k = 0; k < 3; k++){
+		heap.remove(3*f0+k);
+		heap.remove(3*f1+k);
+	}
+
+	entry.arena_mark = undo_arena.mark();
+	entry.position[0] = vertices[v0];
+	entry.position[1] = target;
+	if (uvs)
+		entry.uv = (*uvs)[v0];
+	if (normals)
+		entry.normal = (*normals)[v0];
+	if (cost_mode == COLLAPSE_QUADRIC)
+		entry.quadric = quadrics[v0];
+
+	moveVertex(v0, v1, target);
+	mesh.collapse(oriented, &entry.mesh, &undo_arena);
+
+	touchCollapsed(v0);
+	flushTouched(NULL);
+}
+
+bool CollapseEngine::undo(){
+	if (done == 0)
+		return false;
+	done--;
+	HistoryEntry & entry = history[done];
+	const CollapseRecord & r = entry.mesh;
+
+	mesh.uncollapse(r);
+	vertices[r.v0] = entry.position[0];
+	positions.set(r.v0, entry.position[0]);
+	if (uvs)
+		(*uvs)[r.v0] = entry.uv;
+	if (normals)
+		(*normals)[r.v0] = entry.normal;
+	if (cost_mode == COLLAPSE_QUADRIC)
+		quadrics[r.v0] = entry.quadric;
+
+	// Both ends have moved as far as their edges are concerned
+	touchAround(r.v1, true);
+	touchCollapsed(r.v0);
+	mesh.vertexNeighbours(r.v1, neighbours);
+	for (size_t i = 0; i < neighbours.size(); i++)
+		touchAround(neighbours[i], false);
+	flushTouched(NULL);
+	return true;
+}
+
+bool CollapseEngine::redo(){
+	if (done == history.size())
+		return false;
+	HistoryEntry & entry = history[done];
+	undo_arena.rewind(entry.arena_mark);
+	applyCollapse(entry.mesh.h, glm::vec3(entry.position[1]), entry);
+	done++;
+	return true;
+}
+
+int CollapseEngine::stepParallel(ThreadPool & pool, int max_collapses, float max_cost){
+	if (heap.empty() || max_collapses <= 0)
+		return 0;
+
+	// Only the cheapest quarter of the edges is considered, in (cost, id) order
+	candidates.resize(heap.size());
+	for (int i = 0; i < heap.size(); i++)
+		candidates[i] = heap.at(i);
+	int window = std::max(1, (int)candidates.size() / 4);
+	const IndexedMinHeap & keys = heap;
+	auto cheaper = [&keys](int a, int b){
+		return keys.keyOf(a) < keys.keyOf(b) || (keys.keyOf(a) == keys.keyOf(b) && a < b);
+	};
+	std::nth_element(candidates.begin(), candidates.begin() + (window - 1), candidates.end(), cheaper);
+	std::sort(candidates.begin(), candidates.begin() + window, cheaper);
+	while (window > 0 && heap.keyOf(candidates[window - 1]) > max_cost)
+		window--;
+
+	// Greedy independent set : a collapse claims both ends and all their
+	// neighbours, and no other collapse of this pass may touch a claimed vertex.
+	pass++;
+	selected.clear();
+	selected_targets.clear();
+	for (int i = 0; i < window && (int)selected.size() < max_collapses; i++){
+		int h = candidates[i];
+		if (!mesh.canCollapse(h))
+			continue;
+
+		int oriented;
+		glm::vec3 target;
+		placement(h, oriented, target);
+
+		unsigned int ends[2] = { mesh.origin(oriented), mesh.target(oriented) };
+		bool free = true;
+		for (int e = 0; e < 2 && free; e++){
+			if (stamp[ends[e]] == pass)
+				free = false;
+			mesh.vertexNeighbours(ends[e], neighbours);
+			for (size_t k = 0; k < neighbours.size() && free; k++)
+				if (stamp[neighbours[k]] == pass)
+					free = false;
+		}
+		if (!free || flips(oriented, target))
+			continue;
+
+		for (int e = 0; e < 2; e++){
+			stamp[ends[e]] = pass;
+			mesh.vertexNeighbours(ends[e], neighbours);
+			for (size_t k = 0; k < neighbours.size(); k++)
+				stamp[neighbours[k]] = pass;
+		}
+		selected.push_back(oriented);
+		selected_targets.push_back(target);
+		max_collapsed = std::max(max_collapsed, heap.keyOf(h));
+	}
+
+	// Nothing independent among the cheap edges : fall back to a single step
+	if (selected.empty())
+		return step(max_cost) ? 1 : 0;
+
+	history.clear();
+	done = 0;
+	undo_arena.reset();
+
+	for (size_t i = 0; i < selected.size(); i++){
+		int f0 = HalfEdgeMesh::face(selected[i]);
+		int f1 = HalfEdgeMesh::face(mesh.twin(selected[i]));
+		for (int k = 0; k < 3; k++){
+			heap.remove(3*f0+k);
+			heap.remove(3*f1+k);
+		}
+	}
+
+	pool.parallelFor((int)selected.size(), [this](int begin, int end){
+		for (int i = begin; i < end; i++){
+			int h = selected[i];
+			moveVertex(mesh.origin(h), mesh.target(h), selected_targets[i]);
+			mesh.collapse(h);
+		}
+	}, 64);
+
+	for (size_t i = 0; i < selected.size(); i++)
+		touchCollapsed(mesh.origin(selected[i]));
+	flushTouched(&pool);
+
+	return (int)selected.size();
+}
@@ -0,0 +1,138 @@
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "compact.hpp"
+
+unsigned int exclusiveScan(const std::vector<unsigned int> & flags, std::vector<unsigned int> & offsets, ThreadPool * pool){
+	int n = (int)flags.size();
+	offsets.resize(n);
+
+	// One block per chunk of work : sum each block, scan the block sums,
+	// then scan each block again starting from its offset.
+	int blocks = pool ? std::min((int)pool->size() * 4, std::max(1, n / 4096)) : 1;
+	int block_size = (n + blocks - 1) / std::max(1, blocks);
+	std::vector<unsigned int> sums(blocks + 1, 0);
+
+	parallelFor(pool, blocks, [&](int begin, int end){
+		for (int b = begin; b < end; b++){
+			unsigned int s = 0;
+			for (int i = b * block_size; i < std::min(n, (b + 1) * block_size); i++)
+				s += flags[i];
+			sums[b + 1] = s;
+		}
+	}, 1);
+
+	for (int b = 0; b < blocks; b++)
+		sums[b + 1] += sums[b];
+
+	parallelFor(pool, blocks, [&](int begin, int end){
+		for (int b = begin; b < end; b++){
+			unsigned int s = sums[b];
+			for (int i = b * block_size; i < std::min(n, (b + 1) * block_size); i++){
+				offsets[i] = s;
+				s += flags[i];
+			}
+		}
+	}, 1);
+
+	return sums[blocks];
+}
+
+template <typename T>
+static void scatter(const std::vector<T> & data, std::vector<T> & out, const std::vector<unsigned int> & keep, const std::vector<unsigned int> & offsets, unsigned int count, ThreadPool * pool){
+	out.resize(data.empty() ? 0 : count);
+	parallelFor(pool, (int)data.size(), [&](int begin, int end){
+		for (int i = begin; i < end; i++)
+			if (keep[i])
+				out[offsets[i]] = data[i];
+	}, 4096);
+}
+
+template <typename Index>
+unsigned int compactMeshInto(
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	std::vector<Index> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	CompactScratch & scratch,
+	ThreadPool * pool
+){
+	int nb_faces = (int)indices.size() / 3;
+
+	std::vector<unsigned int> & face_keep = scratch.face_keep;
+	face_keep.resize(nb_faces);
+	parallelFor(pool, nb_faces, [&](int begin, int end){
+		for (int f = begin; f < end; f++){
+			Index a = indices[3*f], b = indices[3*f+1], c = indices[3*f+2];
+			face_keep[f] = (a != b && b != c && a != c) ? 1 : 0;
+		}
+	}, 4096);
+
+	std::vector<unsigned int> & face_offsets = scratch.face_offsets;
+	unsigned int kept_faces = exclusiveScan(face_keep, face_offsets, pool);
+
+	// Marking is a scattered write, cheap enough to leave on one thread
+	std::vector<unsigned int> & vertex_keep = scratch.vertex_keep;
+	vertex_keep.assign(vertices.size(), 0);
+	for (int f = 0; f < nb_faces; f++)
+		if (face_keep[f])
+			for (int k = 0; k < 3; k++)
+				vertex_keep[indices[3*f+k]] = 1;
+
+	std::vector<unsigned int> & remap = scratch.remap;
+	unsigned int kept_vertices = exclusiveScan(vertex_keep, remap, pool);
+
+	out_indices.resize(kept_faces * 3);
+	parallelFor(pool, nb_faces, [&](int begin, int end){
+		for (int f = begin; f < end; f++){
+			if (!face_keep[f])
+				continue;
+			for (int k = 0; k < 3; k++)
+				out_indices[3*face_offsets[f]+k] = (Index)remap[indices[3*f+k]];
+		}
+	}, 4096);
+
+	scatter(vertices, out_vertices, vertex_keep, remap, kept_vertices, pool);
+	scatter(uvs, out_uvs, vertex_keep, remap, kept_vertices, pool);
+	scatter(normals, out_normals, vertex_keep, remap, kept_vertices, pool);
+
+	return kept_vertices;
+}
+
+template <typename Index>
+unsigned int compactMesh(
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	ThreadPool * pool
+){
+	std::vector<Index> out_indices;
+	std::vector<glm::vec3> out_vertices, out_normals;
+	std::vector<glm::vec2> out_uvs;
+	CompactScratch scratch;
+	unsigned int kept_vertices = compactMeshInto(indices, vertices, uvs, normals,
+		out_indices, out_vertices, out_uvs, out_normals, scratch, pool);
+	indices.swap(out_indices);
+	vertices.swap(out_vertices);
+	uvs.swap(out_uvs);
+	normals.swap(out_normals);
+	return kept_vertices;
+}
+
+template unsigned int compactMesh<unsigned short>(std::vector<unsigned short> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &, ThreadPool *);
+template unsigned int compactMesh<unsigned int>(std::vector<unsigned int> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &, ThreadPool *);
+template unsigned int compactMeshInto<unsigned short>(const std::vector<unsigned short> &, const std::vector<glm::vec3> &,
+	const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, std::vector<unsigned short> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &, CompactScratch &, ThreadPool *);
+template unsigned int compactMeshInto<unsigned int>(const std::vector<unsigned int> &, const std::vector<glm::vec3> &,
+	const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, std::vector<unsigned int> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &, CompactScratch &, ThreadPool *);
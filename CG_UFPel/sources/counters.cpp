@@ -0,0 +1,105 @@
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+
+#include "counters.hpp"
+
+PerfCounters::PerfCounters(int window)
+	: window(std::max(1, window)), started(false), collapse_ms(0.0), edges_evaluated(0.0), uploaded_bytes(0.0),
+	  live_triangles(0), live_vertices(0){
+	for (int c = 0; c < COUNTER_COUNT; c++){
+		summaries[c].min = 0.0f;
+		summaries[c].avg = 0.0f;
+		summaries[c].p99 = 0.0f;
+	}
+}
+
+const char * PerfCounters::name(Counter c){
+	static const char * names[COUNTER_COUNT] = {
+		"frame_ms", "collapse_ms", "edges_evaluated", "live_triangles", "live_vertices", "uploaded_bytes"
+	};
+	return names[c];
+}
+
+// p99 is the sample 99% of the way through the sorted ones
+PerfCounters::Stats PerfCounters::statsOf(const float * samples, size_t count, std::vector<float> & scratch){
+	Stats s = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+	if (count == 0)
+		return s;
+	scratch.assign(samples, samples + count);
+	s.min = s.max = scratch[0];
+	for (size_t i = 0; i < count; i++){
+		s.min = std::min(s.min, (double)scratch[i]);
+		s.max = std::max(s.max, (double)scratch[i]);
+		s.total += scratch[i];
+	}
+	s.avg = s.total / count;
+	size_t rank = std::min(count - 1, (size_t)(0.99 * (count - 1) + 0.5));
+	std::nth_element(scratch.begin(), scratch.begin() + rank, scratch.end());
+	s.p99 = scratch[rank];
+	return s;
+}
+
+void PerfCounters::nextFrame(){
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (started){
+		float values[COUNTER_COUNT];
+		values[FRAME_MS] = (float)std::chrono::duration<double, std::milli>(now - frame_start).count();
+		values[COLLAPSE_MS] = (float)collapse_ms;
+		values[EDGES_EVALUATED] = (float)edges_evaluated;
+		values[LIVE_TRIANGLES] = (float)live_triangles;
+		values[LIVE_VERTICES] = (float)live_vertices;
+		values[UPLOADED_BYTES] = (float)uploaded_bytes;
+
+		for (int c = 0; c < COUNTER_COUNT; c++){
+			std::vector<float> & h = history[c];
+			h.push_back(values[c]);
+			size_t n = std::min(h.size(), (size_t)window);
+			Stats s = statsOf(h.data() + h.size() - n, n, scratch);
+			summaries[c].min = (float)s.min;
+			summaries[c].avg = (float)s.avg;
+			summaries[c].p99 = (float)s.p99;
+		}
+	}
+	started = true;
+	frame_start = now;
+	collapse_ms = 0.0;
+	edges_evaluated = 0.0;
+	uploaded_bytes = 0.0;
+}
+
+bool PerfCounters::writeJson(const char * path) const{
+	FILE * file = fopen(path, "w");
+	if (file == NULL){
+		printf("Can't write %s\n", path);
+		return false;
+	}
+
+	std::vector<float> sorted;
+	const std::vector<float> & frame_times = history[FRAME_MS];
+	double seconds = 0.0;
+	for (size_t i = 0; i < frame_times.size(); i++)
+		seconds += frame_times[i] / 1000.0;
+
+	fprintf(file, "{\n  \"frames\": %d,\n  \"seconds\": %.3f,\n  \"window\": %d,\n  \"counters\": {\n", frames(), seconds, window);
+	for (int c = 0; c < COUNTER_COUNT; c++){
+		const std::vector<float> & h = history[c];
+		size_t n = std::min(h.size(), (size_t)window);
+		Stats all = statsOf(h.data(), h.size(), sorted);
+		Stats recent = statsOf(h.data() + h.size() - n, n, sorted);
+		fprintf(file, "    \"%s\": {\n", name((Counter)c));
+		fprintf(file, "      \"total\": %.3f,\n", all.total);
+		fprintf(file, "      \"session\": {\"min\": %.3f, \"avg\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n", all.min, all.avg, all.p99, all.max);
+		fprintf(file, "      \"window\": {\"min\": %.3f, \"avg\": %.3f, \"p99\": %.3f, \"max\": %.3f}\n", recent.min, recent.avg, recent.p99, recent.max);
+		fprintf(file, "    }%s\n", c + 1 < COUNTER_COUNT ? "," : "");
+	}
+	fprintf(file, "  }\n}\n");
+
+	bool ok = !ferror(file);
+	if (fclose(file) != 0 || !ok){
+		printf("Can't write %s\n", path);
+		return false;
+	}
+	return true;
+}
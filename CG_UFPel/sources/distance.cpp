@@ -0,0 +1,298 @@
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <float.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "distance.hpp"
+
+static const int LEAF_SIZE = 4;
+static const int MAX_DEPTH = 64;
+
+TriangleBVH::TriangleBVH(){
+}
+
+template <typename Index>
+void TriangleBVH::build(const std::vector<Index> & indices, const std::vector<glm::vec3> & vertices){
+	nodes.clear();
+	corners.clear();
+	face_of.clear();
+
+	std::vector<glm::vec3> centroids;
+	for (size_t f = 0; f + 2 < indices.size(); f += 3){
+		const glm::vec3 & a = vertices[indices[f]];
+		const glm::vec3 & b = vertices[indices[f+1]];
+		const glm::vec3 & c = vertices[indices[f+2]];
+		if (glm::length(glm::cross(b - a, c - a)) == 0.0f)
+			continue;
+		corners.push_back(a);
+		corners.push_back(b);
+		corners.push_back(c);
+		face_of.push_back((int)(f / 3));
+		centroids.push_back((a + b + c) / 3.0f);
+	}
+	if (face_of.empty())
+		return;
+
+	nodes.reserve(2 * face_of.size() / LEAF_SIZE + 1);
+	nodes.push_back(Node());
+	split(0, 0, (int)face_of.size(), centroids, 0);
+}
+
+template void TriangleBVH::build<unsigned short>(const std::vector<unsigned short> &, const std::vector<glm::vec3> &);
+template void TriangleBVH::build<unsigned int>(const std::vector<unsigned int> &, const std::vector<glm::vec3> &);
+
+// Fits node to the triangles [begin, end) and splits it in two at the median
+// centroid along the longest axis, reordering the triangles as it goes
+void TriangleBVH::split(int node, int begin, int end, std::vector<glm::vec3> & centroids, int depth){
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX), clo(FLT_MAX), chi(-FLT_MAX);
+	for (int t = begin; t < end; t++){
+		for (int k = 0; k < 3; k++){
+			lo = glm::min(lo, corners[3*t+k]);
+			hi = glm::max(hi, corners[3*t+k]);
+		}
+		clo = glm::min(clo, centroids[t]);
+		chi = glm::max(chi, centroids[t]);
+	}
+	nodes[node].box_min = lo;
+	nodes[node].box_max = hi;
+
+	glm::vec3 extent = chi - clo;
+	int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+	if (end - begin <= LEAF_SIZE || extent[axis] == 0.0f || depth >= MAX_DEPTH){
+		nodes[node].first = begin;
+		nodes[node].count = end - begin;
+		return;
+	}
+
+	// Sort a permutation so corners, centroids and faces move together
+	int mid = (begin + end) / 2;
+	std::vector<int> order(end - begin);
+	for (int i = 0; i < end - begin; i++)
+		order[i] = begin + i;
+	std::nth_element(order.begin(), order.begin() + (mid - begin), order.end(), [&](int a, int b){
+		return centroids[a][axis] < centroids[b][axis];
+	});
+	std::vector<glm::vec3> moved_corners(3 * (end - begin)), moved_centroids(end - begin);
+	std::vector<int> moved_faces(end - begin);
+	for (int i = 0; i < end - begin; i++){
+		for (int k = 0; k < 3; k++)
+			moved_corners[3*i+k] = corners[3*order[i]+k];
+		moved_centroids[i] = centroids[order[i]];
+		moved_faces[i] = face_of[order[i]];
+	}
+	std::copy(moved_corners.begin(), moved_corners.end(), corners.begin() + 3 * begin);
+	std::copy(moved_centroids.begin(), moved_centroids.end(), centroids.begin() + begin);
+	std::copy(moved_faces.begin(), moved_faces.end(), face_of.begin() + begin);
+
+	int left = (int)nodes.size();
+	nodes.push_back(Node());
+	nodes.push_back(Node());
+	nodes[node].first = left;
+	nodes[node].count = 0;
+	split(left, begin, mid, centroids, depth + 1);
+	split(left + 1, mid, end, centroids, depth + 1);
+}
+
+// Closest point to p on triangle (a, b, c), from Ericson's Real-Time
+// Collision Detection : find the Voronoi region of p, then project
+static glm::vec3 closest_on_triangle(const glm::vec3 & p, const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c){
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return a;
+
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return a + ab * (d1 / (d1 - d3));
+
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return a + ac * (d2 / (d2 - d6));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Squared distance from p to a box, 0 inside
+static float box_distance2(const glm::vec3 & p, const glm::vec3 & lo, const glm::vec3 & hi){
+	glm::vec3 d = glm::max(glm::max(lo - p, p - hi), glm::vec3(0.0f));
+	return glm::dot(d, d);
+}
+
+float TriangleBVH::closestPoint(const glm::vec3 & p, glm::vec3 & closest, int * triangle) const{
+	if (nodes.empty())
+		return -1.0f;
+
+	float best = FLT_MAX;
+	int best_face = -1;
+	int stack[2 * MAX_DEPTH + 2];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0){
+		const Node & node = nodes[stack[--top]];
+		if (box_distance2(p, node.box_min, node.box_max) >= best)
+			continue;
+
+		if (node.count > 0){
+			for (int t = node.first; t < node.first + node.count; t++){
+				glm::vec3 q = closest_on_triangle(p, corners[3*t], corners[3*t+1], corners[3*t+2]);
+				glm::vec3 d = q - p;
+				float d2 = glm::dot(d, d);
+				if (d2 < best){
+					best = d2;
+					best_face = t;
+					closest = q;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so the farther one is more often pruned
+		int near_child = node.first, far_child = node.first + 1;
+		if (box_distance2(p, nodes[far_child].box_min, nodes[far_child].box_max)
+			< box_distance2(p, nodes[near_child].box_min, nodes[near_child].box_max))
+			std::swap(near_child, far_child);
+		stack[top++] = far_child;
+		stack[top++] = near_child;
+	}
+
+	if (triangle)
+		*triangle = face_of[best_face];
+	return best;
+}
+
+// Small hash RNG, so sample i is the same whichever thread draws it
+static float sample_random(unsigned int i, unsigned int stream){
+	unsigned int h = i * 0x9E3779B9u ^ (stream + 0x7F4A7C15u) * 0x85EBCA6Bu;
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+// Distances from the vertices and area samples of one mesh to the other
+template <typename Index>
+static DistanceStats one_side(
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const TriangleBVH & target,
+	int samples,
+	ThreadPool * pool
+){
+	DistanceStats stats = { 0, 0.0, 0.0, 0.0 };
+	int nb_faces = (int)indices.size() / 3;
+
+	// Only vertices used by a face are on the surface
+	std::vector<glm::vec3> points;
+	std::vector<unsigned char> used(vertices.size(), 0);
+	for (size_t i = 0; i < (size_t)nb_faces * 3; i++)
+		used[indices[i]] = 1;
+	for (size_t v = 0; v < vertices.size(); v++)
+		if (used[v])
+			points.push_back(vertices[v]);
+
+	// Area samples : pick a face by cumulative area, then a uniform point in it
+	std::vector<double> cumulative(nb_faces + 1, 0.0);
+	for (int f = 0; f < nb_faces; f++){
+		const glm::vec3 & a = vertices[indices[3*f]];
+		const glm::vec3 & b = vertices[indices[3*f+1]];
+		const glm::vec3 & c = vertices[indices[3*f+2]];
+		cumulative[f + 1] = cumulative[f] + 0.5 * glm::length(glm::cross(b - a, c - a));
+	}
+	int first_sample = (int)points.size();
+	if (cumulative[nb_faces] > 0.0)
+		points.resize(first_sample + samples);
+	else
+		samples = 0;
+
+	parallelFor(pool, samples, [&](int begin, int end){
+		for (int s = begin; s < end; s++){
+			double r = sample_random(s, 0) * cumulative[nb_faces];
+			int f = (int)(std::upper_bound(cumulative.begin() + 1, cumulative.end(), r) - cumulative.begin()) - 1;
+			f = std::min(std::max(f, 0), nb_faces - 1);
+			float u = sample_random(s, 1), v = sample_random(s, 2);
+			if (u + v > 1.0f){
+				u = 1.0f - u;
+				v = 1.0f - v;
+			}
+			const glm::vec3 & a = vertices[indices[3*f]];
+			const glm::vec3 & b = vertices[indices[3*f+1]];
+			const glm::vec3 & c = vertices[indices[3*f+2]];
+			points[first_sample + s] = a + (b - a) * u + (c - a) * v;
+		}
+	}, 1024);
+
+	std::vector<float> distances(points.size());
+	parallelFor(pool, (int)points.size(), [&](int begin, int end){
+		glm::vec3 closest;
+		for (int i = begin; i < end; i++){
+			float d2 = target.closestPoint(points[i], closest);
+			distances[i] = d2 >= 0.0f ? sqrtf(d2) : 0.0f;
+		}
+	}, 256);
+
+	// Summed in order so the result doesn't depend on the pool
+	double sum = 0.0, sum2 = 0.0, max = 0.0;
+	for (size_t i = 0; i < distances.size(); i++){
+		double d = distances[i];
+		sum += d;
+		sum2 += d * d;
+		max = std::max(max, d);
+	}
+	stats.samples = (int)distances.size();
+	if (stats.samples > 0){
+		stats.mean = sum / stats.samples;
+		stats.rms = sqrt(sum2 / stats.samples);
+		stats.max = max;
+	}
+	return stats;
+}
+
+template <typename Index>
+SurfaceDistance measureSurfaceDistance(
+	const std::vector<Index> & indices_a,
+	const std::vector<glm::vec3> & vertices_a,
+	const std::vector<Index> & indices_b,
+	const std::vector<glm::vec3> & vertices_b,
+	int samples_per_side,
+	ThreadPool * pool
+){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	TriangleBVH tree_a, tree_b;
+	tree_a.build(indices_a, vertices_a);
+	tree_b.build(indices_b, vertices_b);
+
+	SurfaceDistance result;
+	result.forward = one_side(indices_a, vertices_a, tree_b, samples_per_side, pool);
+	result.backward = one_side(indices_b, vertices_b, tree_a, samples_per_side, pool);
+	result.hausdorff = std::max(result.forward.max, result.backward.max);
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+template SurfaceDistance measureSurfaceDistance<unsigned short>(const std::vector<unsigned short> &, const std::vector<glm::vec3> &,
+	const std::vector<unsigned short> &, const std::vector<glm::vec3> &, int, ThreadPool *);
+template SurfaceDistance measureSurfaceDistance<unsigned int>(const std::vector<unsigned int> &, const std::vector<glm::vec3> &,
+	const std::vector<unsigned int> &, const std::vector<glm::vec3> &, int, ThreadPool *);
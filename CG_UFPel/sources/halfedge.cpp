@@ -0,0 +1,385 @@
+#include <vector>
+#include <stddef.h>
+
+#include "halfedge.hpp"
+
+HalfEdgeMesh::HalfEdgeMesh() : live_faces(0), mark_stamp(0){
+}
+
+// Directed edge key for the twin lookup
+static unsigned long long edge_key(unsigned int from, unsigned int to){
+	return ((unsigned long long)from << 32) | to;
+}
+
+// Open addressing table from directed edge to half-edge, in two flat
+// arrays so building a mesh costs a couple of allocations instead of one
+// per half-edge. Keys never equal EMPTY_EDGE since vertex ids are below
+// 2^32 - 1.
+static const unsigned long long EMPTY_EDGE = ~0ull;
+
+struct EdgeTable{
+	std::vector<unsigned long long> keys;
+	std::vector<int> values;
+	size_t mask;
+
+	explicit EdgeTable(size_t count){
+		size_t size = 16;
+		while (size < 2 * count)
+			size *= 2;
+		keys.assign(size, EMPTY_EDGE);
+		values.assign(size, -1);
+		mask = size - 1;
+	}
+
+	size_t slot(unsigned long long key) const{
+		size_t s = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 20) & mask;
+		while (keys[s] != EMPTY_EDGE && keys[s] != key)
+			s = (s + 1) & mask;
+		return s;
+	}
+
+	// Returns false if the key was already there
+	bool insert(unsigned long long key, int value){
+		size_t s = slot(key);
+		if (keys[s] == key)
+			return false;
+		keys[s] = key;
+		values[s] = value;
+		return true;
+	}
+
+	bool find(unsigned long long key, int & value) const{
+		size_t s = slot(key);
+		value = values[s];
+		return keys[s] == key;
+	}
+
+	void set(unsigned long long key, int value){
+		values[slot(key)] = value;
+	}
+};
+
+template <typename Index>
+void HalfEdgeMesh::build(const std::vector<Index> & indices, unsigned int vertex_count){
+
+	int nb_halfedges = (int)(indices.size() / 3) * 3;
+
+	vertex_of.assign(indices.begin(), indices.begin() + nb_halfedges);
+	twin_of.assign(nb_halfedges, -1);
+	out_of.assign(vertex_count, -1);
+	face_removed.assign(nb_halfedges / 3, 0);
+	vertex_flags.assign(vertex_count, 0);
+	vertex_mark.assign(vertex_count, 0);
+	mark_stamp = 0;
+	live_faces = 0;
+
+	for (int f = 0; f < nb_halfedges / 3; f++){
+		unsigned int a = vertex_of[3*f], b = vertex_of[3*f+1], c = vertex_of[3*f+2];
+		if (a == b || b == c || a == c)
+			face_removed[f] = 1;
+		else
+			live_faces++;
+	}
+
+	// Every directed edge, -1 when it is used by more than one face
+	EdgeTable directed(nb_halfedges);
+	for (int h = 0; h < nb_halfedges; h++){
+		if (face_removed[face(h)])
+			continue;
+		unsigned long long key = edge_key(origin(h), target(h));
+		if (!directed.insert(key, h)){
+			directed.set(key, -1);
+			vertex_flags[origin(h)] |= VERTEX_LOCKED;
+			vertex_flags[target(h)] |= VERTEX_LOCKED;
+		}
+	}
+
+	std::vector<int> incident(vertex_count, 0);
+	for (int h = 0; h < nb_halfedges; h++){
+		if (face_removed[face(h)])
+			continue;
+		incident[origin(h)]++;
+		out_of[origin(h)] = h;
+
+		int own, opp;
+		directed.find(edge_key(origin(h), target(h)), own);
+		if (own >= 0 && directed.find(edge_key(target(h), origin(h)), opp) && opp >= 0)
+			twin_of[h] = opp;
+		else
+			vertex_flags[origin(h)] |= VERTEX_BORDER;
+		if (twin_of[h] < 0)
+			vertex_flags[target(h)] |= VERTEX_BORDER;
+	}
+
+	// A vertex whose faces cannot all be reached by walking around it is
+	// non-manifold (two fans touching at a point) : leave it alone.
+	std::vector<int> ring;
+	for (unsigned int v = 0; v < vertex_count; v++){
+		if (out_of[v] < 0){
+			vertex_flags[v] |= VERTEX_REMOVED;
+			continue;
+		}
+		vertexOutgoing(v, ring);
+		if ((int)ring.size() != incident[v])
+			vertex_flags[v] |= VERTEX_LOCKED;
+	}
+}
+
+template <typename Index>
+void HalfEdgeMesh::writeIndices(std::vector<Index> & indices) const{
+	indices.resize(vertex_of.size());
+	for (size_t i = 0; i < vertex_of.size(); i++)
+		indices[i] = (Index)vertex_of[i];
+}
+
+template void HalfEdgeMesh::build<unsigned short>(const std::vector<unsigned short> &, unsigned int);
+template void HalfEdgeMesh::build<unsigned int>(const std::vector<unsigned int> &, unsigned int);
+template void HalfEdgeMesh::writeIndices<unsigned short>(std::vector<unsigned short> &) const;
+template void HalfEdgeMesh::writeIndices<unsigned int>(std::vector<unsigned int> &) const;
+
+void HalfEdgeMesh::vertexOutgoing(unsigned int v, std::vector<int> & out) const{
+	out.clear();
+	int start = out_of[v];
+	if (start < 0)
+		return;
+
+	// Turn one way around v until we are back at the start or hit a border...
+	int h = start;
+	do{
+		out.push_back(h);
+		h = twin_of[prev(h)];
+	} while (h >= 0 && h != start);
+
+	if (h == start)
+		return;
+
+	// ...and if we hit a border, turn the other way from the start too.
+	h = start;
+	while (twin_of[h] >= 0){
+		h = next(twin_of[h]);
+		out.push_back(h);
+	}
+}
+
+void HalfEdgeMesh::vertexNeighbours(unsigned int v, std::vector<unsigned int> & out) const{
+	out.clear();
+	std::vector<int> & ring = ring_a;
+	vertexOutgoing(v, ring);
+	for (size_t i = 0; i < ring.size(); i++){
+		int h = ring[i];
+		out.push_back(target(h));
+		// The last face of a border fan has one more neighbour behind it
+		if (twin_of[prev(h)] < 0)
+			out.push_back(origin(prev(h)));
+	}
+}
+
+void HalfEdgeMesh::vertexFaces(unsigned int v, std::vector<int> & out) const{
+	vertexOutgoing(v, out);
+	for (size_t i = 0; i < out.size(); i++)
+		out[i] = face(out[i]);
+}
+
+int HalfEdgeMesh::valence(unsigned int v) const{
+	vertexOutgoing(v, ring_b);
+	int n = (int)ring_b.size();
+	for (size_t i = 0; i < ring_b.size(); i++)
+		if (twin_of[prev(ring_b[i])] < 0)
+			n++;
+	return n;
+}
+
+bool HalfEdgeMesh::canCollapse(int h) const{
+	if (face_removed[face(h)])
+		return false;
+
+	int t = twin_of[h];
+	if (t < 0)
+		return false;
+
+	unsigned int v0 = origin(h), v1 = target(h);
+	if (isLockedVertex(v0) || isLockedVertex(v1))
+		return false;
+
+	// Collapsing an inner edge between two border vertices pinches the mesh
+	if (isBorderVertex(v0) && isBorderVertex(v1))
+		return false;
+
+	unsigned int a = origin(prev(h));
+	unsigned int b = origin(prev(t));
+	if (a == b)
+		return false;
+
+	// Link condition : the only vertices adjacent to both ends are a and b
+	vertexNeighbours(v0, near_a);
+	vertexNeighbours(v1, near_b);
+	if (++mark_stamp == 0){
+		vertex_mark.assign(vertex_mark.size(), 0);
+		mark_stamp = 1;
+	}
+	for (size_t i = 0; i < near_b.size(); i++)
+		vertex_mark[near_b[i]] = mark_stamp;
+
+	int common = 0;
+	for (size_t i = 0; i < near_a.size(); i++){
+		if (vertex_mark[near_a[i]] != mark_stamp)
+			continue;
+		if (near_a[i] != a && near_a[i] != b)
+			return false;
+		common++;
+	}
+	if (common != 2)
+		return false;
+
+	// Don't leave behind vertices with fewer than three neighbours
+	if ((int)(near_a.size() + near_b.size()) - 4 < 3)
+		return false;
+	if (valence(a) <= 3 || valence(b) <= 3)
+		return false;
+
+	return true;
+}
+
+void HalfEdgeMesh::removeFace(int f, unsigned int v){
+	face_removed[f] = 1;
+	live_faces--;
+	for (int k = 0; k < 3; k++){
+		vertex_of[3*f+k] = v;
+		twin_of[3*f+k] = -1;
+	}
+}
+
+// Same walk as vertexOutgoing(), renaming as it goes. Only origins change,
+// so the walk itself is not affected.
+void HalfEdgeMesh::renameOutgoing(unsigned int from, unsigned int to, std::vector<int> * renamed){
+	int start = out_of[from];
+	int h = start;
+	do{
+		vertex_of[h] = to;
+		if (renamed)
+			renamed->push_back(h);
+		h = twin_of[prev(h)];
+	} while (h >= 0 && h != start);
+
+	if (h == start)
+		return;
+
+	h = start;
+	while (twin_of[h] >= 0){
+		h = next(twin_of[h]);
+		vertex_of[h] = to;
+		if (renamed)
+			renamed->push_back(h);
+	}
+}
+
+void HalfEdgeMesh::collapse(int h, CollapseRecord * record, Arena * arena){
+	int t = twin_of[h];
+	unsigned int v0 = origin(h), v1 = target(h);
+
+	// Face of h is (v0, v1, a), face of t is (v1, v0, b)
+	int hn = next(h), hp = prev(h);
+	int tn = next(t), tp = prev(t);
+	unsigned int a = origin(hp);
+	unsigned int b = origin(tp);
+
+	// Outer neighbours of the two faces that go away
+	int a_v1 = twin_of[hn];  // a -> v1
+	int v0_a = twin_of[hp];  // v0 -> a
+	int b_v0 = twin_of[tn];  // b -> v0
+	int v1_b = twin_of[tp];  // v1 -> b
+
+	if (record){
+		record->h = h;
+		record->t = t;
+		record->v0 = v0;
+		record->v1 = v1;
+		record->a = a;
+		record->b = b;
+		record->outer[0] = a_v1;
+		record->outer[1] = v0_a;
+		record->outer[2] = b_v0;
+		record->outer[3] = v1_b;
+		record->out_v0 = out_of[v0];
+		record->out_v1 = out_of[v1];
+		record->out_a = out_of[a];
+		record->out_b = out_of[b];
+		record->flags_v0 = vertex_flags[v0];
+		record->flags_v1 = vertex_flags[v1];
+	}
+
+	// Everything leaving v1 now leaves v0 : this is the index buffer rewrite
+	if (record)
+		ring_a.clear();
+	renameOutgoing(v1, v0, record ? &ring_a : NULL);
+	if (record){
+		int * renamed = arena->allocateArray<int>(ring_a.size());
+		for (size_t i = 0; i < ring_a.size(); i++)
+			renamed[i] = ring_a[i];
+		record->renamed = renamed;
+		record->renamed_count = (int)ring_a.size();
+	}
+
+	// Stitch the outer edges together across the removed faces
+	if (a_v1 >= 0) twin_of[a_v1] = v0_a;
+	if (v0_a >= 0) twin_of[v0_a] = a_v1;
+	if (b_v0 >= 0) twin_of[b_v0] = v1_b;
+	if (v1_b >= 0) twin_of[v1_b] = b_v0;
+
+	removeFace(face(h), v0);
+	removeFace(face(t), v0);
+
+	vertex_flags[v0] |= vertex_flags[v1] & (VERTEX_BORDER | VERTEX_LOCKED);
+	vertex_flags[v1] |= VERTEX_REMOVED;
+	out_of[v1] = -1;
+
+	// Re-point the outgoing half-edges that lived in the removed faces.
+	// v0 and v1 are never both on a border, so one of these exists.
+	if (v0_a >= 0)
+		out_of[v0] = v0_a;
+	else if (v1_b >= 0)
+		out_of[v0] = v1_b;
+	else if (a_v1 >= 0)
+		out_of[v0] = next(a_v1);
+	else
+		out_of[v0] = next(b_v0);
+
+	if (face_removed[face(out_of[a])])
+		out_of[a] = (a_v1 >= 0) ? a_v1 : (v0_a >= 0 ? next(v0_a) : -1);
+	if (face_removed[face(out_of[b])])
+		out_of[b] = (b_v0 >= 0) ? b_v0 : (v1_b >= 0 ? next(v1_b) : -1);
+}
+
+void HalfEdgeMesh::uncollapse(const CollapseRecord & r){
+	for (int i = 0; i < r.renamed_count; i++)
+		vertex_of[r.renamed[i]] = r.v1;
+
+	// Put the two faces back : (v0, v1, a) and (v1, v0, b)
+	int f0 = face(r.h), f1 = face(r.t);
+	vertex_of[r.h] = r.v0;
+	vertex_of[next(r.h)] = r.v1;
+	vertex_of[prev(r.h)] = r.a;
+	vertex_of[r.t] = r.v1;
+	vertex_of[next(r.t)] = r.v0;
+	vertex_of[prev(r.t)] = r.b;
+	face_removed[f0] = 0;
+	face_removed[f1] = 0;
+	live_faces += 2;
+
+	// Undo the stitching
+	int inner[4] = { next(r.h), prev(r.h), next(r.t), prev(r.t) };
+	twin_of[r.h] = r.t;
+	twin_of[r.t] = r.h;
+	for (int k = 0; k < 4; k++){
+		twin_of[inner[k]] = r.outer[k];
+		if (r.outer[k] >= 0)
+			twin_of[r.outer[k]] = inner[k];
+	}
+
+	vertex_flags[r.v0] = r.flags_v0;
+	vertex_flags[r.v1] = r.flags_v1;
+	out_of[r.v0] = r.out_v0;
+	out_of[r.v1] = r.out_v1;
+	out_of[r.a] = r.out_a;
+	out_of[r.b] = r.out_b;
+}
@@ -0,0 +1,82 @@
+#include <vector>
+#include <stddef.h>
+
+#include "indexedheap.hpp"
+
+void IndexedMinHeap::reset(int capacity){
+	heap.clear();
+	heap.reserve(capacity);
+	slot.assign(capacity, -1);
+	key.assign(capacity, 0.0f);
+}
+
+void IndexedMinHeap::clear(){
+	for (size_t i = 0; i < heap.size(); i++)
+		slot[heap[i]] = -1;
+	heap.clear();
+}
+
+void IndexedMinHeap::update(int id, float k){
+	if (slot[id] < 0){
+		key[id] = k;
+		heap.push_back(id);
+		slot[id] = (int)heap.size() - 1;
+		siftUp(slot[id]);
+		return;
+	}
+	float old = key[id];
+	key[id] = k;
+	if (k < old)
+		siftUp(slot[id]);
+	else
+		siftDown(slot[id]);
+}
+
+void IndexedMinHeap::remove(int id){
+	int i = slot[id];
+	if (i < 0)
+		return;
+	slot[id] = -1;
+	int last = heap.back();
+	heap.pop_back();
+	if (i == (int)heap.size())
+		return;
+	place(i, last);
+	siftUp(i);
+	siftDown(slot[last]);
+}
+
+int IndexedMinHeap::pop(){
+	int id = heap[0];
+	remove(id);
+	return id;
+}
+
+void IndexedMinHeap::siftUp(int i){
+	int id = heap[i];
+	while (i > 0){
+		int parent = (i - 1) / 2;
+		if (!less(id, heap[parent]))
+			break;
+		place(i, heap[parent]);
+		i = parent;
+	}
+	place(i, id);
+}
+
+void IndexedMinHeap::siftDown(int i){
+	int id = heap[i];
+	int n = (int)heap.size();
+	while (true){
+		int child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && less(heap[child + 1], heap[child]))
+			child++;
+		if (!less(heap[child], id))
+			break;
+		place(i, heap[child]);
+		i = child;
+	}
+	place(i, id);
+}
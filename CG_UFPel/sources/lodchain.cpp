@@ -0,0 +1,264 @@
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include <glm/glm.hpp>
+
+#include "halfedge.hpp"
+#include "collapse.hpp"
+#include "lodchain.hpp"
+
+// File layout, little-endian :
+//   "LODS", version, flags, vertex count, level count, index count
+//   per level : first index, index count, max error (float)
+//   positions, uvs and normals (when flagged), indices as uint32
+static const char LOD_MAGIC[4] = { 'L', 'O', 'D', 'S' };
+static const unsigned int LOD_VERSION = 1;
+enum { LOD_HAS_UVS = 1, LOD_HAS_NORMALS = 2 };
+
+static const unsigned int NOT_EMITTED = 0xFFFFFFFFu;
+
+LodChain::LodChain(){
+}
+
+void LodChain::clear(){
+	levels.clear();
+	index_buffer.clear();
+	positions.clear();
+	texcoords.clear();
+	vertex_normals.clear();
+}
+
+template <typename Index>
+bool LodChain::build(
+	const std::vector<Index> & in_indices,
+	const std::vector<glm::vec3> & in_vertices,
+	const std::vector<glm::vec2> & in_uvs,
+	const std::vector<glm::vec3> & in_normals,
+	const std::vector<int> & triangles,
+	CollapseCost cost,
+	ThreadPool * pool,
+	float max_error
+){
+	clear();
+	bool has_uvs = !in_uvs.empty();
+	bool has_normals = !in_normals.empty();
+	if ((has_uvs && in_uvs.size() != in_vertices.size()) || (has_normals && in_normals.size() != in_vertices.size())){
+		printf("LodChain : attributes don't match the %d vertices\n", (int)in_vertices.size());
+		return false;
+	}
+
+	// The engine moves the working copies, the chain only appends to its own
+	std::vector<glm::vec3> work_vertices = in_vertices;
+	std::vector<glm::vec2> work_uvs = in_uvs;
+	std::vector<glm::vec3> work_normals = in_normals;
+
+	HalfEdgeMesh mesh;
+	mesh.build(in_indices, (unsigned int)in_vertices.size());
+	CollapseEngine engine(mesh, work_vertices, cost);
+	engine.setAttributes(has_uvs ? &work_uvs : NULL, has_normals ? &work_normals : NULL);
+	engine.init(pool);
+
+	// emitted[v] is where v was last appended to the shared buffer
+	std::vector<unsigned int> emitted(in_vertices.size(), NOT_EMITTED);
+	std::function<unsigned int(unsigned int)> emit = [&](unsigned int v){
+		unsigned int e = emitted[v];
+		if (e != NOT_EMITTED && positions[e] == work_vertices[v]
+			&& (!has_uvs || texcoords[e] == work_uvs[v])
+			&& (!has_normals || vertex_normals[e] == work_normals[v]))
+			return e;
+		e = (unsigned int)positions.size();
+		positions.push_back(work_vertices[v]);
+		if (has_uvs)
+			texcoords.push_back(work_uvs[v]);
+		if (has_normals)
+			vertex_normals.push_back(work_normals[v]);
+		emitted[v] = e;
+		return e;
+	};
+
+	std::function<void()> snapshot = [&](){
+		Level level;
+		level.first_index = (unsigned int)index_buffer.size();
+		level.max_error = engine.maxCollapsedCost();
+		for (int f = 0; f < mesh.faceCount(); f++){
+			if (mesh.isFaceRemoved(f))
+				continue;
+			for (int k = 0; k < 3; k++)
+				index_buffer.push_back(emit(mesh.origin(3*f+k)));
+		}
+		level.index_count = (unsigned int)index_buffer.size() - level.first_index;
+		levels.push_back(level);
+	};
+
+	snapshot();
+	levels[0].max_error = 0.0f;
+
+	std::vector<int> targets(triangles);
+	std::sort(targets.begin(), targets.end(), std::greater<int>());
+	float max_cost = max_error >= 0.0f ? max_error : FLT_MAX;
+	for (size_t i = 0; i < targets.size(); i++){
+		int target = std::max(0, targets[i]);
+
+		// Every collapse removes exactly two triangles
+		if (pool){
+			while (mesh.liveFaceCount() > target)
+				if (engine.stepParallel(*pool, (mesh.liveFaceCount() - target + 1) / 2, max_cost) == 0)
+					break;
+		}else{
+			while (mesh.liveFaceCount() > target && engine.step(max_cost))
+				;
+		}
+		snapshot();
+	}
+	return true;
+}
+
+template <typename Index>
+bool LodChain::build(
+	const std::vector<Index> & in_indices,
+	const std::vector<glm::vec3> & in_vertices,
+	const std::vector<glm::vec2> & in_uvs,
+	const std::vector<glm::vec3> & in_normals,
+	const std::vector<float> & ratios,
+	CollapseCost cost,
+	ThreadPool * pool
+){
+	// Ratios are of the triangles the half-edge mesh keeps, degenerate ones aside
+	int before = 0;
+	for (size_t i = 0; i + 2 < in_indices.size(); i += 3){
+		Index a = in_indices[i], b = in_indices[i + 1], c = in_indices[i + 2];
+		if (a != b && b != c && a != c)
+			before++;
+	}
+	std::vector<int> triangles(ratios.size());
+	for (size_t i = 0; i < ratios.size(); i++)
+		triangles[i] = (int)(before * ratios[i]);
+	return build(in_indices, in_vertices, in_uvs, in_normals, triangles, cost, pool);
+}
+
+template bool LodChain::build<unsigned short>(const std::vector<unsigned short> &, const std::vector<glm::vec3> &,
+	const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, const std::vector<float> &, CollapseCost, ThreadPool *);
+template bool LodChain::build<unsigned int>(const std::vector<unsigned int> &, const std::vector<glm::vec3> &,
+	const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, const std::vector<float> &, CollapseCost, ThreadPool *);
+template bool LodChain::build<unsigned short>(const std::vector<unsigned short> &, const std::vector<glm::vec3> &,
+	const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, const std::vector<int> &, CollapseCost, ThreadPool *, float);
+template bool LodChain::build<unsigned int>(const std::vector<unsigned int> &, const std::vector<glm::vec3> &,
+	const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, const std::vector<int> &, CollapseCost, ThreadPool *, float);
+
+static void write_u32(FILE * file, unsigned int value){
+	fwrite(&value, 4, 1, file);
+}
+
+bool LodChain::save(const char * path) const{
+	FILE * file = fopen(path, "wb");
+	if (!file){
+		printf("%s could not be opened for writing\n", path);
+		return false;
+	}
+
+	bool has_uvs = !texcoords.empty(), has_normals = !vertex_normals.empty();
+	fwrite(LOD_MAGIC, 1, 4, file);
+	write_u32(file, LOD_VERSION);
+	write_u32(file, (has_uvs ? LOD_HAS_UVS : 0) | (has_normals ? LOD_HAS_NORMALS : 0));
+	write_u32(file, (unsigned int)positions.size());
+	write_u32(file, (unsigned int)levels.size());
+	write_u32(file, (unsigned int)index_buffer.size());
+
+	for (size_t i = 0; i < levels.size(); i++){
+		write_u32(file, levels[i].first_index);
+		write_u32(file, levels[i].index_count);
+		fwrite(&levels[i].max_error, 4, 1, file);
+	}
+
+	fwrite(positions.data(), sizeof(glm::vec3), positions.size(), file);
+	if (has_uvs)
+		fwrite(texcoords.data(), sizeof(glm::vec2), texcoords.size(), file);
+	if (has_normals)
+		fwrite(vertex_normals.data(), sizeof(glm::vec3), vertex_normals.size(), file);
+	fwrite(index_buffer.data(), 4, index_buffer.size(), file);
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	if (!ok)
+		printf("%s could not be written\n", path);
+	return ok;
+}
+
+static bool read_u32(FILE * file, unsigned int & value){
+	return fread(&value, 4, 1, file) == 1;
+}
+
+bool LodChain::load(const char * path){
+	clear();
+
+	FILE * file = fopen(path, "rb");
+	if (!file){
+		printf("%s could not be opened\n", path);
+		return false;
+	}
+
+	char magic[4];
+	unsigned int version, flags, nb_vertices, nb_levels, nb_indices;
+	if (fread(magic, 1, 4, file) != 4 || memcmp(magic, LOD_MAGIC, 4) != 0
+		|| !read_u32(file, version) || version != LOD_VERSION
+		|| !read_u32(file, flags) || !read_u32(file, nb_vertices)
+		|| !read_u32(file, nb_levels) || !read_u32(file, nb_indices)){
+		printf("%s is not a LOD set file\n", path);
+		fclose(file);
+		return false;
+	}
+
+	// The counts must fit in what is left of the file before anything is
+	// allocated for them
+	long header_end = ftell(file);
+	fseek(file, 0, SEEK_END);
+	unsigned long long left = (unsigned long long)(ftell(file) - header_end);
+	fseek(file, header_end, SEEK_SET);
+	unsigned long long vertex_bytes = 12 + ((flags & LOD_HAS_UVS) ? 8 : 0) + ((flags & LOD_HAS_NORMALS) ? 12 : 0);
+	bool ok = 12ull * nb_levels + vertex_bytes * nb_vertices + 4ull * nb_indices <= left
+		&& nb_vertices <= INT_MAX && nb_indices <= INT_MAX;
+	if (!ok){
+		printf("%s is truncated or corrupt\n", path);
+		fclose(file);
+		return false;
+	}
+
+	levels.resize(nb_levels);
+	for (unsigned int i = 0; i < nb_levels && ok; i++){
+		Level & level = levels[i];
+		ok = read_u32(file, level.first_index) && read_u32(file, level.index_count)
+			&& fread(&level.max_error, 4, 1, file) == 1
+			&& level.first_index <= nb_indices && level.index_count <= nb_indices - level.first_index;
+	}
+
+	positions.resize(nb_vertices);
+	if (flags & LOD_HAS_UVS)
+		texcoords.resize(nb_vertices);
+	if (flags & LOD_HAS_NORMALS)
+		vertex_normals.resize(nb_vertices);
+	index_buffer.resize(nb_indices);
+
+	if (ok)
+		ok = fread(positions.data(), sizeof(glm::vec3), nb_vertices, file) == nb_vertices;
+	if (ok && (flags & LOD_HAS_UVS))
+		ok = fread(texcoords.data(), sizeof(glm::vec2), nb_vertices, file) == nb_vertices;
+	if (ok && (flags & LOD_HAS_NORMALS))
+		ok = fread(vertex_normals.data(), sizeof(glm::vec3), nb_vertices, file) == nb_vertices;
+	if (ok)
+		ok = fread(index_buffer.data(), 4, nb_indices, file) == nb_indices;
+	for (unsigned int i = 0; i < nb_indices && ok; i++)
+		ok = index_buffer[i] < nb_vertices;
+	fclose(file);
+
+	if (!ok){
+		printf("%s is truncated or corrupt\n", path);
+		clear();
+		return false;
+	}
+	return true;
+}
@@ -5,6 +5,8 @@
 #include <iostream>
 #include <queue>
 #include <stack> 
+#include <string>
+#include <algorithm>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -18,6 +20,9 @@ unsigned int g_nWidth = 1024, g_nHeight = 768;
 #include <AntTweakBar.h>
 TwBar *g_pToolBar;
 
+#include <counters.hpp>
+PerfCounters g_counters;
+
 // Include GLM
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -29,11 +34,22 @@ using namespace glm;
 #include <controls.hpp>
 #include <objloader.hpp>
 #include <vboindexer.hpp>
+#include <meshcache.hpp>
 #include <glerror.hpp>
+#include <halfedge.hpp>
+#include <collapse.hpp>
+#include <compact.hpp>
+#include <cluster.hpp>
+#include <lodchain.hpp>
+#include <progressive.hpp>
+#include <distance.hpp>
+#include <positions.hpp>
+#include <indextype.hpp>
+#include <threadpool.hpp>
 
 typedef struct e {
-	unsigned short vertex1;
-	unsigned short vertex2;
+	unsigned int vertex1;
+	unsigned int vertex2;
 	float distance;
 
 	bool operator<(const e &outro) const
@@ -46,11 +62,6 @@ typedef struct e {
 	}
 }edge;
 
-typedef struct r {
-	std::vector<unsigned short> indices_history;
-	std::vector<glm::vec3> vertices_history;
-}history;
-
 void WindowSizeCallBack(GLFWwindow *pWindow, int nWidth, int nHeight) {
 
 	g_nWidth = nWidth;
@@ -59,8 +70,128 @@ void WindowSizeCallBack(GLFWwindow *pWindow, int nWidth, int nHeight) {
 	TwWindowSize(g_nWidth, g_nHeight);
 }
 
-void CalculateDistances(std::vector<glm::vec3>& indexed_vertices, std::vector<unsigned short>& indices, std::vector<edge>& edges);
-void shortest_shared_edge(std::vector<glm::vec3>& indexed_vertices, std::vector<unsigned short>& indices, std::vector<edge>& edges);
+// glBufferData with GL_STATIC_DRAW, counting the bytes uploaded
+void BufferData(GLenum target, size_t bytes, const void* data)
+{
+	glBufferData(target, bytes, data, GL_STATIC_DRAW);
+	g_counters.addUploadedBytes(bytes);
+}
+
+// The compacted copy of the mesh that was last uploaded. It lives between
+// uploads so that a collapse, undo or redo only refills it, without
+// allocating a copy of the mesh on every key press.
+struct DrawBuffers
+{
+	std::vector<unsigned int> indices;
+	std::vector<unsigned short> narrow;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	CompactScratch scratch;
+};
+DrawBuffers g_draw;
+
+// Uploads a compacted copy of the mesh, without the collapsed triangles and
+// the vertices they left unused. The working buffers keep their layout for
+// the collapse engine. Returns the number of indices to draw, and their type :
+// 16-bit whenever the compacted mesh fits, to keep index bandwidth low.
+// With a clusterGrid above 0 a grid-clustered preview is uploaded instead.
+GLsizei UploadCompacted(GLuint vertexbuffer, GLuint uvbuffer, GLuint normalbuffer, GLuint elementbuffer,
+	const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& vertices,
+	const std::vector<glm::vec2>& uvs, const std::vector<glm::vec3>& normals, int clusterGrid, GLenum& indexType)
+{
+	std::vector<unsigned int>& draw_indices = g_draw.indices;
+	std::vector<glm::vec3>& draw_vertices = g_draw.vertices;
+	std::vector<glm::vec2>& draw_uvs = g_draw.uvs;
+	std::vector<glm::vec3>& draw_normals = g_draw.normals;
+	if (clusterGrid > 0)
+	{
+		draw_indices.assign(indices.begin(), indices.end());
+		draw_vertices.assign(vertices.begin(), vertices.end());
+		draw_uvs.assign(uvs.begin(), uvs.end());
+		draw_normals.assign(normals.begin(), normals.end());
+		ClusterOptions options;
+		options.grid_resolution = clusterGrid;
+		clusterMesh(draw_indices, draw_vertices, draw_uvs, draw_normals, options);
+	}
+	else
+	{
+		compactMeshInto(indices, vertices, uvs, normals, draw_indices, draw_vertices, draw_uvs, draw_normals, g_draw.scratch);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	BufferData(GL_ARRAY_BUFFER, draw_vertices.size() * sizeof(glm::vec3), draw_vertices.data());
+
+	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
+	BufferData(GL_ARRAY_BUFFER, draw_uvs.size() * sizeof(glm::vec2), draw_uvs.data());
+
+	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
+	BufferData(GL_ARRAY_BUFFER, draw_normals.size() * sizeof(glm::vec3), draw_normals.data());
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
+	if (indexFits<unsigned short>(draw_vertices.size()))
+	{
+		convertIndices(draw_indices, g_draw.narrow);
+		BufferData(GL_ELEMENT_ARRAY_BUFFER, g_draw.narrow.size() * sizeof(unsigned short), g_draw.narrow.data());
+		indexType = GL_UNSIGNED_SHORT;
+	}
+	else
+	{
+		BufferData(GL_ELEMENT_ARRAY_BUFFER, draw_indices.size() * sizeof(unsigned int), draw_indices.data());
+		indexType = GL_UNSIGNED_INT;
+	}
+
+	g_counters.setLive((int)draw_indices.size() / 3, (int)draw_vertices.size());
+	return (GLsizei)draw_indices.size();
+}
+
+// Name of a file written from the mesh at meshPath : its path with the
+// extension replaced, "mesh/suzanne.obj" gives "mesh/suzanne.pm" for ".pm"
+std::string MeshOutputPath(const std::string& meshPath, const char* extension)
+{
+	size_t dot = meshPath.find_last_of('.');
+	size_t slash = meshPath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return meshPath + extension;
+	return meshPath.substr(0, dot) + extension;
+}
+
+// Uploads one level of a progressive mesh : the first vertexCount() vertices
+// and 3 * triangleCount() indices of its buffers, which make up that level
+GLsizei UploadProgressive(GLuint vertexbuffer, GLuint uvbuffer, GLuint normalbuffer, GLuint elementbuffer,
+	ProgressiveMesh& progressive, int level, GLenum& indexType)
+{
+	progressive.setLevel(level);
+	size_t nb_vertices = progressive.vertexCount();
+	size_t nb_indices = 3 * (size_t)progressive.triangleCount();
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	BufferData(GL_ARRAY_BUFFER, nb_vertices * sizeof(glm::vec3), progressive.vertices().data());
+
+	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
+	BufferData(GL_ARRAY_BUFFER, progressive.uvs().empty() ? 0 : nb_vertices * sizeof(glm::vec2), progressive.uvs().data());
+
+	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
+	BufferData(GL_ARRAY_BUFFER, progressive.normals().empty() ? 0 : nb_vertices * sizeof(glm::vec3), progressive.normals().data());
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
+	if (indexFits<unsigned short>(nb_vertices))
+	{
+		g_draw.narrow.assign(progressive.indices().begin(), progressive.indices().begin() + nb_indices);
+		BufferData(GL_ELEMENT_ARRAY_BUFFER, nb_indices * sizeof(unsigned short), g_draw.narrow.data());
+		indexType = GL_UNSIGNED_SHORT;
+	}
+	else
+	{
+		BufferData(GL_ELEMENT_ARRAY_BUFFER, nb_indices * sizeof(unsigned int), progressive.indices().data());
+		indexType = GL_UNSIGNED_INT;
+	}
+
+	g_counters.setLive(progressive.triangleCount(), progressive.vertexCount());
+	return (GLsizei)nb_indices;
+}
+
+void CalculateDistances(std::vector<glm::vec3>& indexed_vertices, std::vector<unsigned int>& indices, std::vector<edge>& edges);
 
 int main(void)
 {
@@ -117,6 +248,40 @@ int main(void)
 	// Add 'bgColor' to 'bar': it is a modifable variable of type TW_TYPE_COLOR3F (3 floats color)
 	vec3 oColor(0.0f);
 	TwAddVarRW(g_pToolBar, "bgColor", TW_TYPE_COLOR3F, &oColor[0], " label='Background color' ");
+	// Add 'quadrics' to 'bar': collapse by quadric error instead of by edge length
+	bool useQuadrics = true;
+	TwAddVarRW(g_pToolBar, "quadrics", TW_TYPE_BOOLCPP, &useQuadrics, " label='Quadric error' help='Collapse the edge with the lowest quadric error instead of the shortest one' ");
+	// Add 'clusterGrid' to 'bar': shows a vertex-clustered preview of the mesh, 0 shows the mesh itself
+	int clusterGrid = 0;
+	TwAddVarRW(g_pToolBar, "clusterGrid", TW_TYPE_INT32, &clusterGrid, " label='Cluster grid' min=0 max=1024 step=8 help='Preview grid clustering with this many cells along the longest side, 0 to turn it off' ");
+	// Add 'pmLevel' to 'bar': level of the progressive mesh written by P, -1 shows the working mesh
+	int pmLevel = -1;
+	TwAddVarRW(g_pToolBar, "pmLevel", TW_TYPE_INT32, &pmLevel, " label='Progressive level' min=-1 max=-1 help='Level of the progressive mesh written with P, -1 to show the mesh being simplified' ");
+	// Add the LOD ratios to 'bar': fractions of the triangles kept by each level written with L, 0 skips a level
+	float lodRatios[4] = { 0.5f, 0.25f, 0.1f, 0.02f };
+	for (int i = 0; i < 4; i++)
+	{
+		std::string name = "lodRatio" + std::to_string(i + 1);
+		std::string def = " group='LODs' label='LOD " + std::to_string(i + 1) + " ratio' min=0 max=1 step=0.01 help='Fraction of the triangles kept by this level of the set written with L, 0 to skip it' ";
+		TwAddVarRW(g_pToolBar, name.c_str(), TW_TYPE_FLOAT, &lodRatios[i], def.c_str());
+	}
+	// Add the performance counters to 'bar': min, average and 99th percentile over the last frames
+	const char* counterLabels[PerfCounters::COUNTER_COUNT] = { "Frame ms", "Collapse ms", "Edges scored", "Triangles", "Vertices", "Bytes uploaded" };
+	for (int c = 0; c < PerfCounters::COUNTER_COUNT; c++)
+	{
+		const PerfCounters::Summary& summary = g_counters.summary((PerfCounters::Counter)c);
+		const char* stats[3] = { "min", "avg", "p99" };
+		const float* values[3] = { &summary.min, &summary.avg, &summary.p99 };
+		for (int k = 0; k < 3; k++)
+		{
+			std::string name = std::string(PerfCounters::name((PerfCounters::Counter)c)) + "_" + stats[k];
+			std::string def = std::string(" group='Counters' precision=2 label='") + counterLabels[c] + " " + stats[k] + "' ";
+			TwAddVarRO(g_pToolBar, name.c_str(), TW_TYPE_FLOAT, values[k], def.c_str());
+		}
+	}
+	// Add 'saveCounters' to 'bar': writes the counters of the whole session to perf_counters.json on exit
+	bool saveCounters = false;
+	TwAddVarRW(g_pToolBar, "saveCounters", TW_TYPE_BOOLCPP, &saveCounters, " group='Counters' label='Save on exit' help='Write the counters to perf_counters.json when the viewer closes' ");
 
 	// Ensure we can capture the escape key being pressed below
 	glfwSetInputMode(g_pWindow, GLFW_STICKY_KEYS, GL_TRUE);
@@ -151,11 +316,19 @@ int main(void)
 	// Get a handle for our "myTextureSampler" uniform
 	GLuint TextureID = glGetUniformLocation(programID, "myTextureSampler");
 
-	// Read our .obj file
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
-	std::vector<glm::vec3> normals;
-	bool res = loadOBJ("mesh/suzanne.obj", vertices, uvs, normals);
+	// Parses and formats mesh files on every core
+	ThreadPool pool;
+
+	// Read our .obj file, already indexed from mesh/suzanne.obj.meshcache
+	// when it is up to date. The working mesh always uses 32-bit indices;
+	// the upload narrows them when it can. Files written from it are named
+	// after it.
+	const std::string meshPath = "mesh/suzanne.obj";
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> indexed_vertices;
+	std::vector<glm::vec2> indexed_uvs;
+	std::vector<glm::vec3> indexed_normals;
+	bool res = loadOBJCached(meshPath.c_str(), indices, indexed_vertices, indexed_uvs, indexed_normals, &pool);
 
 	//int i = 0;
 	/*int count=0;
@@ -166,16 +339,19 @@ int main(void)
 	}
 	std::cout << count << std::endl;*/
 
-	std::vector<unsigned short> indices;
-	std::vector<glm::vec3> indexed_vertices;
-	std::vector<glm::vec2> indexed_uvs;
-	std::vector<glm::vec3> indexed_normals;
-	indexVBO(vertices, uvs, normals, indices, indexed_vertices, indexed_uvs, indexed_normals);
+	// The loaded mesh, to measure how far the simplified one has moved from it
+	const std::vector<unsigned int> loaded_indices = indices;
+	const std::vector<glm::vec3> loaded_vertices = indexed_vertices;
 	
-	//std::priority_queue<edge> shortest_edge;
-	std::vector<edge> edges;
-	shortest_shared_edge(indexed_vertices, indices, edges);
-	if (edges[0].distance == -1)
+	// Connectivity is built once here and kept up to date by the collapses
+	HalfEdgeMesh mesh;
+	mesh.build(indices, indexed_vertices.size());
+
+	// Keeps every shared edge in a min-heap on its collapse cost
+	CollapseEngine engine(mesh, indexed_vertices, useQuadrics ? COLLAPSE_QUADRIC : COLLAPSE_EDGE_LENGTH);
+	engine.setAttributes(&indexed_uvs, &indexed_normals);
+	engine.init();
+	if (mesh.liveFaceCount() == 0)
 	{
 		std::cout<< "couldnt find any to simplify" << std::endl;
 	}
@@ -353,37 +529,32 @@ int main(void)
 
 	GLuint vertexbuffer;
 	glGenBuffers(1, &vertexbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
 
 	GLuint uvbuffer;
 	glGenBuffers(1, &uvbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
 
 	GLuint normalbuffer;
 	glGenBuffers(1, &normalbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
 
 	// Generate a buffer for the indices as well
 	GLuint elementbuffer;
 	glGenBuffers(1, &elementbuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+
+	GLenum drawType;
+	int shownGrid = clusterGrid;
+	int shownLevel = pmLevel;
+	ProgressiveMesh progressive;
+	GLsizei drawCount = UploadCompacted(vertexbuffer, uvbuffer, normalbuffer, elementbuffer, indices, indexed_vertices, indexed_uvs, indexed_normals, clusterGrid, drawType);
 
 	// Get a handle for our "LightPosition" uniform
 	glUseProgram(programID);
 	GLuint LightID = glGetUniformLocation(programID, "LightPosition_worldspace");
 
-	// For speed computation
-	double lastTime = glfwGetTime();
-	int nbFrames    = 0;
+	// Edge costs computed by the engine, as of the last frame
+	int lastEvaluated = engine.edgesEvaluated();
 
 	double lastTimePress = glfwGetTime();
 
-	std::stack<history> step_register;
-
 	do{
         check_gl_error();
 
@@ -393,90 +564,75 @@ int main(void)
 		else
 			nUseMouse = 0;
 
-		// Measure speed
-		double currentTime = glfwGetTime();
-		nbFrames++;
-		if (currentTime - lastTime >= 1.0){ // If last prinf() was more than 1sec ago
-			// printf and reset
-	//		printf("%f ms/frame\n", 1000.0 / double(nbFrames));
-			nbFrames  = 0;
-			lastTime += 1.0;
-		}
+		// Closes the counters of the last frame
+		g_counters.nextFrame();
 
 		//my code
 		double timePress = glfwGetTime();
 
+		// Switching the cost from the toolbar re-scores every edge
+		CollapseCost cost = useQuadrics ? COLLAPSE_QUADRIC : COLLAPSE_EDGE_LENGTH;
+		if (engine.costMode() != cost)
+		{
+			double start = glfwGetTime();
+			engine.setCost(cost);
+			engine.init();
+			lastEvaluated = 0;
+			g_counters.addCollapseTime((glfwGetTime() - start) * 1000.0);
+		}
+
+		// The splits of the progressive mesh stream in a batch per frame, the
+		// slider reaches further as they arrive
+		if (progressive.levelCount() < progressive.splitCount())
+		{
+			int top = progressive.levelCount();
+			if (progressive.readSplits(256) < 0)
+				pmLevel = top = -1;
+			else
+				top = progressive.levelCount();
+			TwSetParam(g_pToolBar, "pmLevel", "max", TW_PARAM_INT32, 1, &top);
+		}
+
+		// Moving the level slider uploads that level, or the working mesh at -1
+		if (pmLevel != shownLevel)
+		{
+			shownLevel = pmLevel;
+			if (pmLevel >= 0)
+				drawCount = UploadProgressive(vertexbuffer, uvbuffer, normalbuffer, elementbuffer, progressive, pmLevel, drawType);
+			else
+				drawCount = UploadCompacted(vertexbuffer, uvbuffer, normalbuffer, elementbuffer, indices, indexed_vertices, indexed_uvs, indexed_normals, clusterGrid, drawType);
+		}
+
+		// Changing the preview grid from the toolbar re-uploads the mesh
+		if (clusterGrid != shownGrid)
+		{
+			shownGrid = clusterGrid;
+			pmLevel = shownLevel = -1;
+			drawCount = UploadCompacted(vertexbuffer, uvbuffer, normalbuffer, elementbuffer, indices, indexed_vertices, indexed_uvs, indexed_normals, clusterGrid, drawType);
+		}
+
 		if (glfwGetKey(g_pWindow, GLFW_KEY_M) == GLFW_PRESS)
 		{
 			if ( (timePress - lastTimePress) >= 0.001)
 			{
-				edge ex = edges[0];
-				if (ex.distance == -1)
+				// Pops the cheapest edge, moves the surviving vertex and re-scores its one-ring
+				double start = glfwGetTime();
+				bool collapsed = engine.step();
+				g_counters.addCollapseTime((glfwGetTime() - start) * 1000.0);
+				if (!collapsed)
 				{
 					std::cout << "no more to simplify" << std::endl;
 				}
 				else
 				{
-					history step;
-					step.indices_history  = indices;
-					step.vertices_history = indexed_vertices;
-					step_register.push(step);
-
-					//shortest_edge.pop();
-					vec3 midpoint;
-					midpoint.x = (indexed_vertices[ex.vertex1].x + indexed_vertices[ex.vertex2].x) / 2;
-
-					midpoint.y = (indexed_vertices[ex.vertex1].y + indexed_vertices[ex.vertex2].y) / 2;
-
-					midpoint.z = (indexed_vertices[ex.vertex1].z + indexed_vertices[ex.vertex2].z) / 2;
-
-					//std::cout << glm::to_string(indexed_vertices[ex.vertex1]) << std::endl;
-					//std::cout << glm::to_string(indexed_vertices[ex.vertex2]) << std::endl;
-					//std::cout << glm::to_string(midpoint) << std::endl;
-
-					//std::cout << "old size: " << indexed_vertices.size() << std::endl;
-					indexed_vertices.push_back(midpoint);
-					//std::cout << "new size: " << indexed_vertices.size() <<std::endl;
-					unsigned short newVertexIndex = indexed_vertices.size() - 1;
-					// std::cout << "new vertex: " << indices.size() << std::endl;
-					std::cout << "antigos triangulos" << std::endl;
-					/*for (int i = 0; i < indices.size(); i += 3)
-					{
-						std::cout << "1: " << indices[i] << " 2: " << indices[i + 1] << " 3: " << indices[i + 2] << std::endl;
-					}*/
-					for (int i = 0; i < indices.size(); i++)
-					{
-						if (indices[i] == ex.vertex1 || indices[i] == ex.vertex2)
-						{
-							indices[i] = newVertexIndex;
-						}
-					}
-					std::cout << "novos triangulos" << std::endl;
-					std::cout << std::endl << std::endl;
-					/*for (int i = 0; i < indices.size(); i += 3)
-					{
-						std::cout << "1: " << indices[i] << " 2: " << indices[i + 1] << " 3: " << indices[i + 2] << std::endl;
-					}*/
-
+					mesh.writeIndices(indices);
 
 					lastTimePress = glfwGetTime();
 
-					glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-					glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
-
-					glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-					glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
-
-					glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-					glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
-
-					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-					glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+					pmLevel = shownLevel = -1;
+					drawCount = UploadCompacted(vertexbuffer, uvbuffer, normalbuffer, elementbuffer, indices, indexed_vertices, indexed_uvs, indexed_normals, clusterGrid, drawType);
 
 					
-
-					edges.clear();
-					shortest_shared_edge(indexed_vertices, indices, edges);
 				}
 			}
 
@@ -486,30 +642,121 @@ int main(void)
 		{
 			if ((timePress - lastTimePress) >= 0.001)
 			{
-				if (!step_register.empty())
+				// Only the one-ring of the last collapse is put back
+				double start = glfwGetTime();
+				bool undone = engine.undo();
+				g_counters.addCollapseTime((glfwGetTime() - start) * 1000.0);
+				if (undone)
 				{
-					history step = step_register.top();
-					step_register.pop();
-
-					indexed_vertices = step.vertices_history;
-					indices = step.indices_history;
+					mesh.writeIndices(indices);
+					pmLevel = shownLevel = -1;
+					drawCount = UploadCompacted(vertexbuffer, uvbuffer, normalbuffer, elementbuffer, indices, indexed_vertices, indexed_uvs, indexed_normals, clusterGrid, drawType);
+				}
+				lastTimePress = glfwGetTime();
+			}
+		}
 
-					glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-					glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
+		if (glfwGetKey(g_pWindow, GLFW_KEY_N) == GLFW_PRESS)
+		{
+			if ((timePress - lastTimePress) >= 0.001)
+			{
+				double start = glfwGetTime();
+				bool redone = engine.redo();
+				g_counters.addCollapseTime((glfwGetTime() - start) * 1000.0);
+				if (redone)
+				{
+					mesh.writeIndices(indices);
+					pmLevel = shownLevel = -1;
+					drawCount = UploadCompacted(vertexbuffer, uvbuffer, normalbuffer, elementbuffer, indices, indexed_vertices, indexed_uvs, indexed_normals, clusterGrid, drawType);
+				}
+				lastTimePress = glfwGetTime();
+			}
+		}
 
-					glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-					glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
+		if (glfwGetKey(g_pWindow, GLFW_KEY_L) == GLFW_PRESS)
+		{
+			if ((timePress - lastTimePress) >= 0.5)
+			{
+				// Cuts every level from the mesh on screen in one run
+				std::vector<float> ratios;
+				for (int i = 0; i < 4; i++)
+					if (lodRatios[i] > 0.0f)
+						ratios.push_back(lodRatios[i]);
+				std::string path = MeshOutputPath(meshPath, ".lods");
+				LodChain chain;
+				if (chain.build(indices, indexed_vertices, indexed_uvs, indexed_normals, ratios, cost) && chain.save(path.c_str()))
+				{
+					for (int i = 0; i < chain.levelCount(); i++)
+						std::cout << "LOD " << i << " : " << chain.triangleCount(i) << " triangles" << std::endl;
+					std::cout << chain.vertices().size() << " shared vertices written to " << path << std::endl;
+				}
+				lastTimePress = glfwGetTime();
+			}
+		}
 
-					glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-					glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
+		if (glfwGetKey(g_pWindow, GLFW_KEY_E) == GLFW_PRESS)
+		{
+			if ((timePress - lastTimePress) >= 0.5)
+			{
+				// Saves the mesh on screen, without the faces and vertices collapsed away
+				std::vector<unsigned int> out_indices = indices;
+				std::vector<glm::vec3> out_vertices = indexed_vertices;
+				std::vector<glm::vec2> out_uvs = indexed_uvs;
+				std::vector<glm::vec3> out_normals = indexed_normals;
+				compactMesh(out_indices, out_vertices, out_uvs, out_normals);
+				std::string path = MeshOutputPath(meshPath, ".simplified.obj");
+				double start = glfwGetTime();
+				if (saveOBJCached(path.c_str(), out_indices, out_vertices, out_uvs, out_normals, &pool))
+					printf("%d triangles written to %s (%.1f ms)\n",
+						(int)out_indices.size() / 3, path.c_str(), (glfwGetTime() - start) * 1000.0);
+				lastTimePress = glfwGetTime();
+			}
+		}
 
-					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-					glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+		if (glfwGetKey(g_pWindow, GLFW_KEY_P) == GLFW_PRESS)
+		{
+			if ((timePress - lastTimePress) >= 0.5)
+			{
+				// Records every collapse of the mesh on screen, then reads the file back
+				// as a viewer would : the base mesh first, the splits over the next frames
+				std::vector<unsigned int> pm_indices;
+				std::vector<glm::vec3> pm_vertices, pm_normals;
+				std::vector<glm::vec2> pm_uvs;
+				CompactScratch scratch;
+				compactMeshInto(indices, indexed_vertices, indexed_uvs, indexed_normals, pm_indices, pm_vertices, pm_uvs, pm_normals, scratch);
+				std::string path = MeshOutputPath(meshPath, ".pm");
+				int top = 0;
+				if (progressive.build(pm_indices, pm_vertices, pm_uvs, pm_normals, cost) && progressive.save(path.c_str())
+					&& progressive.open(path.c_str()))
+				{
+					std::cout << progressive.splitCount() << " vertex splits written to " << path << std::endl;
+					pmLevel = 0;
+					shownLevel = -1;
 				}
+				else
+				{
+					pmLevel = top = -1;
+				}
+				TwSetParam(g_pToolBar, "pmLevel", "max", TW_PARAM_INT32, 1, &top);
+				lastTimePress = glfwGetTime();
+			}
+		}
+
+		if (glfwGetKey(g_pWindow, GLFW_KEY_H) == GLFW_PRESS)
+		{
+			if ((timePress - lastTimePress) >= 0.5)
+			{
+				SurfaceDistance d = measureSurfaceDistance(loaded_indices, loaded_vertices, indices, indexed_vertices, 20000, &pool);
+				printf("loaded -> current : mean %g rms %g max %g\n", d.forward.mean, d.forward.rms, d.forward.max);
+				printf("current -> loaded : mean %g rms %g max %g\n", d.backward.mean, d.backward.rms, d.backward.max);
+				printf("hausdorff %g (%.3f s)\n", d.hausdorff, d.seconds);
 				lastTimePress = glfwGetTime();
 			}
 		}
 
+		g_counters.addEdgesEvaluated(engine.edgesEvaluated() - lastEvaluated);
+		lastEvaluated = engine.edgesEvaluated();
+
 		// Clear the screen
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -594,8 +841,8 @@ int main(void)
 		// Draw the triangles !
 		glDrawElements(
 			GL_TRIANGLES,        // mode
-			indices.size(),      // count
-			GL_UNSIGNED_SHORT,   // type
+			drawCount,           // count
+			drawType,            // type
 			(void*)0             // element array buffer offset
 			);
 
@@ -629,6 +876,9 @@ int main(void)
 	glDeleteTextures(1, &Texture);
 	glDeleteVertexArrays(1, &VertexArrayID);
 
+	if (saveCounters && g_counters.writeJson("perf_counters.json"))
+		std::cout << "Counters of " << g_counters.frames() << " frames written to perf_counters.json" << std::endl;
+
 	// Terminate AntTweakBar and GLFW
 	TwTerminate();
 	glfwTerminate();
@@ -636,273 +886,45 @@ int main(void)
 	return 0;
 }
 
-void CalculateDistances(std::vector<glm::vec3>& indexed_vertices, std::vector<unsigned short>& indices, std::vector<edge>& edges)
+// Fills edges with every distinct edge of the mesh and its length, the
+// shortest one first. The lengths are computed in one batch by edgeLengths().
+void CalculateDistances(std::vector<glm::vec3>& indexed_vertices, std::vector<unsigned int>& indices, std::vector<edge>& edges)
 {
-	unsigned short i = 0;
-	edge shortest;
-	for (auto it = begin(indices); it != end(indices); it += 3, i++)
+	std::vector<std::pair<unsigned int, unsigned int> > pairs;
+	pairs.reserve(indices.size());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
 	{
-
-		bool flag = true;
-		edge edge1_2;
-		edge1_2.vertex1 = *it;
-		edge1_2.vertex2 = *(it + 1);
-		if (edge1_2.vertex1 != edge1_2.vertex2)
+		for (int k = 0; k < 3; k++)
 		{
-			if (edges.empty())
-			{
-				//std::cout << "vazio" << std::endl;
-				edge1_2.distance = distance(indexed_vertices[edge1_2.vertex1], indexed_vertices[edge1_2.vertex2]);
-				edges.push_back(edge1_2);
-				shortest = edge1_2;
-			}
-			else {
-				for (auto j : edges)
-				{
-					//std::cout << "i= " << i << " j= " << glm::to_string(j.vertex1) << std::endl;
-					if ((j.vertex1 == edge1_2.vertex1 && j.vertex2 == edge1_2.vertex2) ||
-						(j.vertex1 == edge1_2.vertex2 && j.vertex2 == edge1_2.vertex1))
-					{
-						flag = false;
-						//std::cout << "aresta ja encontrada" << std::endl;
-					}
-				}
-				if (flag)
-				{
-					edge1_2.distance = distance(indexed_vertices[edge1_2.vertex1], indexed_vertices[edge1_2.vertex2]);
-					edges.push_back(edge1_2);
-					flag = false;
-					if (edge1_2.distance < shortest.distance)
-					{
-						shortest = edge1_2;
-					}
-				}
-			}
+			unsigned int a = indices[i + k], b = indices[i + (k + 1) % 3];
+			if (a != b)
+				pairs.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
 		}
+	}
+	std::sort(pairs.begin(), pairs.end());
+	pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
 
-		edge edge1_3;
-		edge1_3.vertex1 = *it;
-		edge1_3.vertex2 = *(it + 2);
-		if (edge1_3.vertex1 != edge1_3.vertex2)
-		{
-			if (edges.empty())
-			{
-				//std::cout << "vazio" << std::endl;
-				edge1_3.distance = distance(indexed_vertices[edge1_3.vertex1], indexed_vertices[edge1_3.vertex2]);
-				edges.push_back(edge1_3);
-				shortest = edge1_3;
-			}
-			else
-			{
-				flag = true;
-				for (auto j : edges)
-				{
-					if ((j.vertex1 == edge1_3.vertex1 && j.vertex2 == edge1_3.vertex2) ||
-						(j.vertex1 == edge1_3.vertex2 && j.vertex2 == edge1_3.vertex1))
-					{
-						flag = false;
-					}
-				}
-				if (flag)
-				{
-					edge1_3.distance = distance(indexed_vertices[edge1_2.vertex1], indexed_vertices[edge1_2.vertex2]);
-					edges.push_back(edge1_3);
-					if (edge1_3.distance < shortest.distance)
-					{
-						shortest = edge1_3;
-					}
-				}
-			}
-		}
-
-		flag = true;
-		edge edge2_3;
-		edge2_3.vertex1 = *(it + 1);
-		edge2_3.vertex2 = *(it + 2);
-
-		if (edge2_3.vertex1 != edge2_3.vertex2)
-		{
-			if (edges.empty())
-			{
-				//std::cout << "vazio" << std::endl;
-				edge2_3.distance = distance(indexed_vertices[edge2_3.vertex1], indexed_vertices[edge2_3.vertex2]);
-				edges.push_back(edge2_3);
-				shortest = edge2_3;
-			}
-			else
-			{
-				for (auto j : edges)
-				{
-					if ((j.vertex1 == edge2_3.vertex1 && j.vertex2 == edge2_3.vertex2) ||
-						(j.vertex1 == edge2_3.vertex2 && j.vertex2 == edge2_3.vertex1))
-					{
-						flag = false;
-						//std::cout << "aresta ja encontrada" << std::endl;
-					}
-				}
-				if (flag)
-				{
-					edge2_3.distance = distance(indexed_vertices[edge1_2.vertex1], indexed_vertices[edge1_2.vertex2]);
-					edges.push_back(edge2_3);
-					if (edge2_3.distance < shortest.distance)
-					{
-						shortest = edge2_3;
-					}
-
-				}
-
-			}
-
-		}
-	} 
-	if (edges.empty())
+	std::vector<unsigned int> v0(pairs.size()), v1(pairs.size());
+	for (size_t i = 0; i < pairs.size(); i++)
 	{
-		edges[0].distance = -1;
+		v0[i] = pairs[i].first;
+		v1[i] = pairs[i].second;
 	}
-	else
-		edges[0] = shortest;
-	/*for (auto it : edges)
+	std::vector<float> lengths(pairs.size());
+	PositionStore positions;
+	positions.assign(indexed_vertices);
+	edgeLengths(positions, v0.data(), v1.data(), (int)pairs.size(), lengths.data());
+
+	edges.resize(pairs.size());
+	size_t shortest = 0;
+	for (size_t i = 0; i < pairs.size(); i++)
 	{
-		//if((indexed_vertices[it.vertex1].x == -1.0 && indexed_vertices[it.vertex1].y == 1.0 && indexed_vertices[it.vertex1].z == 1.0)
-		//	|| (indexed_vertices[it.vertex2].x == -1.0 && indexed_vertices[it.vertex2].y == 1.0 && indexed_vertices[it.vertex2].z == 1.0))
-		std::cout << it.vertex1 << " " << it.vertex2 << std::endl;
-	}*/
-	
-}
-
-
-//IR PERCORRENDO A LISTA E COLOCANDO OS PARES NO EDGES
-//SEMPRE QUE ACHAR UM PAR QUE JA TA NO EDGES, COMPARA PRA VER SE É O MENOR DO QUE O SHORTEST ATUAL
-//COLOCAR PRA RETORNAR UM BOOL INDICANDO SUCESSO OU FALHA
-
-void shortest_shared_edge(std::vector<glm::vec3>& indexed_vertices, std::vector<unsigned short>& indices, std::vector<edge>& edges)
-{
-	int i = 0;
-	edge shortest;
-	shortest.distance = -1;
-
-	for (auto it = begin(indices); it != end(indices); it += 3, i++)
-	{
-
-		//COMEÇO DO TESTE DO PAR 1 2
-		edge edge1_2;
-		edge1_2.vertex1 = *it;
-		edge1_2.vertex2 = *(it + 1);
-
-		if (edge1_2.vertex1 != edge1_2.vertex2)
-		{
-			if (edges.empty())
-			{
-				edge1_2.distance = distance(indexed_vertices[edge1_2.vertex1], indexed_vertices[edge1_2.vertex2]);
-				edges.push_back(edge1_2);
-			}
-
-			else
-			{
-				edge1_2.distance = distance(indexed_vertices[edge1_2.vertex1], indexed_vertices[edge1_2.vertex2]);
-				for (auto j : edges)
-				{
-					if ((j.vertex1 == edge1_2.vertex1 && j.vertex2 == edge1_2.vertex2) ||
-						(j.vertex1 == edge1_2.vertex2 && j.vertex2 == edge1_2.vertex1))
-					{
-
-						if (edge1_2.distance < shortest.distance || shortest.distance == -1)
-						{
-							shortest = edge1_2;
-						}
-
-					}
-				}
-
-				edges.push_back(edge1_2);
-
-			}
-		}
-		//FIM DO TESTE DO PAR 1 2
-
-		//COMECO DO TESTE DO PAR 1 3
-		edge edge1_3;
-		edge1_3.vertex1 = *it;
-		edge1_3.vertex2 = *(it + 2);
-
-		if (edge1_3.vertex1 != edge1_3.vertex2)
-		{
-			if (edges.empty())
-			{
-				edge1_3.distance = distance(indexed_vertices[edge1_3.vertex1], indexed_vertices[edge1_3.vertex2]);
-				edges.push_back(edge1_3);
-			}
-
-			else
-			{
-				edge1_3.distance = distance(indexed_vertices[edge1_3.vertex1], indexed_vertices[edge1_3.vertex2]);
-
-				for (auto j : edges)
-				{
-					
-					if ((j.vertex1 == edge1_3.vertex1 && j.vertex2 == edge1_3.vertex2) ||
-						(j.vertex1 == edge1_3.vertex2 && j.vertex2 == edge1_3.vertex1))
-					{
-						if ( (edge1_3.vertex1 != edge1_2.vertex1 && edge1_3.vertex2 != edge1_2.vertex2) ||
-							 (edge1_3.vertex1 != edge1_2.vertex2 && edge1_3.vertex2 != edge1_2.vertex1))
-						{
-							if (edge1_3.distance < shortest.distance || shortest.distance == -1)
-							{
-								shortest = edge1_3;
-							}
-						}
-
-					}
-				}
-
-				edges.push_back(edge1_3);
-
-			}
-		}
-		//FIM DO TESTE DO PAR 1 3
-
-		//COMEÇO DO TESTE DO PAR 2 3
-		edge edge2_3;
-		edge2_3.vertex1 = *(it + 1);
-		edge2_3.vertex2 = *(it + 2);
-
-		if (edge2_3.vertex1 != edge2_3.vertex2)
-		{
-			if (edges.empty())
-			{
-				edge2_3.distance = distance(indexed_vertices[edge2_3.vertex1], indexed_vertices[edge2_3.vertex2]);
-				edges.push_back(edge2_3);
-			}
-
-			else
-			{
-				edge2_3.distance = distance(indexed_vertices[edge2_3.vertex1], indexed_vertices[edge2_3.vertex2]);
-				for (auto j : edges)
-				{
-					if ((j.vertex1 == edge2_3.vertex1 && j.vertex2 == edge2_3.vertex2) ||
-						(j.vertex1 == edge2_3.vertex2 && j.vertex2 == edge2_3.vertex1))
-					{
-						if ((edge2_3.vertex1 != edge1_2.vertex1 && edge2_3.vertex2 != edge1_2.vertex2) ||
-							(edge2_3.vertex1 != edge1_2.vertex2 && edge2_3.vertex2 != edge1_2.vertex1))
-						{
-							if ((edge2_3.vertex1 != edge1_3.vertex1 && edge2_3.vertex2 != edge1_3.vertex2) ||
-								(edge2_3.vertex1 != edge1_3.vertex2 && edge2_3.vertex2 != edge1_3.vertex1))
-							{
-								if (edge2_3.distance < shortest.distance || shortest.distance == -1)
-								{
-									shortest = edge2_3;
-								}
-							}
-						}
-
-					}
-				}
-
-				edges.push_back(edge2_3);
-
-			}
-		}
+		edges[i].vertex1 = v0[i];
+		edges[i].vertex2 = v1[i];
+		edges[i].distance = lengths[i];
+		if (lengths[i] < lengths[shortest])
+			shortest = i;
 	}
-	edges[0] = shortest;
-
-}
\ No newline at end of file
+	if (!edges.empty())
+		std::swap(edges[0], edges[shortest]);
+}
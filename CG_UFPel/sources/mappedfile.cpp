@@ -0,0 +1,102 @@
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.hpp"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: view(NULL), length(0), file(INVALID_HANDLE_VALUE), mapping(NULL){
+}
+
+bool MappedFile::open(const char * path){
+	close();
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)){
+		close();
+		return false;
+	}
+	length = (size_t)size.QuadPart;
+	if (length == 0)
+		return true;  // empty files can't be mapped
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping != NULL)
+		view = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL){
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close(){
+	if (view != NULL)
+		UnmapViewOfFile(view);
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	view = NULL;
+	length = 0;
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: view(NULL), length(0){
+}
+
+bool MappedFile::open(const char * path){
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)){
+		::close(fd);
+		return false;
+	}
+	if (info.st_size > 0){
+		void * mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED){
+			::close(fd);
+			return false;
+		}
+		// The whole file is read front to back
+		madvise(mapped, (size_t)info.st_size, MADV_SEQUENTIAL);
+		view = (const char *)mapped;
+		length = (size_t)info.st_size;
+	}
+	// The mapping keeps the file alive
+	::close(fd);
+	return true;
+}
+
+void MappedFile::close(){
+	if (view != NULL)
+		munmap((void *)view, length);
+	view = NULL;
+	length = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile(){
+	close();
+}
@@ -0,0 +1,290 @@
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <glm/glm.hpp>
+
+#include "meshcache.hpp"
+#include "objloader.hpp"
+#include "indextype.hpp"
+
+// File layout, little-endian :
+//   "MSHC", version, flags, vertex count, index count, 0
+//   source size, source modification time, source hash (64 bits each)
+//   bounds min, bounds max (3 floats each)
+//   positions, uvs and normals (when flagged), indices as uint32
+// Every array starts on a 4-byte boundary, so the mapping can be read in place.
+static const char CACHE_MAGIC[4] = { 'M', 'S', 'H', 'C' };
+static const unsigned int CACHE_VERSION = 1;
+static const size_t CACHE_HEADER_SIZE = 72;
+enum { CACHE_HAS_UVS = 1, CACHE_HAS_NORMALS = 2 };
+
+// FNV-1a over 64-bit words then the tail bytes. Only meant to notice that
+// a file was edited, it runs at memory speed.
+static unsigned long long hash_bytes(const char * data, size_t size){
+	const uint64_t prime = 0x100000001b3ull;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8){
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * prime;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ (unsigned char)data[i]) * prime;
+	return (hash ^ size) * prime;
+}
+
+// Size and modification time of a file, false if it doesn't exist
+static bool file_stamp(const char * path, unsigned long long & size, long long & time){
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return false;
+	size = (unsigned long long)info.st_size;
+	time = (long long)info.st_mtime;
+	return true;
+}
+
+static bool file_hash(const char * path, unsigned long long & hash){
+	MappedFile source;
+	if (!source.open(path))
+		return false;
+	hash = hash_bytes(source.data(), source.size());
+	return true;
+}
+
+MeshCache::MeshCache(){
+	close();
+}
+
+void MeshCache::close(){
+	file.close();
+	nb_vertices = 0;
+	nb_indices = 0;
+	source_size = 0;
+	source_time = 0;
+	source_hash = 0;
+	bounds_min = glm::vec3(0.0f);
+	bounds_max = glm::vec3(0.0f);
+	positions = NULL;
+	texcoords = NULL;
+	vertex_normals = NULL;
+	index_buffer = NULL;
+}
+
+bool MeshCache::open(const char * path){
+	close();
+	if (!file.open(path)){
+		printf("%s could not be opened\n", path);
+		return false;
+	}
+
+	const char * data = file.data();
+	unsigned int version = 0, flags = 0;
+	if (file.size() < CACHE_HEADER_SIZE || memcmp(data, CACHE_MAGIC, 4) != 0){
+		printf("%s is not a mesh cache file\n", path);
+		close();
+		return false;
+	}
+	memcpy(&version, data + 4, 4);
+	if (version != CACHE_VERSION){
+		printf("%s was written by another version\n", path);
+		close();
+		return false;
+	}
+	memcpy(&flags, data + 8, 4);
+	memcpy(&nb_vertices, data + 12, 4);
+	memcpy(&nb_indices, data + 16, 4);
+	memcpy(&source_size, data + 24, 8);
+	memcpy(&source_time, data + 32, 8);
+	memcpy(&source_hash, data + 40, 8);
+	memcpy(&bounds_min, data + 48, 12);
+	memcpy(&bounds_max, data + 60, 12);
+
+	unsigned long long expected = CACHE_HEADER_SIZE + 12ull * nb_vertices + 4ull * nb_indices;
+	if (flags & CACHE_HAS_UVS)
+		expected += 8ull * nb_vertices;
+	if (flags & CACHE_HAS_NORMALS)
+		expected += 12ull * nb_vertices;
+	bool ok = expected == file.size();
+
+	if (ok){
+		const char * at = data + CACHE_HEADER_SIZE;
+		positions = (const glm::vec3 *)at;
+		at += 12ull * nb_vertices;
+		if (flags & CACHE_HAS_UVS){
+			texcoords = (const glm::vec2 *)at;
+			at += 8ull * nb_vertices;
+		}
+		if (flags & CACHE_HAS_NORMALS){
+			vertex_normals = (const glm::vec3 *)at;
+			at += 12ull * nb_vertices;
+		}
+		index_buffer = (const unsigned int *)at;
+	}
+	for (unsigned int i = 0; i < nb_indices && ok; i++)
+		ok = index_buffer[i] < nb_vertices;
+
+	if (!ok){
+		printf("%s is truncated or corrupt\n", path);
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool MeshCache::matches(const char * source_path) const{
+	unsigned long long size, hash;
+	long long time;
+	return file.data() != NULL
+		&& file_stamp(source_path, size, time) && size == source_size && time == source_time
+		&& file_hash(source_path, hash) && hash == source_hash;
+}
+
+static void write_u32(FILE * file, unsigned int value){
+	fwrite(&value, 4, 1, file);
+}
+
+static void write_u64(FILE * file, unsigned long long value){
+	fwrite(&value, 8, 1, file);
+}
+
+template <typename Index>
+bool MeshCache::save(
+	const char * path,
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	const char * source_path
+){
+	unsigned long long size = 0, hash = 0;
+	long long time = 0;
+	if (source_path != NULL && (!file_stamp(source_path, size, time) || !file_hash(source_path, hash))){
+		printf("%s could not be read\n", source_path);
+		return false;
+	}
+
+	glm::vec3 lower(0.0f), upper(0.0f);
+	if (!vertices.empty()){
+		lower = upper = vertices[0];
+		for (size_t i = 1; i < vertices.size(); i++){
+			lower = glm::min(lower, vertices[i]);
+			upper = glm::max(upper, vertices[i]);
+		}
+	}
+
+	FILE * file = fopen(path, "wb");
+	if (!file){
+		printf("%s could not be opened for writing\n", path);
+		return false;
+	}
+
+	bool has_uvs = !uvs.empty(), has_normals = !normals.empty();
+	fwrite(CACHE_MAGIC, 1, 4, file);
+	write_u32(file, CACHE_VERSION);
+	write_u32(file, (has_uvs ? CACHE_HAS_UVS : 0) | (has_normals ? CACHE_HAS_NORMALS : 0));
+	write_u32(file, (unsigned int)vertices.size());
+	write_u32(file, (unsigned int)indices.size());
+	write_u32(file, 0);
+	write_u64(file, size);
+	write_u64(file, (unsigned long long)time);
+	write_u64(file, hash);
+	fwrite(&lower, sizeof(glm::vec3), 1, file);
+	fwrite(&upper, sizeof(glm::vec3), 1, file);
+
+	fwrite(vertices.data(), sizeof(glm::vec3), vertices.size(), file);
+	if (has_uvs)
+		fwrite(uvs.data(), sizeof(glm::vec2), uvs.size(), file);
+	if (has_normals)
+		fwrite(normals.data(), sizeof(glm::vec3), normals.size(), file);
+	std::vector<unsigned int> wide;
+	convertIndices(indices, wide);
+	fwrite(wide.data(), 4, wide.size(), file);
+
+	bool ok = ferror(file) == 0;
+	if (fclose(file) != 0)
+		ok = false;
+	if (!ok)
+		printf("%s could not be written\n", path);
+	return ok;
+}
+
+template bool MeshCache::save<unsigned short>(const char *, const std::vector<unsigned short> &,
+	const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, const char *);
+template bool MeshCache::save<unsigned int>(const char *, const std::vector<unsigned int> &,
+	const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, const char *);
+
+template <typename Index>
+bool loadOBJCached(
+	const char * path,
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	ThreadPool * pool
+){
+	std::string cache_path = std::string(path) + ".meshcache";
+	indices.clear();
+	vertices.clear();
+	uvs.clear();
+	normals.clear();
+
+	// Quietly skipped the first time, when there's no cache yet
+	unsigned long long size;
+	long long time;
+	if (file_stamp(cache_path.c_str(), size, time)){
+		MeshCache cache;
+		if (cache.open(cache_path.c_str()) && cache.matches(path)
+			&& cache.uvs() != NULL && cache.normals() != NULL && indexFits<Index>(cache.vertexCount())){
+			printf("Loading mesh cache %s...\n", cache_path.c_str());
+			vertices.assign(cache.vertices(), cache.vertices() + cache.vertexCount());
+			uvs.assign(cache.uvs(), cache.uvs() + cache.vertexCount());
+			normals.assign(cache.normals(), cache.normals() + cache.vertexCount());
+			indices.assign(cache.indices(), cache.indices() + cache.indexCount());
+			return true;
+		}
+	}
+
+	if (!loadOBJIndexed(path, indices, vertices, uvs, normals, pool))
+		return false;
+
+	// The mesh is loaded either way, a cache that can't be written is only reported
+	MeshCache::save(cache_path.c_str(), indices, vertices, uvs, normals, path);
+	return true;
+}
+
+template bool loadOBJCached<unsigned short>(const char *, std::vector<unsigned short> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, ThreadPool *);
+template bool loadOBJCached<unsigned int>(const char *, std::vector<unsigned int> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, ThreadPool *);
+
+template <typename Index>
+bool saveOBJCached(
+	const char * path,
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	ThreadPool * pool
+){
+	if (!saveOBJ(path, indices, vertices, uvs, normals, pool))
+		return false;
+
+	// The OBJ holds "%.6f" roundings, in its own vertex order : the cache is
+	// made from the file parsed back, so it matches what parsing it gives
+	std::vector<Index> written_indices;
+	std::vector<glm::vec3> written_vertices, written_normals;
+	std::vector<glm::vec2> written_uvs;
+	std::string cache_path = std::string(path) + ".meshcache";
+	return loadOBJIndexed(path, written_indices, written_vertices, written_uvs, written_normals, pool)
+		&& MeshCache::save(cache_path.c_str(), written_indices, written_vertices, written_uvs, written_normals, path);
+}
+
+template bool saveOBJCached<unsigned short>(const char *, const std::vector<unsigned short> &,
+	const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, ThreadPool *);
+template bool saveOBJCached<unsigned int>(const char *, const std::vector<unsigned int> &,
+	const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, ThreadPool *);
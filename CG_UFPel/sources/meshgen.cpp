@@ -0,0 +1,239 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "meshgen.hpp"
+#include "indextype.hpp"
+
+static const float PI = 3.14159265358979f;
+
+template <typename Index>
+static void push_triangle(std::vector<Index> & indices, unsigned int a, unsigned int b, unsigned int c){
+	indices.push_back((Index)a);
+	indices.push_back((Index)b);
+	indices.push_back((Index)c);
+}
+
+template <typename Index>
+bool generateSphere(int triangles,
+	std::vector<Index> & indices, std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs, std::vector<glm::vec3> & normals){
+	// rings bands of 2 * rings segments : the two pole bands have one
+	// triangle per segment, the others two, 4 * rings * (rings - 1) in all
+	int rings = std::max(2, (int)floor((1.0 + sqrt(1.0 + (double)triangles)) / 2.0 + 0.5));
+	int segments = 2 * rings;
+
+	// Pole rows have one vertex per segment, the others one per segment
+	// plus the seam
+	size_t count = 2 * (size_t)segments + (size_t)(rings - 1) * (segments + 1);
+	indices.clear();
+	vertices.clear();
+	uvs.clear();
+	normals.clear();
+	if (!indexFits<Index>(count))
+		return false;
+	vertices.reserve(count);
+	uvs.reserve(count);
+	normals.reserve(count);
+
+	for (int i = 0; i <= rings; i++){
+		float v = (float)i / rings;
+		float theta = v * PI;
+		bool pole = i == 0 || i == rings;
+		int columns = pole ? segments : segments + 1;
+		for (int j = 0; j < columns; j++){
+			float u = pole ? (j + 0.5f) / segments : (float)j / segments;
+			float phi = u * 2.0f * PI;
+			glm::vec3 p(sinf(theta) * cosf(phi), cosf(theta), -sinf(theta) * sinf(phi));
+			if (pole)
+				p = glm::vec3(0.0f, i == 0 ? 1.0f : -1.0f, 0.0f);
+			vertices.push_back(p);
+			normals.push_back(p);
+			uvs.push_back(glm::vec2(u, -(1.0f - v)));
+		}
+	}
+
+	// First vertex of row i
+	unsigned int last_row = (unsigned int)(segments + (rings - 1) * (segments + 1));
+	indices.reserve(12 * (size_t)rings * (rings - 1));
+	for (int i = 0; i < rings; i++){
+		unsigned int row = i == 0 ? 0 : segments + (i - 1) * (segments + 1);
+		unsigned int next = i + 1 == rings ? last_row : segments + i * (segments + 1);
+		for (int j = 0; j < segments; j++){
+			if (i == 0)
+				push_triangle(indices, row + j, next + j, next + j + 1);
+			else if (i + 1 == rings)
+				push_triangle(indices, row + j, next + j, row + j + 1);
+			else{
+				push_triangle(indices, row + j, next + j, next + j + 1);
+				push_triangle(indices, row + j, next + j + 1, row + j + 1);
+			}
+		}
+	}
+	return true;
+}
+
+template <typename Index>
+bool generateTorus(int triangles,
+	std::vector<Index> & indices, std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs, std::vector<glm::vec3> & normals){
+	const float R = 1.0f, r = 0.35f;
+
+	// 2 * major * minor triangles with twice as many steps around the major circle
+	int minor = std::max(3, (int)floor(sqrt(triangles / 4.0) + 0.5));
+	int major = 2 * minor;
+
+	size_t count = (size_t)(major + 1) * (minor + 1);
+	indices.clear();
+	vertices.clear();
+	uvs.clear();
+	normals.clear();
+	if (!indexFits<Index>(count))
+		return false;
+	vertices.reserve(count);
+	uvs.reserve(count);
+	normals.reserve(count);
+
+	for (int i = 0; i <= major; i++){
+		float u = (float)i / major;
+		float a = u * 2.0f * PI;
+		for (int j = 0; j <= minor; j++){
+			float v = (float)j / minor;
+			float b = v * 2.0f * PI;
+			glm::vec3 n(cosf(b) * cosf(a), sinf(b), -cosf(b) * sinf(a));
+			glm::vec3 center(R * cosf(a), 0.0f, -R * sinf(a));
+			vertices.push_back(center + n * r);
+			normals.push_back(n);
+			uvs.push_back(glm::vec2(u, -v));
+		}
+	}
+
+	indices.reserve(6 * (size_t)major * minor);
+	for (int i = 0; i < major; i++){
+		for (int j = 0; j < minor; j++){
+			unsigned int a = i * (minor + 1) + j;
+			unsigned int b = (i + 1) * (minor + 1) + j;
+			push_triangle(indices, a, b, b + 1);
+			push_triangle(indices, a, b + 1, a + 1);
+		}
+	}
+	return true;
+}
+
+// Uniform value in [-1, 1] at a lattice point
+static float lattice(int x, int y, unsigned int seed){
+	unsigned int h = (unsigned int)x * 374761393u + (unsigned int)y * 668265263u + seed * 2246822519u;
+	h = (h ^ (h >> 13)) * 1274126177u;
+	h ^= h >> 16;
+	return h / 2147483647.5f - 1.0f;
+}
+
+// Smoothly interpolated lattice values, summed over octaves of doubling
+// frequency and halving amplitude
+static float fractal_noise(float x, float y, unsigned int seed){
+	float sum = 0.0f, amplitude = 0.5f, frequency = 4.0f;
+	for (int octave = 0; octave < 6; octave++){
+		float fx = x * frequency, fy = y * frequency;
+		int ix = (int)floorf(fx), iy = (int)floorf(fy);
+		float tx = fx - ix, ty = fy - iy;
+		tx = tx * tx * (3.0f - 2.0f * tx);
+		ty = ty * ty * (3.0f - 2.0f * ty);
+		unsigned int s = seed + octave * 1013u;
+		float a = lattice(ix, iy, s) + (lattice(ix + 1, iy, s) - lattice(ix, iy, s)) * tx;
+		float b = lattice(ix, iy + 1, s) + (lattice(ix + 1, iy + 1, s) - lattice(ix, iy + 1, s)) * tx;
+		sum += (a + (b - a) * ty) * amplitude;
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+	return sum;
+}
+
+template <typename Index>
+bool generateTerrain(int triangles, unsigned int seed,
+	std::vector<Index> & indices, std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs, std::vector<glm::vec3> & normals){
+	const float HEIGHT = 0.25f;
+
+	// n x n quads of two triangles
+	int n = std::max(1, (int)floor(sqrt(triangles / 2.0) + 0.5));
+	int side = n + 1;
+
+	size_t count = (size_t)side * side;
+	indices.clear();
+	vertices.clear();
+	uvs.clear();
+	normals.clear();
+	if (!indexFits<Index>(count))
+		return false;
+	vertices.reserve(count);
+	uvs.reserve(count);
+	normals.resize(count);
+
+	float step = 2.0f / n;
+	for (int j = 0; j < side; j++){
+		for (int i = 0; i < side; i++){
+			float x = -1.0f + i * step, z = -1.0f + j * step;
+			vertices.push_back(glm::vec3(x, HEIGHT * fractal_noise(x, z, seed), z));
+			uvs.push_back(glm::vec2((float)i / n, -(float)j / n));
+		}
+	}
+
+	// Normals from the height differences across each grid point
+	for (int j = 0; j < side; j++){
+		for (int i = 0; i < side; i++){
+			int i0 = std::max(i - 1, 0), i1 = std::min(i + 1, n);
+			int j0 = std::max(j - 1, 0), j1 = std::min(j + 1, n);
+			float dx = (vertices[j * side + i1].y - vertices[j * side + i0].y) / ((i1 - i0) * step);
+			float dz = (vertices[j1 * side + i].y - vertices[j0 * side + i].y) / ((j1 - j0) * step);
+			normals[j * side + i] = glm::normalize(glm::vec3(-dx, 1.0f, -dz));
+		}
+	}
+
+	indices.reserve(6 * (size_t)n * n);
+	for (int j = 0; j < n; j++){
+		for (int i = 0; i < n; i++){
+			unsigned int a = j * side + i;
+			unsigned int c = a + side;
+			push_triangle(indices, a, c, a + 1);
+			push_triangle(indices, a + 1, c, c + 1);
+		}
+	}
+	return true;
+}
+
+template <typename Index>
+void expandCorners(const std::vector<Index> & indices, const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs, const std::vector<glm::vec3> & normals,
+	std::vector<glm::vec3> & out_vertices, std::vector<glm::vec2> & out_uvs, std::vector<glm::vec3> & out_normals){
+	out_vertices.resize(indices.size());
+	out_uvs.resize(uvs.empty() ? 0 : indices.size());
+	out_normals.resize(normals.empty() ? 0 : indices.size());
+	for (size_t i = 0; i < indices.size(); i++){
+		out_vertices[i] = vertices[indices[i]];
+		if (!uvs.empty())
+			out_uvs[i] = uvs[indices[i]];
+		if (!normals.empty())
+			out_normals[i] = normals[indices[i]];
+	}
+}
+
+template bool generateSphere<unsigned short>(int, std::vector<unsigned short> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template bool generateSphere<unsigned int>(int, std::vector<unsigned int> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template bool generateTorus<unsigned short>(int, std::vector<unsigned short> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template bool generateTorus<unsigned int>(int, std::vector<unsigned int> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template bool generateTerrain<unsigned short>(int, unsigned int, std::vector<unsigned short> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template bool generateTerrain<unsigned int>(int, unsigned int, std::vector<unsigned int> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template void expandCorners<unsigned short>(const std::vector<unsigned short> &, const std::vector<glm::vec3> &,
+	const std::vector<glm::vec2> &, const std::vector<glm::vec3> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template void expandCorners<unsigned int>(const std::vector<unsigned int> &, const std::vector<glm::vec3> &,
+	const std::vector<glm::vec2> &, const std::vector<glm::vec3> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "numtext.hpp"
+
+// Powers of ten that are exact in a double
+static const double exact_powers[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool is_digit(char c){
+	return (unsigned char)(c - '0') < 10;
+}
+
+static inline const char * skip_blanks(const char * p, const char * end){
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	return p;
+}
+
+// Hands the token at p to strtof(), for the inputs the fast path can't round
+static bool scan_float_slow(const char * & p, const char * end, float & out){
+	char token[128];
+	size_t n = 0;
+	while (p + n < end && n < sizeof(token) - 1){
+		char c = p[n];
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '/')
+			break;
+		token[n++] = c;
+	}
+	token[n] = '\0';
+
+	char * stop;
+	float value = strtof(token, &stop);
+	if (stop == token || (n == sizeof(token) - 1 && stop == token + n))
+		return false;  // nothing read, or cut short by the buffer
+	p += stop - token;
+	out = value;
+	return true;
+}
+
+bool scanFloat(const char * & p, const char * end, float & out){
+	const char * start = skip_blanks(p, end);
+	const char * s = start;
+
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+')){
+		negative = *s == '-';
+		s++;
+	}
+
+	// Up to 19 significant digits fit in the mantissa ; exact is cleared if
+	// a nonzero digit had to be dropped
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool exact = true;
+	bool any = false;
+	for (; s < end && is_digit(*s); s++){
+		any = true;
+		if (digits < 19){
+			mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+			digits += mantissa != 0;
+		}
+		else{
+			exponent++;
+			exact &= *s == '0';
+		}
+	}
+	if (s < end && *s == '.'){
+		for (s++; s < end && is_digit(*s); s++){
+			any = true;
+			if (digits < 19){
+				mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+			else
+				exact &= *s == '0';
+		}
+	}
+	if (!any){
+		// inf, nan and such
+		p = start;
+		return scan_float_slow(p, end, out);
+	}
+
+	// The exponent only counts if digits follow the 'e'
+	if (s < end && (*s == 'e' || *s == 'E')){
+		const char * e = s + 1;
+		bool negative_exponent = false;
+		if (e < end && (*e == '-' || *e == '+')){
+			negative_exponent = *e == '-';
+			e++;
+		}
+		if (e < end && is_digit(*e)){
+			int value = 0;
+			for (; e < end && is_digit(*e); e++)
+				if (value < 100000)
+					value = value * 10 + (*e - '0');
+			exponent += negative_exponent ? -value : value;
+			s = e;
+		}
+	}
+
+	if (mantissa == 0 && exact){
+		out = negative ? -0.0f : 0.0f;
+		p = s;
+		return true;
+	}
+
+	// mantissa and 10^|exponent| are exact doubles, so the product or quotient
+	// is the correctly rounded double. Rounding that again to float is only
+	// wrong if it landed exactly halfway between two floats.
+	if (exact && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22){
+		double value = exponent < 0 ? (double)mantissa / exact_powers[-exponent] : (double)mantissa * exact_powers[exponent];
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		if ((bits & ((uint64_t(1) << 29) - 1)) != (uint64_t(1) << 28)){
+			out = (float)(negative ? -value : value);
+			p = s;
+			return true;
+		}
+	}
+
+	p = start;
+	return scan_float_slow(p, end, out);
+}
+
+bool scanInt(const char * & p, const char * end, int & out){
+	const char * s = skip_blanks(p, end);
+
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+')){
+		negative = *s == '-';
+		s++;
+	}
+	if (s >= end || !is_digit(*s))
+		return false;
+
+	// Ten digits can't overflow 64 bits, more can't fit in an int anyway
+	int64_t value = 0;
+	const char * first = s;
+	for (; s < end && is_digit(*s); s++)
+		value = value * 10 + (*s - '0');
+	if (s - first > 10 || value > (int64_t)INT_MAX + negative)
+		return false;
+
+	out = (int)(negative ? -value : value);
+	p = s;
+	return true;
+}
+
+// "00" to "99", two digits at a time
+static const char digit_pairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static inline char * write_digits(char * out, unsigned long long value){
+	char digits[20];
+	char * d = digits + sizeof(digits);
+	while (value >= 100){
+		d -= 2;
+		memcpy(d, digit_pairs + 2 * (value % 100), 2);
+		value /= 100;
+	}
+	if (value >= 10){
+		d -= 2;
+		memcpy(d, digit_pairs + 2 * value, 2);
+	}
+	else
+		*--d = (char)('0' + value);
+	size_t n = digits + sizeof(digits) - d;
+	memcpy(out, d, n);
+	return out + n;
+}
+
+char * formatFloat(char * out, float value){
+	double magnitude = fabs((double)value);
+	if (!(magnitude < 1e12))
+		return out + snprintf(out, FLOAT_TEXT_MAX, "%.6f", value);
+
+	// A float times 1e6 is exact in a double : 24 bits of mantissa times
+	// 15625 * 2^6. llrint() then rounds half to even, as printf() does.
+	unsigned long long scaled = (unsigned long long)llrint(magnitude * 1e6);
+	if (signbit(value))
+		*out++ = '-';
+	out = write_digits(out, scaled / 1000000);
+	*out++ = '.';
+	unsigned int fraction = (unsigned int)(scaled % 1000000);
+	memcpy(out, digit_pairs + 2 * (fraction / 10000), 2);
+	memcpy(out + 2, digit_pairs + 2 * (fraction / 100 % 100), 2);
+	memcpy(out + 4, digit_pairs + 2 * (fraction % 100), 2);
+	return out + 6;
+}
+
+char * formatUInt(char * out, unsigned int value){
+	return write_digits(out, value);
+}
@@ -1,4 +1,6 @@
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include <stdio.h>
 #include <string>
 #include <cstring>
@@ -6,109 +8,603 @@
 #include <glm/glm.hpp>
 
 #include "objloader.hpp"
+#include "indextype.hpp"
+#include "mappedfile.hpp"
+#include "numtext.hpp"
 
-// Very, VERY simple OBJ loader.
+// Simple OBJ loader.
+// The file is memory mapped and parsed in place, numbers are read with
+// scanFloat() / scanInt() instead of going through scanf. With a pool, the
+// file is cut at line boundaries into chunks that are counted, then parsed,
+// then expanded to corners in parallel. It reads v, vt, vn
+// and f lines, with v, v/vt, v//vn or v/vt/vn corners, negative (relative)
+// indices and polygons, which are split in a fan around their first corner.
+// Other lines (comments, groups, materials, smoothing...) are skipped.
+// Corners without a uv get (0, 0) and corners without a normal get the
+// area-weighted average normal of the faces around their position, so they
+// still share vertices once indexed.
 // Here is a short list of features a real function would provide : 
 // - Binary files. Reading a model should be just a few memcpy's away, not parsing a file at runtime. In short : OBJ is not very great.
 // - Animations & bones (includes bones weights)
 // - Multiple UVs
-// - All attributes should be optional, not "forced"
-// - More stable. Change a line in the OBJ file and it crashes.
-// - More secure. Change another line and you can inject code.
 // - Loading from memory, stream, etc
 
+// Corner of a face : 0-based indices into the v, vt and vn lists, -1 if absent
+struct ObjCorner{
+	int v, vt, vn;
+};
+
+// v, vt and vn of the whole file, each chunk fills its own slice
+struct ObjData{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+};
+
+// Whole lines of the file, parsed by one task. Counting gives the number
+// of lines and elements of each kind ; their prefix sums over the chunks
+// before are where this chunk's elements go and what relative indices in it
+// count back from.
+struct ObjChunk{
+	const char * begin;
+	const char * end;
+	size_t lines, v, vt, vn, faces;
+	size_t first_line, first_v, first_vt, first_vn, first_corner;
+	std::vector<ObjCorner> corners;  // three per triangle
+	size_t error_line;               // first line that couldn't be read, 0 if none
+};
+
+enum ObjLine{
+	OBJ_OTHER,
+	OBJ_V,
+	OBJ_VT,
+	OBJ_VN,
+	OBJ_F
+};
+
+static inline bool is_blank(char c){
+	return c == ' ' || c == '\t';
+}
+
+static inline const char * skip_blanks(const char * p, const char * end){
+	while (p < end && is_blank(*p))
+		p++;
+	return p;
+}
+
+static inline const char * line_end(const char * p, const char * end){
+	const char * eol = (const char *)memchr(p, '\n', end - p);
+	return eol != NULL ? eol : end;
+}
+
+// Kind of the line whose first word starts at s
+static inline ObjLine line_kind(const char * s, const char * eol){
+	if (eol - s < 2)
+		return OBJ_OTHER;
+	if (s[0] == 'v'){
+		if (is_blank(s[1]))
+			return OBJ_V;
+		if (eol - s >= 3 && is_blank(s[2]))
+			return s[1] == 't' ? OBJ_VT : s[1] == 'n' ? OBJ_VN : OBJ_OTHER;
+		return OBJ_OTHER;
+	}
+	return s[0] == 'f' && is_blank(s[1]) ? OBJ_F : OBJ_OTHER;
+}
+
+// Cuts [data, data + size) into chunks of whole lines, about one megabyte
+// each and a few per thread
+static void split_obj(const char * data, size_t size, ThreadPool * pool, std::vector<ObjChunk> & chunks){
+	size_t count = 1;
+	if (pool)
+		count = std::max((size_t)1, std::min((size_t)pool->size() * 4, size >> 20));
+
+	const char * end = data + size;
+	const char * begin = data;
+	for (size_t c = 0; c < count && begin < end; c++){
+		const char * stop = c + 1 == count ? end : data + size / count * (c + 1);
+		if (stop < begin)
+			stop = begin;
+		if (stop < end)
+			stop = line_end(stop, end);
+		stop = stop < end ? stop + 1 : end;
+
+		ObjChunk chunk = ObjChunk();
+		chunk.begin = begin;
+		chunk.end = stop;
+		chunks.push_back(chunk);
+		begin = stop;
+	}
+}
+
+static void count_chunk(ObjChunk & chunk){
+	const char * p = chunk.begin;
+	while (p < chunk.end){
+		const char * eol = line_end(p, chunk.end);
+		switch (line_kind(skip_blanks(p, eol), eol)){
+		case OBJ_V:  chunk.v++; break;
+		case OBJ_VT: chunk.vt++; break;
+		case OBJ_VN: chunk.vn++; break;
+		case OBJ_F:  chunk.faces++; break;
+		default: break;
+		}
+		chunk.lines++;
+		p = eol < chunk.end ? eol + 1 : chunk.end;
+	}
+}
+
+// OBJ indices start at 1, negative ones count back from the last element
+// read (read elements of that kind so far)
+static inline bool scan_index(const char * & p, const char * end, size_t read, size_t total, int & out){
+	int index;
+	if (p >= end || is_blank(*p) || !scanInt(p, end, index))
+		return false;
+	if (index > 0 && (size_t)index <= total)
+		out = index - 1;
+	else if (index < 0 && (size_t)-(long long)index <= read)
+		out = (int)(read + index);
+	else
+		return false;
+	return true;
+}
+
+// read holds the v, vt and vn read before this line
+static bool parse_face(const char * p, const char * eol, const size_t read[3], const ObjData & data, std::vector<ObjCorner> & corners){
+	ObjCorner first = { -1, -1, -1 };
+	ObjCorner previous = first;
+	int n = 0;
+	for (;;){
+		p = skip_blanks(p, eol);
+		if (p == eol || *p == '\r')
+			break;
+
+		ObjCorner corner = { -1, -1, -1 };
+		if (!scan_index(p, eol, read[0], data.positions.size(), corner.v))
+			return false;
+		if (p < eol && *p == '/'){
+			p++;
+			if (p < eol && *p != '/' && !scan_index(p, eol, read[1], data.uvs.size(), corner.vt))
+				return false;
+			if (p < eol && *p == '/'){
+				p++;
+				if (!scan_index(p, eol, read[2], data.normals.size(), corner.vn))
+					return false;
+			}
+		}
+		if (p < eol && !is_blank(*p) && *p != '\r')
+			return false;
+
+		if (n == 0)
+			first = corner;
+		else if (n >= 2){
+			corners.push_back(first);
+			corners.push_back(previous);
+			corners.push_back(corner);
+		}
+		previous = corner;
+		n++;
+	}
+	return n >= 3;
+}
+
+// Parses the chunk into its slices of data and its own corners, stopping at
+// the first line that can't be read
+static void parse_chunk(ObjChunk & chunk, ObjData & data){
+	size_t read[3] = { chunk.first_v, chunk.first_vt, chunk.first_vn };
+	chunk.corners.reserve(3 * chunk.faces);
+
+	const char * p = chunk.begin;
+	for (size_t line = chunk.first_line; p < chunk.end; line++){
+		const char * eol = line_end(p, chunk.end);
+		const char * s = skip_blanks(p, eol);
+
+		bool ok = true;
+		switch (line_kind(s, eol)){
+		case OBJ_V:{
+			glm::vec3 & vertex = data.positions[read[0]++];
+			s++;
+			ok = scanFloat(s, eol, vertex.x) && scanFloat(s, eol, vertex.y) && scanFloat(s, eol, vertex.z);
+			break;
+		}
+		case OBJ_VT:{
+			glm::vec2 & uv = data.uvs[read[1]++];
+			s += 2;
+			ok = scanFloat(s, eol, uv.x) && scanFloat(s, eol, uv.y);
+			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+			break;
+		}
+		case OBJ_VN:{
+			glm::vec3 & normal = data.normals[read[2]++];
+			s += 2;
+			ok = scanFloat(s, eol, normal.x) && scanFloat(s, eol, normal.y) && scanFloat(s, eol, normal.z);
+			break;
+		}
+		case OBJ_F:
+			ok = parse_face(s + 1, eol, read, data, chunk.corners);
+			break;
+		default:
+			break;
+		}
+
+		if (!ok){
+			chunk.error_line = line;
+			return;
+		}
+		p = eol < chunk.end ? eol + 1 : chunk.end;
+	}
+}
+
+// Maps and parses the file into data and the chunks' corners. Returns the
+// number of corners, or -1 after printing why the file can't be read.
+static long long read_obj(const char * path, ThreadPool * pool, ObjData & data, std::vector<ObjChunk> & chunks){
+	printf("Loading OBJ file %s...\n", path);
+
+	MappedFile file;
+	if( !file.open(path) ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		getchar();
+		return -1;
+	}
+
+	split_obj(file.data(), file.size(), pool, chunks);
+	int nb_chunks = (int)chunks.size();
+	parallelFor(pool, nb_chunks, [&](int begin, int end){
+		for (int c = begin; c < end; c++)
+			count_chunk(chunks[c]);
+	}, 1);
+
+	// Where each chunk's lines and elements start
+	size_t lines = 1, v = 0, vt = 0, vn = 0;
+	for (int c = 0; c < nb_chunks; c++){
+		ObjChunk & chunk = chunks[c];
+		chunk.first_line = lines;
+		chunk.first_v = v;
+		chunk.first_vt = vt;
+		chunk.first_vn = vn;
+		lines += chunk.lines;
+		v += chunk.v;
+		vt += chunk.vt;
+		vn += chunk.vn;
+	}
+
+	data.positions.resize(v);
+	data.uvs.resize(vt);
+	data.normals.resize(vn);
+	parallelFor(pool, nb_chunks, [&](int begin, int end){
+		for (int c = begin; c < end; c++)
+			parse_chunk(chunks[c], data);
+	}, 1);
+
+	size_t corners = 0;
+	for (int c = 0; c < nb_chunks; c++){
+		ObjChunk & chunk = chunks[c];
+		if (chunk.error_line != 0){
+			printf("%s:%d can't be read by our simple parser :-( Try exporting with other options\n", path, (int)chunk.error_line);
+			return -1;
+		}
+		chunk.first_corner = corners;
+		corners += chunk.corners.size();
+	}
+	return (long long)corners;
+}
+
+// Area-weighted vertex normals, left empty if every corner has a normal.
+// Faces add to shared vertices, so the sums are done on one thread.
+static void smooth_normals(const ObjData & data, const std::vector<ObjChunk> & chunks, ThreadPool * pool, std::vector<glm::vec3> & normals){
+	bool any_without_normal = false;
+	for (size_t c = 0; c < chunks.size() && !any_without_normal; c++)
+		for (size_t i = 0; i < chunks[c].corners.size() && !any_without_normal; i++)
+			any_without_normal = chunks[c].corners[i].vn < 0;
+	if (!any_without_normal)
+		return;
+
+	normals.assign(data.positions.size(), glm::vec3(0.0f));
+	for (size_t c = 0; c < chunks.size(); c++)
+		addFaceNormals(chunks[c].corners, [](const ObjCorner & corner){ return corner.v; }, data.positions, normals);
+	normalizeNormals(normals, pool);
+}
+
+void normalizeNormals(std::vector<glm::vec3> & normals, ThreadPool * pool){
+	parallelFor(pool, (int)normals.size(), [&](int begin, int end){
+		for (int i = begin; i < end; i++){
+			float length = glm::length(normals[i]);
+			if (length > 0.0f)
+				normals[i] /= length;
+		}
+	}, 4096);
+}
+
 bool loadOBJ(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
 	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals
+	std::vector<glm::vec3> & out_normals,
+	ThreadPool * pool
 ){
-	printf("Loading OBJ file %s...\n", path);
+	ObjData data;
+	std::vector<ObjChunk> chunks;
+	long long read = read_obj(path, pool, data, chunks);
+	if (read < 0)
+		return false;
+	size_t corners = (size_t)read;
 
-	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices; 
-	std::vector<glm::vec2> temp_uvs;
-	std::vector<glm::vec3> temp_normals;
+	std::vector<glm::vec3> smooth;
+	smooth_normals(data, chunks, pool, smooth);
 
+	// For each vertex of each triangle, get the attributes thanks to the index
+	size_t vertex_base = out_vertices.size(), uv_base = out_uvs.size(), normal_base = out_normals.size();
+	out_vertices.resize(vertex_base + corners);
+	out_uvs     .resize(uv_base + corners);
+	out_normals .resize(normal_base + corners);
+	parallelFor(pool, (int)chunks.size(), [&](int begin, int end){
+		for (int c = begin; c < end; c++){
+			const ObjChunk & chunk = chunks[c];
+			for (size_t i = 0; i < chunk.corners.size(); i++){
+				const ObjCorner & corner = chunk.corners[i];
+				size_t at = chunk.first_corner + i;
+				out_vertices[vertex_base + at] = data.positions[corner.v];
+				out_uvs     [uv_base + at] = corner.vt >= 0 ? data.uvs[corner.vt] : glm::vec2(0.0f);
+				out_normals [normal_base + at] = corner.vn >= 0 ? data.normals[corner.vn] : smooth[corner.v];
+			}
+		}
+	}, 1);
 
-	FILE * file = fopen(path, "r");
-	if( file == NULL ){
-		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-		getchar();
+	return true;
+}
+
+// Slot of the corner table : a (v, vt, vn) triple and the output vertex it
+// became, index == EMPTY_SLOT if the slot is free
+struct CornerSlot{
+	ObjCorner key;
+	unsigned int index;
+};
+
+static const unsigned int EMPTY_SLOT = 0xFFFFFFFFu;
+
+static inline size_t corner_hash(const ObjCorner & c){
+	unsigned long long h = (unsigned int)c.v * 0x9E3779B97F4A7C15ull;
+	h ^= (unsigned int)c.vt * 0xC2B2AE3D27D4EB4Full;
+	h ^= (unsigned int)c.vn * 0x165667B19E3779F9ull;
+	return (size_t)(h ^ (h >> 32));
+}
+
+// Slot holding key, or the free slot where it goes. The table is a power of
+// two long and never full.
+static inline CornerSlot & find_slot(std::vector<CornerSlot> & table, const ObjCorner & key){
+	size_t mask = table.size() - 1;
+	for (size_t i = corner_hash(key) & mask;; i = (i + 1) & mask){
+		CornerSlot & slot = table[i];
+		if (slot.index == EMPTY_SLOT || (slot.key.v == key.v && slot.key.vt == key.vt && slot.key.vn == key.vn))
+			return slot;
+	}
+}
+
+static void grow_table(std::vector<CornerSlot> & table, size_t size){
+	std::vector<CornerSlot> old;
+	old.swap(table);
+	CornerSlot empty = { { -1, -1, -1 }, EMPTY_SLOT };
+	table.assign(size, empty);
+	for (size_t i = 0; i < old.size(); i++)
+		if (old[i].index != EMPTY_SLOT)
+			find_slot(table, old[i].key) = old[i];
+}
+
+template <typename Index>
+bool loadOBJIndexed(
+	const char * path,
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	ThreadPool * pool
+){
+	indices.clear();
+	vertices.clear();
+	uvs.clear();
+	normals.clear();
+
+	ObjData data;
+	std::vector<ObjChunk> chunks;
+	long long read = read_obj(path, pool, data, chunks);
+	if (read < 0)
 		return false;
+
+	std::vector<glm::vec3> smooth;
+	smooth_normals(data, chunks, pool, smooth);
+
+	// Most meshes have about one output vertex per position, a few more
+	// along uv seams and creases
+	size_t expected = std::max(data.positions.size(), std::max(data.uvs.size(), data.normals.size()));
+	std::vector<CornerSlot> table;
+	size_t size = 64;
+	while (size < 2 * expected)
+		size *= 2;
+	grow_table(table, size);
+	vertices.reserve(expected);
+	uvs.reserve(expected);
+	normals.reserve(expected);
+	indices.reserve((size_t)read);
+
+	for (size_t c = 0; c < chunks.size(); c++){
+		const std::vector<ObjCorner> & corners = chunks[c].corners;
+		for (size_t i = 0; i < corners.size(); i++){
+			const ObjCorner & corner = corners[i];
+			CornerSlot * slot = &find_slot(table, corner);
+			if (slot->index == EMPTY_SLOT){
+				if ( !indexFits<Index>(vertices.size() + 1) ){
+					printf("loadOBJIndexed : more than %u unique vertices, use wider indices\n", (unsigned int)vertices.size());
+					return false;
+				}
+				// Keep the table at most half full
+				if (2 * (vertices.size() + 1) > table.size()){
+					grow_table(table, 2 * table.size());
+					slot = &find_slot(table, corner);
+				}
+				slot->key = corner;
+				slot->index = (unsigned int)vertices.size();
+				vertices.push_back(data.positions[corner.v]);
+				uvs     .push_back(corner.vt >= 0 ? data.uvs[corner.vt] : glm::vec2(0.0f));
+				normals .push_back(corner.vn >= 0 ? data.normals[corner.vn] : smooth[corner.v]);
+			}
+			indices.push_back((Index)slot->index);
+		}
 	}
 
-	while( 1 ){
+	return true;
+}
+
+template bool loadOBJIndexed<unsigned short>(const char *, std::vector<unsigned short> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, ThreadPool *);
+template bool loadOBJIndexed<unsigned int>(const char *, std::vector<unsigned int> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, ThreadPool *);
 
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
+// saveOBJ() formats the file in chunks of this many lines. Each chunk gets
+// its own buffer, so chunks are formatted in parallel and then handed to the
+// file in order, one unbuffered write each.
+static const size_t OBJ_WRITE_LINES = 32768;
 
-		// else : parse lineHeader
-		
-		if ( strcmp( lineHeader, "v" ) == 0 ){
-			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
-			temp_vertices.push_back(vertex);
-		}else if ( strcmp( lineHeader, "vt" ) == 0 ){
-			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y );
-			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-			temp_uvs.push_back(uv);
-		}else if ( strcmp( lineHeader, "vn" ) == 0 ){
-			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-			temp_normals.push_back(normal);
-		}else if ( strcmp( lineHeader, "f" ) == 0 ){
-			std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
-			if (matches != 9){
-				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-				return false;
+// Longest line saveOBJ() writes : "vn " and three floats. Faces are shorter.
+static const size_t OBJ_LINE_MAX = 3 + 3 * (FLOAT_TEXT_MAX + 1);
+
+// Lines [begin, end) of one kind of ObjLine
+struct ObjWriteChunk{
+	int kind;
+	size_t begin;
+	size_t end;
+};
+
+static void add_write_chunks(std::vector<ObjWriteChunk> & chunks, int kind, size_t count){
+	for (size_t begin = 0; begin < count; begin += OBJ_WRITE_LINES){
+		ObjWriteChunk chunk = { kind, begin, std::min(count, begin + OBJ_WRITE_LINES) };
+		chunks.push_back(chunk);
+	}
+}
+
+static char * format_vec3_line(char * out, char tag, const glm::vec3 & value){
+	*out++ = 'v';
+	if (tag)
+		*out++ = tag;
+	*out++ = ' ';
+	out = formatFloat(out, value.x);
+	*out++ = ' ';
+	out = formatFloat(out, value.y);
+	*out++ = ' ';
+	out = formatFloat(out, value.z);
+	*out++ = '\n';
+	return out;
+}
+
+// Formats the lines of a chunk at out and returns their length. Missing
+// attributes are left out of the faces : f v//vn, f v/vt or f v.
+template <typename Index>
+static size_t format_obj_chunk(
+	char * out,
+	const ObjWriteChunk & chunk,
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals
+){
+	char * start = out;
+	bool has_uvs = !uvs.empty(), has_normals = !normals.empty();
+	for (size_t i = chunk.begin; i < chunk.end; i++){
+		switch (chunk.kind){
+		case OBJ_V:
+			out = format_vec3_line(out, 0, vertices[i]);
+			break;
+		case OBJ_VT:
+			memcpy(out, "vt ", 3);
+			out = formatFloat(out + 3, uvs[i].x);
+			*out++ = ' ';
+			out = formatFloat(out, -uvs[i].y);
+			*out++ = '\n';
+			break;
+		case OBJ_VN:
+			out = format_vec3_line(out, 'n', normals[i]);
+			break;
+		default:
+			*out++ = 'f';
+			for (int k = 0; k < 3; k++){
+				*out++ = ' ';
+				char * corner = out;
+				out = formatUInt(out, (unsigned int)indices[3 * i + k] + 1);
+				size_t length = out - corner;
+				if (has_uvs){
+					*out++ = '/';
+					memcpy(out, corner, length);
+					out += length;
+				}
+				if (has_normals){
+					*out++ = '/';
+					if (!has_uvs)
+						*out++ = '/';
+					memcpy(out, corner, length);
+					out += length;
+				}
 			}
-			vertexIndices.push_back(vertexIndex[0]);
-			vertexIndices.push_back(vertexIndex[1]);
-			vertexIndices.push_back(vertexIndex[2]);
-			uvIndices    .push_back(uvIndex[0]);
-			uvIndices    .push_back(uvIndex[1]);
-			uvIndices    .push_back(uvIndex[2]);
-			normalIndices.push_back(normalIndex[0]);
-			normalIndices.push_back(normalIndex[1]);
-			normalIndices.push_back(normalIndex[2]);
-		}else{
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
+			*out++ = '\n';
+			break;
 		}
+	}
+	return out - start;
+}
 
+template <typename Index>
+bool saveOBJ(
+	const char * path,
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	ThreadPool * pool
+){
+	FILE * file = fopen(path, "w");
+	if (file == NULL){
+		printf("Can't write %s\n", path);
+		return false;
 	}
+	// The chunks are already large, stdio would only copy them once more
+	setvbuf(file, NULL, _IONBF, 0);
 
-	// For each vertex of each triangle
-	for( unsigned int i=0; i<vertexIndices.size(); i++ ){
-
-		// Get the indices of its attributes
-		unsigned int vertexIndex = vertexIndices[i];
-		unsigned int uvIndex = uvIndices[i];
-		unsigned int normalIndex = normalIndices[i];
-		
-		// Get the attributes thanks to the index
-		glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
-		glm::vec2 uv = temp_uvs[ uvIndex-1 ];
-		glm::vec3 normal = temp_normals[ normalIndex-1 ];
-		
-		// Put the attributes in buffers
-		out_vertices.push_back(vertex);
-		out_uvs     .push_back(uv);
-		out_normals .push_back(normal);
-	
+	std::vector<ObjWriteChunk> chunks;
+	add_write_chunks(chunks, OBJ_V, vertices.size());
+	add_write_chunks(chunks, OBJ_VT, uvs.size());
+	add_write_chunks(chunks, OBJ_VN, normals.size());
+	add_write_chunks(chunks, OBJ_F, indices.size() / 3);
+
+	// A few chunks per thread are formatted at a time, then written in order,
+	// so the buffers stay a few megabytes whatever the size of the mesh
+	size_t wave = pool ? (size_t)pool->size() * 2 : 1;
+	std::vector< std::vector<char> > buffers(std::min(wave, chunks.size()));
+	std::vector<size_t> lengths(buffers.size());
+
+	bool ok = fprintf(file, "# %d vertices, %d triangles\n", (int)vertices.size(), (int)indices.size() / 3) > 0;
+	for (size_t first = 0; first < chunks.size() && ok; first += wave){
+		int count = (int)std::min(wave, chunks.size() - first);
+		parallelFor(pool, count, [&](int begin, int end){
+			for (int i = begin; i < end; i++){
+				const ObjWriteChunk & chunk = chunks[first + i];
+				size_t needed = (chunk.end - chunk.begin) * OBJ_LINE_MAX;
+				if (buffers[i].size() < needed)
+					buffers[i].resize(needed);
+				lengths[i] = format_obj_chunk(buffers[i].data(), chunk, indices, vertices, uvs, normals);
+			}
+		}, 1);
+		for (int i = 0; i < count && ok; i++)
+			ok = fwrite(buffers[i].data(), 1, lengths[i], file) == lengths[i];
 	}
 
+	if (fclose(file) != 0 || !ok){
+		printf("Can't write %s\n", path);
+		return false;
+	}
 	return true;
 }
 
+template bool saveOBJ<unsigned short>(const char *, const std::vector<unsigned short> &,
+	const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, ThreadPool *);
+template bool saveOBJ<unsigned int>(const char *, const std::vector<unsigned int> &,
+	const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, ThreadPool *);
+
 
 #ifdef USE_ASSIMP // don't use this #define, it's only for me (it AssImp fails to compile on your machine, at least all the other tutorials still work)
 
@@ -117,9 +613,10 @@ bool loadOBJ(
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing flags
 
+template <typename Index>
 bool loadAssImp(
 	const char * path, 
-	std::vector<unsigned short> & indices,
+	std::vector<Index> & indices,
 	std::vector<glm::vec3> & vertices,
 	std::vector<glm::vec2> & uvs,
 	std::vector<glm::vec3> & normals
@@ -134,6 +631,10 @@ bool loadAssImp(
 		return false;
 	}
 	const aiMesh* mesh = scene->mMeshes[0]; // In this simple example code we always use the 1rst mesh (in OBJ files there is often only one anyway)
+	if ( !indexFits<Index>(mesh->mNumVertices) ){
+		printf("%s has %u vertices, use wider indices\n", path, mesh->mNumVertices);
+		return false;
+	}
 
 	// Fill vertices positions
 	vertices.reserve(mesh->mNumVertices);
@@ -167,7 +668,12 @@ bool loadAssImp(
 	}
 	
 	// The "scene" pointer will be deleted automatically by "importer"
-
+	return true;
 }
 
+template bool loadAssImp<unsigned short>(const char *, std::vector<unsigned short> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template bool loadAssImp<unsigned int>(const char *, std::vector<unsigned int> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,361 @@
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#include <glm/glm.hpp>
+
+#include "quadric.hpp"
+#include "threadpool.hpp"
+#include "outofcore.hpp"
+#include "mappedfile.hpp"
+
+static const int AXIS_BITS = 21;
+
+ClusterStream::ClusterStream(const glm::vec3 & box_min, const glm::vec3 & box_max, int resolution){
+	glm::vec3 extent = box_max - box_min;
+	float longest = fmaxf(extent.x, fmaxf(extent.y, extent.z));
+	if (resolution < 1)
+		resolution = 1;
+	if (resolution > (1 << AXIS_BITS))
+		resolution = 1 << AXIS_BITS;
+
+	origin = box_min;
+	cell_size = longest > 0.0f ? longest / resolution : 1.0f;
+	for (int k = 0; k < 3; k++){
+		dim[k] = (int)ceilf(extent[k] / cell_size);
+		if (dim[k] < 1)
+			dim[k] = 1;
+		if (dim[k] > resolution)
+			dim[k] = resolution;
+	}
+}
+
+size_t ClusterStream::FaceHash::operator()(const Face & f) const{
+	unsigned long long h = (unsigned int)f.c[0];
+	h = h * 0x9E3779B97F4A7C15ull + (unsigned int)f.c[1];
+	h = h * 0x9E3779B97F4A7C15ull + (unsigned int)f.c[2];
+	return (size_t)(h ^ (h >> 29));
+}
+
+unsigned long long ClusterStream::cellKey(const glm::vec3 & p) const{
+	unsigned long long key = 0;
+	for (int k = 0; k < 3; k++){
+		// Clamped as a float, a position that isn't finite can't overflow the int
+		float f = floorf((p[k] - origin[k]) / cell_size);
+		int c = !(f >= 0.0f) ? 0 : f >= (float)dim[k] ? dim[k] - 1 : (int)f;
+		key = (key << AXIS_BITS) | (unsigned long long)c;
+	}
+	return key;
+}
+
+int ClusterStream::cellSlot(unsigned long long key){
+	std::pair<std::unordered_map<unsigned long long, int>::iterator, bool> ins =
+		slot_of.insert(std::make_pair(key, (int)cells.size()));
+	if (ins.second){
+		Cell cell;
+		quadricZero(cell.quadric);
+		cell.sum[0] = cell.sum[1] = cell.sum[2] = 0.0;
+		cell.count = 0;
+		cell.key = key;
+		cells.push_back(cell);
+	}
+	return ins.first->second;
+}
+
+void ClusterStream::addTriangles(const glm::vec3 * corners, int count, ThreadPool * pool){
+	batch_keys.resize(3 * count);
+	batch_quadrics.resize(count);
+
+	std::function<void(int, int)> prepare = [&](int begin, int end){
+		for (int t = begin; t < end; t++){
+			const glm::vec3 * p = corners + 3 * t;
+			for (int k = 0; k < 3; k++)
+				batch_keys[3*t+k] = cellKey(p[k]);
+			quadricZero(batch_quadrics[t]);
+			quadricAddTriangle(batch_quadrics[t], p[0], p[1], p[2]);
+		}
+	};
+	parallelFor(pool, count, prepare, 1024);
+
+	for (int t = 0; t < count; t++){
+		int s[3];
+		for (int k = 0; k < 3; k++){
+			s[k] = cellSlot(batch_keys[3*t+k]);
+			Cell & cell = cells[s[k]];
+			const glm::vec3 & p = corners[3*t+k];
+			cell.sum[0] += p.x;
+			cell.sum[1] += p.y;
+			cell.sum[2] += p.z;
+			cell.count++;
+		}
+
+		// Each distinct cell of the triangle gets its plane once
+		quadricAdd(cells[s[0]].quadric, batch_quadrics[t]);
+		if (s[1] != s[0])
+			quadricAdd(cells[s[1]].quadric, batch_quadrics[t]);
+		if (s[2] != s[0] && s[2] != s[1])
+			quadricAdd(cells[s[2]].quadric, batch_quadrics[t]);
+
+		if (s[0] == s[1] || s[1] == s[2] || s[0] == s[2])
+			continue;
+
+		// Rotate the smallest slot first so the same face is only kept once
+		int r = (s[0] < s[1] && s[0] < s[2]) ? 0 : (s[1] < s[2] ? 1 : 2);
+		Face f = {{ s[r], s[(r + 1) % 3], s[(r + 2) % 3] }};
+		faces.insert(f);
+	}
+}
+
+void ClusterStream::finish(std::vector<unsigned int> & indices, std::vector<glm::vec3> & vertices) const{
+	// Only the cells used by a surviving face become vertices, numbered in
+	// the order the cells were first touched
+	std::vector<int> used(cells.size(), 0);
+	for (std::unordered_set<Face, FaceHash>::const_iterator it = faces.begin(); it != faces.end(); ++it)
+		for (int k = 0; k < 3; k++)
+			used[it->c[k]] = 1;
+
+	std::vector<unsigned int> remap(cells.size(), 0);
+	vertices.clear();
+	for (size_t i = 0; i < cells.size(); i++){
+		if (!used[i])
+			continue;
+		const Cell & cell = cells[i];
+		remap[i] = (unsigned int)vertices.size();
+
+		glm::vec3 mean((float)(cell.sum[0] / cell.count), (float)(cell.sum[1] / cell.count), (float)(cell.sum[2] / cell.count));
+		glm::vec3 p;
+		bool inside = quadricOptimum(cell.quadric, p);
+		for (int k = 0; k < 3 && inside; k++){
+			int c = (int)((cell.key >> (AXIS_BITS * (2 - k))) & ((1ull << AXIS_BITS) - 1));
+			float lo = origin[k] + (c - 1) * cell_size;
+			float hi = origin[k] + (c + 2) * cell_size;
+			inside = p[k] >= lo && p[k] <= hi;
+		}
+		vertices.push_back(inside ? p : mean);
+	}
+
+	// Sort the faces so the output does not depend on hash order
+	std::vector<Face> sorted(faces.begin(), faces.end());
+	std::sort(sorted.begin(), sorted.end(), [](const Face & a, const Face & b){
+		if (a.c[0] != b.c[0]) return a.c[0] < b.c[0];
+		if (a.c[1] != b.c[1]) return a.c[1] < b.c[1];
+		return a.c[2] < b.c[2];
+	});
+	indices.resize(3 * sorted.size());
+	for (size_t f = 0; f < sorted.size(); f++)
+		for (int k = 0; k < 3; k++)
+			indices[3*f+k] = remap[sorted[f].c[k]];
+}
+
+size_t ClusterStream::memoryBytes() const{
+	// Hash nodes cost about a key, a value and two pointers each
+	return cells.capacity() * sizeof(Cell)
+	     + slot_of.size() * (sizeof(unsigned long long) + sizeof(int) + 2 * sizeof(void *))
+	     + slot_of.bucket_count() * sizeof(void *)
+	     + faces.size() * (sizeof(Face) + 2 * sizeof(void *))
+	     + faces.bucket_count() * sizeof(void *)
+	     + batch_keys.capacity() * sizeof(unsigned long long)
+	     + batch_quadrics.capacity() * sizeof(Quadric);
+}
+
+OutOfCoreOptions::OutOfCoreOptions()
+	: grid_resolution(256), batch_triangles(1 << 16), pool(NULL), spill_path(NULL){
+}
+
+// Reads "v x y z". Returns false for any other line.
+static bool parse_position(const char * line, glm::vec3 & p){
+	if (line[0] != 'v' || (line[1] != ' ' && line[1] != '\t'))
+		return false;
+	char * s = (char *)line + 2;
+	for (int k = 0; k < 3; k++)
+		p[k] = strtof(s, &s);
+	return true;
+}
+
+// Position index of the next face corner ("7", "7/2", "7/2/5", "7//5",
+// negative for relative), or -1 at the end of the line. -2 if the index
+// is out of range.
+static long long parse_corner(char *& s, long long vertex_count){
+	while (*s == ' ' || *s == '\t')
+		s++;
+	if (*s == '\0' || *s == '\n' || *s == '\r' || *s == '#')
+		return -1;
+	char * end;
+	long long i = strtoll(s, &end, 10);
+	if (end == s)
+		return -1;
+	s = end;
+	while (*s != '\0' && *s != ' ' && *s != '\t' && *s != '\n' && *s != '\r')
+		s++;
+	i = i < 0 ? vertex_count + i : i - 1;
+	return (i >= 0 && i < vertex_count) ? i : -2;
+}
+
+bool simplifyOutOfCore(
+	const char * path,
+	const OutOfCoreOptions & options,
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	OutOfCoreStats * stats
+){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	FILE * file = fopen(path, "r");
+	if (file == NULL){
+		printf("Impossible to open %s\n", path);
+		return false;
+	}
+
+	// Lines longer than this (huge polygons) are skipped
+	std::vector<char> buffer(1 << 16);
+	char * line = &buffer[0];
+
+	FILE * spill = NULL;
+	if (options.spill_path != NULL){
+		spill = fopen(options.spill_path, "wb");
+		if (spill == NULL){
+			printf("simplifyOutOfCore : can't write %s\n", options.spill_path);
+			fclose(file);
+			return false;
+		}
+	}
+
+	// First pass : bounding box and positions, written out a block at a
+	// time when they are spilled
+	glm::vec3 box_min(FLT_MAX), box_max(-FLT_MAX);
+	long long vertex_count = 0;
+	std::vector<glm::vec3> positions;
+	bool spill_ok = true;
+	bool continued = false;
+	while (fgets(line, (int)buffer.size(), file)){
+		// The pieces of an overlong line are skipped here as in the second pass
+		size_t len = strlen(line);
+		bool was_continued = continued;
+		continued = !(len > 0 && line[len - 1] == '\n') && !feof(file);
+		glm::vec3 p;
+		if (was_continued || continued || !parse_position(line, p))
+			continue;
+		box_min = glm::min(box_min, p);
+		box_max = glm::max(box_max, p);
+		vertex_count++;
+		positions.push_back(p);
+		if (spill && positions.size() == (1 << 16)){
+			spill_ok = spill_ok && fwrite(&positions[0], sizeof(glm::vec3), positions.size(), spill) == positions.size();
+			positions.clear();
+		}
+	}
+	if (spill){
+		if (!positions.empty())
+			spill_ok = spill_ok && fwrite(&positions[0], sizeof(glm::vec3), positions.size(), spill) == positions.size();
+		positions = std::vector<glm::vec3>();
+		if (fclose(spill) != 0)
+			spill_ok = false;
+	}
+
+	MappedFile spilled;
+	const glm::vec3 * known = positions.empty() ? NULL : &positions[0];
+	if (spill && vertex_count > 0 && spill_ok){
+		spill_ok = spilled.open(options.spill_path) && spilled.size() == (size_t)vertex_count * sizeof(glm::vec3);
+		known = (const glm::vec3 *)spilled.data();
+	}
+	if (!spill_ok || vertex_count == 0 || vertex_count > 0xFFFFFFFFll){
+		if (!spill_ok)
+			printf("simplifyOutOfCore : can't spill the positions to %s\n", options.spill_path);
+		else
+			printf("simplifyOutOfCore : %s has %lld vertices\n", path, vertex_count);
+		fclose(file);
+		spilled.close();
+		if (spill)
+			remove(options.spill_path);
+		return false;
+	}
+
+	// Second pass : stream the faces. Positions are counted again so that
+	// faces only see the vertices defined before them.
+	rewind(file);
+	ClusterStream grid(box_min, box_max, options.grid_resolution);
+	int batch_size = options.batch_triangles > 0 ? options.batch_triangles : 1;
+	std::vector<glm::vec3> batch;
+	batch.reserve(3 * batch_size);
+
+	std::vector<long long> corners;
+	long long seen = 0, triangles = 0, skipped = 0, truncated = 0;
+	continued = false;
+	while (fgets(line, (int)buffer.size(), file)){
+		size_t len = strlen(line);
+		bool complete = len > 0 && line[len - 1] == '\n';
+		bool was_continued = continued;
+		continued = !complete && !feof(file);
+		if (was_continued || continued){
+			if (!was_continued)
+				truncated++;
+			continue;
+		}
+
+		if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')){
+			seen++;
+			continue;
+		}
+		if (line[0] != 'f' || (line[1] != ' ' && line[1] != '\t'))
+			continue;
+
+		// A face with any corner out of range is dropped whole
+		char * s = line + 1;
+		long long corner;
+		bool bad = false;
+		corners.clear();
+		while ((corner = parse_corner(s, seen)) != -1){
+			bad = bad || corner == -2;
+			corners.push_back(corner);
+		}
+		if (bad){
+			skipped++;
+			continue;
+		}
+		for (size_t k = 2; k < corners.size(); k++){
+			batch.push_back(known[corners[0]]);
+			batch.push_back(known[corners[k - 1]]);
+			batch.push_back(known[corners[k]]);
+			triangles++;
+			if ((int)batch.size() == 3 * batch_size){
+				grid.addTriangles(&batch[0], batch_size, options.pool);
+				batch.clear();
+			}
+		}
+	}
+	fclose(file);
+	if (!batch.empty())
+		grid.addTriangles(&batch[0], (int)batch.size() / 3, options.pool);
+
+	if (skipped)
+		printf("simplifyOutOfCore : skipped %lld faces with indices out of range\n", skipped);
+	if (truncated)
+		printf("simplifyOutOfCore : skipped %lld lines longer than %d bytes\n", truncated, (int)buffer.size());
+
+	size_t peak = positions.capacity() * sizeof(glm::vec3) + batch.capacity() * sizeof(glm::vec3) + buffer.size() + grid.memoryBytes();
+	size_t spilled_bytes = spilled.size();
+	positions = std::vector<glm::vec3>();
+	spilled.close();
+	if (spill)
+		remove(options.spill_path);
+	grid.finish(indices, vertices);
+
+	if (stats){
+		stats->vertices_before = vertex_count;
+		stats->triangles_before = triangles;
+		stats->vertices_after = (int)vertices.size();
+		stats->triangles_after = (int)indices.size() / 3;
+		stats->peak_bytes = peak;
+		stats->spilled_bytes = spilled_bytes;
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return true;
+}
@@ -0,0 +1,507 @@
+#include <vector>
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include "plyfile.hpp"
+#include "objloader.hpp"
+#include "indextype.hpp"
+
+// PLY property types. The body is read and written as is, which assumes a
+// little-endian host like every platform this builds for.
+enum PlyType{
+	PLY_NONE,
+	PLY_INT8,
+	PLY_UINT8,
+	PLY_INT16,
+	PLY_UINT16,
+	PLY_INT32,
+	PLY_UINT32,
+	PLY_FLOAT32,
+	PLY_FLOAT64
+};
+
+// Names texture coordinates go by, in the order they are looked for. open()
+// and read() must agree on the pair, so both take the first one present.
+static const char * const UV_NAMES[4][2] = {
+	{ "s", "t" }, { "u", "v" }, { "texture_u", "texture_v" }, { "texture_s", "texture_t" }
+};
+
+static int ply_type(const std::string & name){
+	if (name == "char" || name == "int8") return PLY_INT8;
+	if (name == "uchar" || name == "uint8") return PLY_UINT8;
+	if (name == "short" || name == "int16") return PLY_INT16;
+	if (name == "ushort" || name == "uint16") return PLY_UINT16;
+	if (name == "int" || name == "int32") return PLY_INT32;
+	if (name == "uint" || name == "uint32") return PLY_UINT32;
+	if (name == "float" || name == "float32") return PLY_FLOAT32;
+	if (name == "double" || name == "float64") return PLY_FLOAT64;
+	return PLY_NONE;
+}
+
+static size_t ply_size(int type){
+	static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+	return sizes[type];
+}
+
+static double ply_value(const char * p, int type){
+	switch (type){
+	case PLY_INT8:    { int8_t v;   memcpy(&v, p, 1); return v; }
+	case PLY_UINT8:   { uint8_t v;  memcpy(&v, p, 1); return v; }
+	case PLY_INT16:   { int16_t v;  memcpy(&v, p, 2); return v; }
+	case PLY_UINT16:  { uint16_t v; memcpy(&v, p, 2); return v; }
+	case PLY_INT32:   { int32_t v;  memcpy(&v, p, 4); return v; }
+	case PLY_UINT32:  { uint32_t v; memcpy(&v, p, 4); return v; }
+	case PLY_FLOAT32: { float v;    memcpy(&v, p, 4); return v; }
+	case PLY_FLOAT64: { double v;   memcpy(&v, p, 8); return v; }
+	default: return 0.0;
+	}
+}
+
+PlyMesh::PlyMesh(){
+	close();
+}
+
+void PlyMesh::close(){
+	file.close();
+	elements.clear();
+	body = NULL;
+	vertex_element = -1;
+	face_element = -1;
+	vertex_count = 0;
+	face_count = 0;
+	position_view = PlyView<glm::vec3>();
+	normal_view = PlyView<glm::vec3>();
+	uv_view = PlyView<glm::vec2>();
+	triangle_view = PlyView<PlyTriangle>();
+}
+
+bool PlyMesh::open(const char * path){
+	close();
+	if (!file.open(path)){
+		printf("%s could not be opened\n", path);
+		return false;
+	}
+	if (!parseHeader(path) || !locateElements(path)){
+		close();
+		return false;
+	}
+
+	if (vertex_element >= 0){
+		const Element & vertex = elements[vertex_element];
+		static const char * const xyz[3] = { "x", "y", "z" };
+		static const char * const nxyz[3] = { "nx", "ny", "nz" };
+		position_view = floatView<glm::vec3>(vertex, xyz, 3);
+		normal_view = floatView<glm::vec3>(vertex, nxyz, 3);
+		for (int i = 0; i < 4; i++)
+			if (findProperty(vertex, UV_NAMES[i][0]) != NULL && findProperty(vertex, UV_NAMES[i][1]) != NULL){
+				uv_view = floatView<glm::vec2>(vertex, UV_NAMES[i], 2);
+				break;
+			}
+	}
+	return true;
+}
+
+// The header is text lines up to "end_header", the binary body follows
+bool PlyMesh::parseHeader(const char * path){
+	const char * data = file.data();
+	const char * end = data + file.size();
+	if (file.size() < 4 || memcmp(data, "ply", 3) != 0 || (data[3] != '\n' && data[3] != '\r')){
+		printf("%s is not a PLY file\n", path);
+		return false;
+	}
+
+	const char * p = data;
+	bool binary = false;
+	for (;;){
+		const char * eol = (const char *)memchr(p, '\n', end - p);
+		if (eol == NULL){
+			printf("%s has no end_header\n", path);
+			return false;
+		}
+		std::istringstream line(std::string(p, eol));
+		p = eol + 1;
+
+		std::string keyword;
+		line >> keyword;
+		if (keyword == "end_header")
+			break;
+		if (keyword == "format"){
+			std::string format;
+			line >> format;
+			binary = format == "binary_little_endian";
+		}else if (keyword == "element"){
+			Element element = Element();
+			line >> element.name >> element.count;
+			elements.push_back(element);
+		}else if (keyword == "property"){
+			if (elements.empty()){
+				printf("%s has a property outside of any element\n", path);
+				return false;
+			}
+			Property property = Property();
+			std::string type;
+			line >> type;
+			if (type == "list"){
+				std::string count_type, item_type;
+				line >> count_type >> item_type;
+				property.count_type = ply_type(count_type);
+				property.type = ply_type(item_type);
+				if (property.count_type == PLY_NONE || property.count_type == PLY_FLOAT32 || property.count_type == PLY_FLOAT64)
+					property.type = PLY_NONE;
+			}else
+				property.type = ply_type(type);
+			line >> property.name;
+			if (property.type == PLY_NONE){
+				printf("%s has a property of unknown type\n", path);
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+	}
+	if (!binary){
+		printf("%s : only binary little-endian PLY files can be read\n", path);
+		return false;
+	}
+
+	for (size_t i = 0; i < elements.size(); i++){
+		if (elements[i].name == "vertex")
+			vertex_element = (int)i;
+		else if (elements[i].name == "face")
+			face_element = (int)i;
+	}
+	body = p;
+	return true;
+}
+
+// Finds where the records of every element start and end. Elements with
+// lists are walked record by record, reading only the list lengths.
+bool PlyMesh::locateElements(const char * path){
+	const char * end = file.data() + file.size();
+	const char * p = body;
+	bool truncated = false;
+
+	for (size_t e = 0; e < elements.size() && !truncated; e++){
+		Element & element = elements[e];
+		element.begin = p;
+
+		bool has_list = false;
+		size_t stride = 0;
+		for (size_t i = 0; i < element.properties.size(); i++){
+			Property & property = element.properties[i];
+			property.offset = stride;
+			stride += ply_size(property.type);
+			has_list |= property.count_type != PLY_NONE;
+		}
+
+		if (!has_list){
+			element.stride = stride;
+			if (stride > 0 && element.count > (size_t)(end - p) / stride)
+				truncated = true;
+			else
+				p += element.count * stride;
+		}else{
+			// Faces of 3 uchar-counted 32-bit indices can be viewed in place
+			const Property & first = element.properties[0];
+			bool triangles = (int)e == face_element && element.properties.size() == 1
+				&& first.count_type == PLY_UINT8 && (first.type == PLY_INT32 || first.type == PLY_UINT32);
+
+			for (size_t r = 0; r < element.count && !truncated; r++){
+				for (size_t i = 0; i < element.properties.size() && !truncated; i++){
+					const Property & property = element.properties[i];
+					size_t count_size = ply_size(property.count_type);
+					if ((size_t)(end - p) < count_size){
+						truncated = true;
+						break;
+					}
+					size_t n = 1;
+					if (property.count_type != PLY_NONE){
+						double length = ply_value(p, property.count_type);
+						n = length >= 0.0 ? (size_t)length : (size_t)-1;
+						triangles &= n == 3;
+						p += count_size;
+					}
+					if (n > (size_t)(end - p) / ply_size(property.type))
+						truncated = true;
+					else
+						p += n * ply_size(property.type);
+				}
+			}
+			if (triangles && !truncated){
+				triangle_view.data = element.begin + 1;
+				triangle_view.count = element.count;
+				triangle_view.stride = 13;
+			}
+		}
+		element.end = p;
+	}
+
+	if (truncated){
+		printf("%s is truncated or corrupt\n", path);
+		return false;
+	}
+	if (vertex_element >= 0)
+		vertex_count = elements[vertex_element].count;
+	if (face_element >= 0)
+		face_count = elements[face_element].count;
+	return true;
+}
+
+const PlyMesh::Property * PlyMesh::findProperty(const Element & element, const char * name) const{
+	for (size_t i = 0; i < element.properties.size(); i++)
+		if (element.properties[i].name == name)
+			return &element.properties[i];
+	return NULL;
+}
+
+// View of count consecutive float properties names[0..count) of a fixed-size element
+template <typename T>
+PlyView<T> PlyMesh::floatView(const Element & element, const char * const * names, int count) const{
+	PlyView<T> view = PlyView<T>();
+	if (element.stride == 0)
+		return view;
+	const Property * first = findProperty(element, names[0]);
+	for (int i = 0; i < count; i++){
+		const Property * property = findProperty(element, names[i]);
+		if (property == NULL || property->type != PLY_FLOAT32 || first == NULL || property->offset != first->offset + 4 * i)
+			return view;
+	}
+	view.data = element.begin + first->offset;
+	view.count = element.count;
+	view.stride = element.stride;
+	return view;
+}
+
+template <typename Index>
+bool PlyMesh::read(
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	ThreadPool * pool
+) const{
+	indices.clear();
+	vertices.clear();
+	uvs.clear();
+	normals.clear();
+
+	if (vertex_element < 0 || elements[vertex_element].stride == 0){
+		printf("PLY file has no vertex element, or one with lists\n");
+		return false;
+	}
+	if (!indexFits<Index>(vertex_count)){
+		printf("PLY file has %u vertices, use wider indices\n", (unsigned int)vertex_count);
+		return false;
+	}
+
+	// Properties the views couldn't cover are converted one by one
+	const Element & vertex = elements[vertex_element];
+	const Property * position[3] = { findProperty(vertex, "x"), findProperty(vertex, "y"), findProperty(vertex, "z") };
+	const Property * normal[3] = { findProperty(vertex, "nx"), findProperty(vertex, "ny"), findProperty(vertex, "nz") };
+	const Property * uv[2] = { NULL, NULL };
+	for (int i = 0; i < 4 && (uv[0] == NULL || uv[1] == NULL); i++){
+		uv[0] = findProperty(vertex, UV_NAMES[i][0]);
+		uv[1] = findProperty(vertex, UV_NAMES[i][1]);
+	}
+	if (position[0] == NULL || position[1] == NULL || position[2] == NULL){
+		printf("PLY vertices have no x, y and z\n");
+		return false;
+	}
+	bool has_normals = normal[0] != NULL && normal[1] != NULL && normal[2] != NULL;
+	bool has_uvs = uv[0] != NULL && uv[1] != NULL;
+
+	vertices.resize(vertex_count);
+	uvs.resize(vertex_count, glm::vec2(0.0f));
+	if (has_normals)
+		normals.resize(vertex_count);
+	parallelFor(pool, (int)vertex_count, [&](int begin, int end){
+		for (int i = begin; i < end; i++){
+			const char * record = vertex.begin + (size_t)i * vertex.stride;
+			if (position_view.data != NULL)
+				vertices[i] = position_view[i];
+			else
+				for (int k = 0; k < 3; k++)
+					vertices[i][k] = (float)ply_value(record + position[k]->offset, position[k]->type);
+			if (has_normals){
+				if (normal_view.data != NULL)
+					normals[i] = normal_view[i];
+				else
+					for (int k = 0; k < 3; k++)
+						normals[i][k] = (float)ply_value(record + normal[k]->offset, normal[k]->type);
+			}
+			if (has_uvs){
+				if (uv_view.data != NULL)
+					uvs[i] = uv_view[i];
+				else
+					for (int k = 0; k < 2; k++)
+						uvs[i][k] = (float)ply_value(record + uv[k]->offset, uv[k]->type);
+				uvs[i].y = -uvs[i].y; // Invert V coordinate, like loadOBJ()
+			}
+		}
+	}, 4096);
+
+	std::atomic<bool> out_of_range(false);
+	if (triangle_view.data != NULL){
+		indices.resize(3 * face_count);
+		parallelFor(pool, (int)face_count, [&](int begin, int end){
+			bool bad = false;
+			for (int f = begin; f < end; f++){
+				PlyTriangle triangle = triangle_view[f];
+				for (int k = 0; k < 3; k++){
+					bad |= triangle.v[k] >= vertex_count;
+					indices[3 * f + k] = (Index)triangle.v[k];
+				}
+			}
+			if (bad)
+				out_of_range = true;
+		}, 4096);
+	}else if (face_element >= 0){
+		// Walks the records, splitting polygons in fans around their first corner
+		const Element & face = elements[face_element];
+		const char * p = face.begin;
+		indices.reserve(3 * face_count);
+		for (size_t f = 0; f < face_count; f++){
+			for (size_t i = 0; i < face.properties.size(); i++){
+				const Property & property = face.properties[i];
+				size_t n = 1;
+				if (property.count_type != PLY_NONE){
+					n = (size_t)ply_value(p, property.count_type);
+					p += ply_size(property.count_type);
+				}
+				size_t item = ply_size(property.type);
+				if (property.count_type != PLY_NONE && (property.name == "vertex_indices" || property.name == "vertex_index")){
+					for (size_t k = 2; k < n; k++){
+						double corners[3] = { ply_value(p, property.type), ply_value(p + (k - 1) * item, property.type), ply_value(p + k * item, property.type) };
+						for (int c = 0; c < 3; c++){
+							if (corners[c] < 0.0 || corners[c] >= (double)vertex_count)
+								out_of_range = true;
+							indices.push_back((Index)corners[c]);
+						}
+					}
+				}
+				p += n * item;
+			}
+		}
+	}
+	if (out_of_range){
+		printf("PLY file has a face with an index out of range\n");
+		indices.clear();
+		vertices.clear();
+		uvs.clear();
+		normals.clear();
+		return false;
+	}
+
+	// Smooth normals, as loadOBJ() gives vertices without one
+	if (!has_normals){
+		normals.assign(vertex_count, glm::vec3(0.0f));
+		addFaceNormals(indices, [](Index v){ return v; }, vertices, normals);
+		normalizeNormals(normals, pool);
+	}
+	return true;
+}
+
+template bool PlyMesh::read<unsigned short>(std::vector<unsigned short> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, ThreadPool *) const;
+template bool PlyMesh::read<unsigned int>(std::vector<unsigned int> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, ThreadPool *) const;
+
+template <typename Index>
+bool loadPLY(
+	const char * path,
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	ThreadPool * pool
+){
+	printf("Loading PLY file %s...\n", path);
+	PlyMesh mesh;
+	return mesh.open(path) && mesh.read(indices, vertices, uvs, normals, pool);
+}
+
+template bool loadPLY<unsigned short>(const char *, std::vector<unsigned short> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, ThreadPool *);
+template bool loadPLY<unsigned int>(const char *, std::vector<unsigned int> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, ThreadPool *);
+
+template <typename Index>
+bool savePLY(
+	const char * path,
+	const std::vector<Index> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals
+){
+	FILE * file = fopen(path, "wb");
+	if (file == NULL){
+		printf("Can't write %s\n", path);
+		return false;
+	}
+
+	bool has_uvs = !uvs.empty(), has_normals = !normals.empty();
+	size_t faces = indices.size() / 3;
+	fprintf(file, "ply\nformat binary_little_endian 1.0\nelement vertex %u\n", (unsigned int)vertices.size());
+	fprintf(file, "property float x\nproperty float y\nproperty float z\n");
+	if (has_normals)
+		fprintf(file, "property float nx\nproperty float ny\nproperty float nz\n");
+	if (has_uvs)
+		fprintf(file, "property float s\nproperty float t\n");
+	fprintf(file, "element face %u\nproperty list uchar uint vertex_indices\nend_header\n", (unsigned int)faces);
+
+	// Records are packed a block at a time, one fwrite per block
+	const size_t block = 16384;
+	size_t floats = 3 + (has_normals ? 3 : 0) + (has_uvs ? 2 : 0);
+	std::vector<float> vertex_records(block * floats);
+	for (size_t first = 0; first < vertices.size(); first += block){
+		size_t count = std::min(block, vertices.size() - first);
+		float * out = vertex_records.data();
+		for (size_t i = first; i < first + count; i++){
+			*out++ = vertices[i].x;
+			*out++ = vertices[i].y;
+			*out++ = vertices[i].z;
+			if (has_normals){
+				*out++ = normals[i].x;
+				*out++ = normals[i].y;
+				*out++ = normals[i].z;
+			}
+			if (has_uvs){
+				*out++ = uvs[i].x;
+				*out++ = -uvs[i].y;
+			}
+		}
+		fwrite(vertex_records.data(), sizeof(float) * floats, count, file);
+	}
+
+	std::vector<unsigned char> face_records(block * 13);
+	for (size_t first = 0; first < faces; first += block){
+		size_t count = std::min(block, faces - first);
+		unsigned char * out = face_records.data();
+		for (size_t f = first; f < first + count; f++){
+			unsigned int corners[3] = { (unsigned int)indices[3 * f], (unsigned int)indices[3 * f + 1], (unsigned int)indices[3 * f + 2] };
+			*out++ = 3;
+			memcpy(out, corners, 12);
+			out += 12;
+		}
+		fwrite(face_records.data(), 13, count, file);
+	}
+
+	bool ok = !ferror(file);
+	if (fclose(file) != 0 || !ok){
+		printf("Can't write %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+template bool savePLY<unsigned short>(const char *, const std::vector<unsigned short> &,
+	const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, const std::vector<glm::vec3> &);
+template bool savePLY<unsigned int>(const char *, const std::vector<unsigned int> &,
+	const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, const std::vector<glm::vec3> &);
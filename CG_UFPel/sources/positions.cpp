@@ -0,0 +1,408 @@
+#include <vector>
+#include <atomic>
+#include <math.h>
+#include <stdlib.h>
+
+#include <glm/glm.hpp>
+
+#include "positions.hpp"
+
+// x86 builds get the SIMD kernels. SSE2 is the baseline of x86-64 and of
+// Win32 builds with /arch:SSE2; AVX2 and AVX-512 are compiled for their
+// target only (MSVC takes the intrinsics without flags) and are called
+// after checking the CPU.
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define POSITIONS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+// AVX-512 has fused multiply-adds, which GCC would otherwise form out of the
+// separate multiplies and adds, changing the rounding
+#if defined(__clang__)
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+#endif
+// The AVX-512 headers of GCC 12 trip this on every intrinsic
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define POSITIONS_SSE2
+#endif
+#endif
+
+static const size_t ALIGNMENT = 32;
+
+static float * allocate_aligned(size_t count){
+#ifdef _WIN32
+	return (float *)_aligned_malloc(count * sizeof(float), ALIGNMENT);
+#else
+	void * p = NULL;
+	if (posix_memalign(&p, ALIGNMENT, count * sizeof(float)) != 0)
+		return NULL;
+	return (float *)p;
+#endif
+}
+
+static void free_aligned(float * p){
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+PositionStore::PositionStore()
+	: xs(NULL), ys(NULL), zs(NULL), count(0), capacity(0){
+}
+
+PositionStore::~PositionStore(){
+	free_aligned(xs);
+}
+
+// The three arrays share one allocation, each padded to whole 32 byte lines
+void PositionStore::assign(const std::vector<glm::vec3> & positions){
+	int n = (int)positions.size();
+	if (n > capacity){
+		free_aligned(xs);
+		capacity = (n + 7) & ~7;
+		xs = allocate_aligned(3 * (size_t)capacity);
+		if (xs == NULL){
+			capacity = 0;
+			count = 0;
+			ys = zs = NULL;
+			return;
+		}
+		ys = xs + capacity;
+		zs = ys + capacity;
+	}
+	count = n;
+	for (int i = 0; i < n; i++){
+		xs[i] = positions[i].x;
+		ys[i] = positions[i].y;
+		zs[i] = positions[i].z;
+	}
+	for (int i = n; i < capacity; i++)
+		xs[i] = ys[i] = zs[i] = 0.0f;
+}
+
+void PositionStore::clear(){
+	count = 0;
+}
+
+// ----------------------------------------------------------------------------
+// Dispatch
+
+static SimdLevel detect_level(){
+#ifdef POSITIONS_X86
+	unsigned int regs[4];
+	unsigned int leaf7_ebx = 0, leaf1_ecx = 0, leaf1_edx = 0, max_leaf = 0;
+#if defined(_MSC_VER)
+	int r[4];
+	__cpuid(r, 0);
+	max_leaf = (unsigned int)r[0];
+	__cpuid(r, 1);
+	leaf1_ecx = (unsigned int)r[2];
+	leaf1_edx = (unsigned int)r[3];
+	if (max_leaf >= 7){
+		__cpuidex(r, 7, 0);
+		leaf7_ebx = (unsigned int)r[1];
+	}
+#else
+	max_leaf = __get_cpuid_max(0, NULL);
+	if (__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3])){
+		leaf1_ecx = regs[2];
+		leaf1_edx = regs[3];
+	}
+	if (max_leaf >= 7){
+		__cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+		leaf7_ebx = regs[1];
+	}
+#endif
+	(void)regs;
+
+	bool sse2 = (leaf1_edx & (1u << 26)) != 0;
+	if (!sse2)
+		return SIMD_SCALAR;
+
+	// The OS must save the AVX (and AVX-512) registers on context switches
+	bool osxsave = (leaf1_ecx & (1u << 27)) != 0;
+	bool avx = (leaf1_ecx & (1u << 28)) != 0;
+	if (!osxsave || !avx)
+		return SIMD_SSE2;
+#if defined(_MSC_VER)
+	unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned int xcr0_lo, xcr0_hi;
+	__asm__ __volatile__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	unsigned long long xcr0 = ((unsigned long long)xcr0_hi << 32) | xcr0_lo;
+#endif
+	if ((xcr0 & 0x6) != 0x6 || !(leaf7_ebx & (1u << 5)))
+		return SIMD_SSE2;
+	if ((xcr0 & 0xE6) != 0xE6 || !(leaf7_ebx & (1u << 16)))
+		return SIMD_AVX2;
+	return SIMD_AVX512;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+static SimdLevel detected_level(){
+	static const SimdLevel level = detect_level();
+	return level;
+}
+
+static std::atomic<int> level_cap(SIMD_AVX512);
+
+SimdLevel simdLevel(){
+	SimdLevel level = detected_level();
+	int cap = level_cap.load(std::memory_order_relaxed);
+	return (int)level < cap ? level : (SimdLevel)cap;
+}
+
+const char * simdLevelName(SimdLevel level){
+	switch (level){
+	case SIMD_SSE2: return "SSE2";
+	case SIMD_AVX2: return "AVX2";
+	case SIMD_AVX512: return "AVX-512";
+	default: return "scalar";
+	}
+}
+
+void setSimdLevel(SimdLevel level){
+	level_cap.store((int)level, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------------------------
+// Edge lengths. Each kernel does as many whole registers as it can and
+// returns where it stopped; the scalar loop does the rest.
+
+static void edge_lengths_scalar(const float * x, const float * y, const float * z,
+	const unsigned int * v0, const unsigned int * v1, int begin, int count, float * out){
+	for (int i = begin; i < count; i++){
+		float dx = x[v1[i]] - x[v0[i]];
+		float dy = y[v1[i]] - y[v0[i]];
+		float dz = z[v1[i]] - z[v0[i]];
+		out[i] = sqrtf(dx*dx + dy*dy + dz*dz);
+	}
+}
+
+#ifdef POSITIONS_SSE2
+// No gathers before AVX2 : the lanes are loaded one by one, the arithmetic
+// is done four at a time
+static int edge_lengths_sse2(const float * x, const float * y, const float * z,
+	const unsigned int * v0, const unsigned int * v1, int count, float * out){
+	int i = 0;
+	for (; i + 4 <= count; i += 4){
+		const unsigned int * a = v0 + i;
+		const unsigned int * b = v1 + i;
+		__m128 dx = _mm_sub_ps(_mm_setr_ps(x[b[0]], x[b[1]], x[b[2]], x[b[3]]), _mm_setr_ps(x[a[0]], x[a[1]], x[a[2]], x[a[3]]));
+		__m128 dy = _mm_sub_ps(_mm_setr_ps(y[b[0]], y[b[1]], y[b[2]], y[b[3]]), _mm_setr_ps(y[a[0]], y[a[1]], y[a[2]], y[a[3]]));
+		__m128 dz = _mm_sub_ps(_mm_setr_ps(z[b[0]], z[b[1]], z[b[2]], z[b[3]]), _mm_setr_ps(z[a[0]], z[a[1]], z[a[2]], z[a[3]]));
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		_mm_storeu_ps(out + i, _mm_sqrt_ps(d2));
+	}
+	return i;
+}
+#endif
+
+#ifdef POSITIONS_X86
+TARGET_AVX2 static int edge_lengths_avx2(const float * x, const float * y, const float * z,
+	const unsigned int * v0, const unsigned int * v1, int count, float * out){
+	int i = 0;
+	for (; i + 8 <= count; i += 8){
+		__m256i a = _mm256_loadu_si256((const __m256i *)(v0 + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(v1 + i));
+		__m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(x, b, 4), _mm256_i32gather_ps(x, a, 4));
+		__m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(y, b, 4), _mm256_i32gather_ps(y, a, 4));
+		__m256 dz = _mm256_sub_ps(_mm256_i32gather_ps(z, b, 4), _mm256_i32gather_ps(z, a, 4));
+		__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+		_mm256_storeu_ps(out + i, _mm256_sqrt_ps(d2));
+	}
+	return i;
+}
+
+TARGET_AVX512 static int edge_lengths_avx512(const float * x, const float * y, const float * z,
+	const unsigned int * v0, const unsigned int * v1, int count, float * out){
+	int i = 0;
+	for (; i + 16 <= count; i += 16){
+		__m512i a = _mm512_loadu_si512((const void *)(v0 + i));
+		__m512i b = _mm512_loadu_si512((const void *)(v1 + i));
+		__m512 dx = _mm512_sub_ps(_mm512_i32gather_ps(b, x, 4), _mm512_i32gather_ps(a, x, 4));
+		__m512 dy = _mm512_sub_ps(_mm512_i32gather_ps(b, y, 4), _mm512_i32gather_ps(a, y, 4));
+		__m512 dz = _mm512_sub_ps(_mm512_i32gather_ps(b, z, 4), _mm512_i32gather_ps(a, z, 4));
+		__m512 d2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+		_mm512_storeu_ps(out + i, _mm512_sqrt_ps(d2));
+	}
+	return i;
+}
+#endif
+
+void edgeLengths(const PositionStore & positions, const unsigned int * v0, const unsigned int * v1, int count, float * out){
+	const float * x = positions.x();
+	const float * y = positions.y();
+	const float * z = positions.z();
+	int done = 0;
+	switch (simdLevel()){
+#ifdef POSITIONS_X86
+	case SIMD_AVX512:
+		done = edge_lengths_avx512(x, y, z, v0, v1, count, out);
+		break;
+	case SIMD_AVX2:
+		done = edge_lengths_avx2(x, y, z, v0, v1, count, out);
+		break;
+#endif
+#ifdef POSITIONS_SSE2
+	case SIMD_SSE2:
+		done = edge_lengths_sse2(x, y, z, v0, v1, count, out);
+		break;
+#endif
+	default:
+		break;
+	}
+	edge_lengths_scalar(x, y, z, v0, v1, done, count, out);
+}
+
+// ----------------------------------------------------------------------------
+// Quadric errors. The terms are the ones of quadricError, summed in the same
+// order in double precision : the doubled coefficients are doubled as floats
+// first, as 2*m[k] is there. Coefficients are gathered across quadrics, one
+// lane per quadric, twelve floats apart.
+
+static void quadric_errors_scalar(const Quadric * quadrics, const float * x, const float * y, const float * z,
+	int begin, int count, float * out){
+	for (int i = begin; i < count; i++)
+		out[i] = quadricError(quadrics[i], glm::vec3(x[i], y[i], z[i]));
+}
+
+#ifdef POSITIONS_SSE2
+static inline __m128d coefficient_sse2(const Quadric * q, int k){
+	return _mm_setr_pd(q[0].m[k], q[1].m[k]);
+}
+
+static inline __m128d doubled_sse2(const Quadric * q, int k){
+	return _mm_setr_pd(q[0].m[k] + q[0].m[k], q[1].m[k] + q[1].m[k]);
+}
+
+static int quadric_errors_sse2(const Quadric * quadrics, const float * x, const float * y, const float * z,
+	int count, float * out){
+	int i = 0;
+	for (; i + 2 <= count; i += 2){
+		const Quadric * q = quadrics + i;
+		__m128d px = _mm_setr_pd(x[i], x[i + 1]);
+		__m128d py = _mm_setr_pd(y[i], y[i + 1]);
+		__m128d pz = _mm_setr_pd(z[i], z[i + 1]);
+		__m128d e = _mm_mul_pd(_mm_mul_pd(coefficient_sse2(q, 0), px), px);
+		e = _mm_add_pd(e, _mm_mul_pd(_mm_mul_pd(doubled_sse2(q, 1), px), py));
+		e = _mm_add_pd(e, _mm_mul_pd(_mm_mul_pd(doubled_sse2(q, 2), px), pz));
+		e = _mm_add_pd(e, _mm_mul_pd(doubled_sse2(q, 3), px));
+		e = _mm_add_pd(e, _mm_mul_pd(_mm_mul_pd(coefficient_sse2(q, 4), py), py));
+		e = _mm_add_pd(e, _mm_mul_pd(_mm_mul_pd(doubled_sse2(q, 5), py), pz));
+		e = _mm_add_pd(e, _mm_mul_pd(doubled_sse2(q, 6), py));
+		e = _mm_add_pd(e, _mm_mul_pd(_mm_mul_pd(coefficient_sse2(q, 7), pz), pz));
+		e = _mm_add_pd(e, _mm_mul_pd(doubled_sse2(q, 8), pz));
+		e = _mm_add_pd(e, coefficient_sse2(q, 9));
+
+		// max returns its second operand for NaN, like the e > 0 test
+		__m128 f = _mm_cvtpd_ps(_mm_max_pd(e, _mm_setzero_pd()));
+		out[i] = _mm_cvtss_f32(f);
+		out[i + 1] = _mm_cvtss_f32(_mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 1, 1, 1)));
+	}
+	return i;
+}
+#endif
+
+#ifdef POSITIONS_X86
+TARGET_AVX2 static inline __m128 gather_coefficients_avx2(const Quadric * q, int k){
+	return _mm_i32gather_ps(q->m + k, _mm_setr_epi32(0, 12, 24, 36), 4);
+}
+
+TARGET_AVX2 static int quadric_errors_avx2(const Quadric * quadrics, const float * x, const float * y, const float * z,
+	int count, float * out){
+	int i = 0;
+	for (; i + 4 <= count; i += 4){
+		const Quadric * q = quadrics + i;
+		__m256d c[10];
+		for (int k = 0; k < 10; k++){
+			__m128 m = gather_coefficients_avx2(q, k);
+			bool doubled = k == 1 || k == 2 || k == 3 || k == 5 || k == 6 || k == 8;
+			c[k] = _mm256_cvtps_pd(doubled ? _mm_add_ps(m, m) : m);
+		}
+		__m256d px = _mm256_cvtps_pd(_mm_loadu_ps(x + i));
+		__m256d py = _mm256_cvtps_pd(_mm_loadu_ps(y + i));
+		__m256d pz = _mm256_cvtps_pd(_mm_loadu_ps(z + i));
+		__m256d e = _mm256_mul_pd(_mm256_mul_pd(c[0], px), px);
+		e = _mm256_add_pd(e, _mm256_mul_pd(_mm256_mul_pd(c[1], px), py));
+		e = _mm256_add_pd(e, _mm256_mul_pd(_mm256_mul_pd(c[2], px), pz));
+		e = _mm256_add_pd(e, _mm256_mul_pd(c[3], px));
+		e = _mm256_add_pd(e, _mm256_mul_pd(_mm256_mul_pd(c[4], py), py));
+		e = _mm256_add_pd(e, _mm256_mul_pd(_mm256_mul_pd(c[5], py), pz));
+		e = _mm256_add_pd(e, _mm256_mul_pd(c[6], py));
+		e = _mm256_add_pd(e, _mm256_mul_pd(_mm256_mul_pd(c[7], pz), pz));
+		e = _mm256_add_pd(e, _mm256_mul_pd(c[8], pz));
+		e = _mm256_add_pd(e, c[9]);
+		_mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_max_pd(e, _mm256_setzero_pd())));
+	}
+	return i;
+}
+
+TARGET_AVX512 static inline __m256 gather_coefficients_avx512(const Quadric * q, int k){
+	return _mm256_i32gather_ps(q->m + k, _mm256_setr_epi32(0, 12, 24, 36, 48, 60, 72, 84), 4);
+}
+
+TARGET_AVX512 static int quadric_errors_avx512(const Quadric * quadrics, const float * x, const float * y, const float * z,
+	int count, float * out){
+	int i = 0;
+	for (; i + 8 <= count; i += 8){
+		const Quadric * q = quadrics + i;
+		__m512d c[10];
+		for (int k = 0; k < 10; k++){
+			__m256 m = gather_coefficients_avx512(q, k);
+			bool doubled = k == 1 || k == 2 || k == 3 || k == 5 || k == 6 || k == 8;
+			c[k] = _mm512_cvtps_pd(doubled ? _mm256_add_ps(m, m) : m);
+		}
+		__m512d px = _mm512_cvtps_pd(_mm256_loadu_ps(x + i));
+		__m512d py = _mm512_cvtps_pd(_mm256_loadu_ps(y + i));
+		__m512d pz = _mm512_cvtps_pd(_mm256_loadu_ps(z + i));
+		__m512d e = _mm512_mul_pd(_mm512_mul_pd(c[0], px), px);
+		e = _mm512_add_pd(e, _mm512_mul_pd(_mm512_mul_pd(c[1], px), py));
+		e = _mm512_add_pd(e, _mm512_mul_pd(_mm512_mul_pd(c[2], px), pz));
+		e = _mm512_add_pd(e, _mm512_mul_pd(c[3], px));
+		e = _mm512_add_pd(e, _mm512_mul_pd(_mm512_mul_pd(c[4], py), py));
+		e = _mm512_add_pd(e, _mm512_mul_pd(_mm512_mul_pd(c[5], py), pz));
+		e = _mm512_add_pd(e, _mm512_mul_pd(c[6], py));
+		e = _mm512_add_pd(e, _mm512_mul_pd(_mm512_mul_pd(c[7], pz), pz));
+		e = _mm512_add_pd(e, _mm512_mul_pd(c[8], pz));
+		e = _mm512_add_pd(e, c[9]);
+		_mm256_storeu_ps(out + i, _mm512_cvtpd_ps(_mm512_max_pd(e, _mm512_setzero_pd())));
+	}
+	return i;
+}
+#endif
+
+void quadricErrors(const Quadric * quadrics, const float * x, const float * y, const float * z, int count, float * out){
+	int done = 0;
+	switch (simdLevel()){
+#ifdef POSITIONS_X86
+	case SIMD_AVX512:
+		done = quadric_errors_avx512(quadrics, x, y, z, count, out);
+		break;
+	case SIMD_AVX2:
+		done = quadric_errors_avx2(quadrics, x, y, z, count, out);
+		break;
+#endif
+#ifdef POSITIONS_SSE2
+	case SIMD_SSE2:
+		done = quadric_errors_sse2(quadrics, x, y, z, count, out);
+		break;
+#endif
+	default:
+		break;
+	}
+	quadric_errors_scalar(quadrics, x, y, z, done, count, out);
+}
@@ -0,0 +1,406 @@
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <limits.h>
+
+#include <glm/glm.hpp>
+
+#include "halfedge.hpp"
+#include "collapse.hpp"
+#include "progressive.hpp"
+
+// File layout, little-endian :
+//   "PMSH", version, flags, base vertex count, base face count, split count
+//   base positions, uvs and normals (when flagged), base indices as uint32
+//   per split : v0, its 2 faces (6 x uint32), the new vertex (position, uv,
+//   normal), v0 before the collapse (same), renamed corner count, corners
+static const char PM_MAGIC[4] = { 'P', 'M', 'S', 'H' };
+static const unsigned int PM_VERSION = 1;
+enum { PM_HAS_UVS = 1, PM_HAS_NORMALS = 2 };
+
+ProgressiveMesh::ProgressiveMesh() : stream(NULL){
+	clear();
+}
+
+ProgressiveMesh::~ProgressiveMesh(){
+	clear();
+}
+
+void ProgressiveMesh::clear(){
+	if (stream)
+		fclose(stream);
+	stream = NULL;
+	base_vertices = 0;
+	base_faces = 0;
+	total_splits = 0;
+	current = 0;
+	has_uvs = false;
+	has_normals = false;
+	index_buffer.clear();
+	positions.clear();
+	texcoords.clear();
+	vertex_normals.clear();
+	splits.clear();
+	renamed_corners.clear();
+	std::vector<unsigned int>().swap(refined_indices);
+}
+
+template <typename Index>
+bool ProgressiveMesh::build(
+	const std::vector<Index> & in_indices,
+	const std::vector<glm::vec3> & in_vertices,
+	const std::vector<glm::vec2> & in_uvs,
+	const std::vector<glm::vec3> & in_normals,
+	CollapseCost cost,
+	int min_triangles
+){
+	clear();
+	has_uvs = !in_uvs.empty();
+	has_normals = !in_normals.empty();
+	if ((has_uvs && in_uvs.size() != in_vertices.size()) || (has_normals && in_normals.size() != in_vertices.size())){
+		printf("ProgressiveMesh : attributes don't match the %d vertices\n", (int)in_vertices.size());
+		return false;
+	}
+
+	// Run the whole collapse sequence on a copy
+	std::vector<glm::vec3> work_vertices = in_vertices;
+	std::vector<glm::vec2> work_uvs = in_uvs;
+	std::vector<glm::vec3> work_normals = in_normals;
+	HalfEdgeMesh mesh;
+	mesh.build(in_indices, (unsigned int)in_vertices.size());
+	CollapseEngine engine(mesh, work_vertices, cost);
+	engine.setAttributes(has_uvs ? &work_uvs : NULL, has_normals ? &work_normals : NULL);
+	engine.init();
+	while (mesh.liveFaceCount() > min_triangles && engine.step())
+		;
+
+	// Renumber in refinement order : what is left first, then the vertex and
+	// faces each split brings back, starting from the last collapse.
+	int n = engine.undoCount();
+	std::vector<int> vertex_id(in_vertices.size(), -1);
+	std::vector<int> face_id(mesh.faceCount(), -1);
+	for (unsigned int v = 0; v < mesh.vertexCount(); v++)
+		if (!mesh.isVertexRemoved(v))
+			vertex_id[v] = base_vertices++;
+	for (int f = 0; f < mesh.faceCount(); f++)
+		if (!mesh.isFaceRemoved(f))
+			face_id[f] = base_faces++;
+	for (int i = n - 1; i >= 0; i--){
+		const CollapseRecord & r = engine.historyEntry(i).mesh;
+		int j = n - 1 - i;
+		vertex_id[r.v1] = base_vertices + j;
+		face_id[HalfEdgeMesh::face(r.h)] = base_faces + 2 * j;
+		face_id[HalfEdgeMesh::face(r.t)] = base_faces + 2 * j + 1;
+	}
+	total_splits = n;
+
+	int nb_vertices = base_vertices + n;
+	positions.resize(nb_vertices);
+	if (has_uvs)
+		texcoords.resize(nb_vertices);
+	if (has_normals)
+		vertex_normals.resize(nb_vertices);
+	for (size_t v = 0; v < vertex_id.size(); v++){
+		if (vertex_id[v] < 0)
+			continue;
+		positions[vertex_id[v]] = work_vertices[v];
+		if (has_uvs)
+			texcoords[vertex_id[v]] = work_uvs[v];
+		if (has_normals)
+			vertex_normals[vertex_id[v]] = work_normals[v];
+	}
+
+	index_buffer.resize(3 * (base_faces + 2 * n));
+	for (int f = 0; f < mesh.faceCount(); f++)
+		if (!mesh.isFaceRemoved(f))
+			for (int k = 0; k < 3; k++)
+				index_buffer[3*face_id[f]+k] = (unsigned int)vertex_id[mesh.origin(3*f+k)];
+
+	splits.resize(n);
+	for (int i = 0; i < n; i++){
+		const CollapseEngine::HistoryEntry & entry = engine.historyEntry(i);
+		const CollapseRecord & r = entry.mesh;
+		VertexSplit & split = splits[n - 1 - i];
+		split.v0 = vertex_id[r.v0];
+		split.position = entry.position[0];
+		split.uv = entry.uv;
+		split.normal = entry.normal;
+
+		// The two faces as they were before the collapse : (v0, v1, a) and (v1, v0, b)
+		int f0 = HalfEdgeMesh::face(r.h), f1 = HalfEdgeMesh::face(r.t);
+		index_buffer[3*face_id[f0] + r.h % 3] = (unsigned int)vertex_id[r.v0];
+		index_buffer[3*face_id[f0] + HalfEdgeMesh::next(r.h) % 3] = (unsigned int)vertex_id[r.v1];
+		index_buffer[3*face_id[f0] + HalfEdgeMesh::prev(r.h) % 3] = (unsigned int)vertex_id[r.a];
+		index_buffer[3*face_id[f1] + r.t % 3] = (unsigned int)vertex_id[r.v1];
+		index_buffer[3*face_id[f1] + HalfEdgeMesh::next(r.t) % 3] = (unsigned int)vertex_id[r.v0];
+		index_buffer[3*face_id[f1] + HalfEdgeMesh::prev(r.t) % 3] = (unsigned int)vertex_id[r.b];
+
+		split.renamed_first = (unsigned int)renamed_corners.size();
+		for (int k = 0; k < r.renamed_count; k++){
+			int f = HalfEdgeMesh::face(r.renamed[k]);
+			if (f != f0 && f != f1)
+				renamed_corners.push_back(3 * face_id[f] + r.renamed[k] % 3);
+		}
+		split.renamed_count = (unsigned int)renamed_corners.size() - split.renamed_first;
+	}
+
+	current = 0;
+	return true;
+}
+
+template bool ProgressiveMesh::build<unsigned short>(const std::vector<unsigned short> &, const std::vector<glm::vec3> &,
+	const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, CollapseCost, int);
+template bool ProgressiveMesh::build<unsigned int>(const std::vector<unsigned int> &, const std::vector<glm::vec3> &,
+	const std::vector<glm::vec2> &, const std::vector<glm::vec3> &, CollapseCost, int);
+
+static void write_u32(FILE * file, unsigned int value){
+	fwrite(&value, 4, 1, file);
+}
+
+bool ProgressiveMesh::save(const char * path){
+	FILE * file = fopen(path, "wb");
+	if (!file){
+		printf("%s could not be opened for writing\n", path);
+		return false;
+	}
+
+	// At level 0 every face is stored as its split brings it back
+	int level = current;
+	setLevel(0);
+
+	fwrite(PM_MAGIC, 1, 4, file);
+	write_u32(file, PM_VERSION);
+	write_u32(file, (has_uvs ? PM_HAS_UVS : 0) | (has_normals ? PM_HAS_NORMALS : 0));
+	write_u32(file, base_vertices);
+	write_u32(file, base_faces);
+	write_u32(file, (unsigned int)splits.size());
+
+	fwrite(positions.data(), sizeof(glm::vec3), base_vertices, file);
+	if (has_uvs)
+		fwrite(texcoords.data(), sizeof(glm::vec2), base_vertices, file);
+	if (has_normals)
+		fwrite(vertex_normals.data(), sizeof(glm::vec3), base_vertices, file);
+	fwrite(index_buffer.data(), 4, 3 * base_faces, file);
+
+	for (size_t i = 0; i < splits.size(); i++){
+		const VertexSplit & split = splits[i];
+		unsigned int v1 = base_vertices + (unsigned int)i;
+		write_u32(file, split.v0);
+
+		fwrite(&index_buffer[3 * (base_faces + 2 * i)], 4, 6, file);
+
+		fwrite(&positions[v1], sizeof(glm::vec3), 1, file);
+		if (has_uvs)
+			fwrite(&texcoords[v1], sizeof(glm::vec2), 1, file);
+		if (has_normals)
+			fwrite(&vertex_normals[v1], sizeof(glm::vec3), 1, file);
+
+		fwrite(&split.position, sizeof(glm::vec3), 1, file);
+		if (has_uvs)
+			fwrite(&split.uv, sizeof(glm::vec2), 1, file);
+		if (has_normals)
+			fwrite(&split.normal, sizeof(glm::vec3), 1, file);
+
+		write_u32(file, split.renamed_count);
+		if (split.renamed_count > 0)
+			fwrite(&renamed_corners[split.renamed_first], 4, split.renamed_count, file);
+	}
+
+	bool ok = ferror(file) == 0;
+	if (fclose(file) != 0)
+		ok = false;
+	setLevel(level);
+	if (!ok)
+		printf("%s could not be written\n", path);
+	return ok;
+}
+
+static bool read_u32(FILE * file, unsigned int & value){
+	return fread(&value, 4, 1, file) == 1;
+}
+
+bool ProgressiveMesh::open(const char * path){
+	clear();
+
+	FILE * file = fopen(path, "rb");
+	if (!file){
+		printf("%s could not be opened\n", path);
+		return false;
+	}
+
+	char magic[4];
+	unsigned int version, flags, nb_vertices, nb_faces, nb_splits;
+	if (fread(magic, 1, 4, file) != 4 || memcmp(magic, PM_MAGIC, 4) != 0
+		|| !read_u32(file, version) || version != PM_VERSION
+		|| !read_u32(file, flags) || !read_u32(file, nb_vertices)
+		|| !read_u32(file, nb_faces) || !read_u32(file, nb_splits)){
+		printf("%s is not a progressive mesh file\n", path);
+		fclose(file);
+		return false;
+	}
+
+	has_uvs = (flags & PM_HAS_UVS) != 0;
+	has_normals = (flags & PM_HAS_NORMALS) != 0;
+
+	// The counts must fit in what is left of the file before anything is
+	// allocated for them. Splits are counted without their renamed corners.
+	long header_end = ftell(file);
+	fseek(file, 0, SEEK_END);
+	unsigned long long left = (unsigned long long)(ftell(file) - header_end);
+	fseek(file, header_end, SEEK_SET);
+	unsigned long long vertex_bytes = 12 + (has_uvs ? 8 : 0) + (has_normals ? 12 : 0);
+	unsigned long long split_bytes = 4 + 24 + 2 * vertex_bytes + 4;
+	bool ok = vertex_bytes * nb_vertices + 12ull * nb_faces + split_bytes * nb_splits <= left
+		&& (unsigned long long)nb_vertices + nb_splits <= INT_MAX
+		&& 3ull * ((unsigned long long)nb_faces + 2ull * nb_splits) <= INT_MAX;
+
+	if (ok){
+		base_vertices = nb_vertices;
+		base_faces = nb_faces;
+		total_splits = nb_splits;
+		positions.resize(nb_vertices);
+		if (has_uvs)
+			texcoords.resize(nb_vertices);
+		if (has_normals)
+			vertex_normals.resize(nb_vertices);
+		index_buffer.resize(3 * nb_faces);
+
+		ok = fread(positions.data(), sizeof(glm::vec3), nb_vertices, file) == nb_vertices;
+	}
+	if (ok && has_uvs)
+		ok = fread(texcoords.data(), sizeof(glm::vec2), nb_vertices, file) == nb_vertices;
+	if (ok && has_normals)
+		ok = fread(vertex_normals.data(), sizeof(glm::vec3), nb_vertices, file) == nb_vertices;
+	if (ok)
+		ok = fread(index_buffer.data(), 4, index_buffer.size(), file) == index_buffer.size();
+	for (size_t i = 0; i < index_buffer.size() && ok; i++)
+		ok = index_buffer[i] < nb_vertices;
+	if (!ok){
+		printf("%s is truncated or corrupt\n", path);
+		fclose(file);
+		clear();
+		return false;
+	}
+
+	stream = file;
+	refined_indices = index_buffer;
+	if (total_splits == 0){
+		fclose(stream);
+		stream = NULL;
+		std::vector<unsigned int>().swap(refined_indices);
+	}
+	return true;
+}
+
+int ProgressiveMesh::readSplits(int count){
+	int read = 0;
+	while (stream && read < count && (int)splits.size() < total_splits){
+		// Split i may use the vertices and faces that exist once it is applied
+		unsigned int i = (unsigned int)splits.size();
+		unsigned int nb_vertices = base_vertices + i + 1;
+		unsigned int nb_corners = 3 * (base_faces + 2 * i);
+
+		VertexSplit split;
+		unsigned int faces[6], nb_renamed;
+		glm::vec3 position, normal(0.0f);
+		glm::vec2 uv(0.0f);
+		split.uv = glm::vec2(0.0f);
+		split.normal = glm::vec3(0.0f);
+		split.renamed_first = (unsigned int)renamed_corners.size();
+		split.renamed_count = 0;
+
+		bool ok = read_u32(stream, split.v0) && fread(faces, 4, 6, stream) == 6
+			&& fread(&position, sizeof(glm::vec3), 1, stream) == 1
+			&& (!has_uvs || fread(&uv, sizeof(glm::vec2), 1, stream) == 1)
+			&& (!has_normals || fread(&normal, sizeof(glm::vec3), 1, stream) == 1)
+			&& fread(&split.position, sizeof(glm::vec3), 1, stream) == 1
+			&& (!has_uvs || fread(&split.uv, sizeof(glm::vec2), 1, stream) == 1)
+			&& (!has_normals || fread(&split.normal, sizeof(glm::vec3), 1, stream) == 1)
+			&& read_u32(stream, nb_renamed)
+			&& split.v0 < nb_vertices - 1 && nb_renamed <= nb_corners;
+		for (int k = 0; k < 6 && ok; k++)
+			ok = faces[k] < nb_vertices;
+		if (ok){
+			split.renamed_count = nb_renamed;
+			renamed_corners.resize(split.renamed_first + nb_renamed);
+			ok = nb_renamed == 0 || fread(&renamed_corners[split.renamed_first], 4, nb_renamed, stream) == nb_renamed;
+		}
+		// The corners a split renames must hold v0 until it is applied,
+		// otherwise coarsen() would not give back the level before it
+		for (unsigned int k = 0; k < nb_renamed && ok; k++){
+			unsigned int corner = renamed_corners[split.renamed_first + k];
+			ok = corner < nb_corners && refined_indices[corner] == split.v0;
+		}
+		if (!ok){
+			printf("Progressive mesh file is truncated or corrupt after %d splits\n", (int)i);
+			clear();
+			return -1;
+		}
+
+		positions.push_back(position);
+		if (has_uvs)
+			texcoords.push_back(uv);
+		if (has_normals)
+			vertex_normals.push_back(normal);
+		index_buffer.insert(index_buffer.end(), faces, faces + 6);
+		for (unsigned int k = 0; k < nb_renamed; k++)
+			refined_indices[renamed_corners[split.renamed_first + k]] = nb_vertices - 1;
+		refined_indices.insert(refined_indices.end(), faces, faces + 6);
+		splits.push_back(split);
+		read++;
+	}
+
+	if (stream && (int)splits.size() >= total_splits){
+		fclose(stream);
+		stream = NULL;
+		std::vector<unsigned int>().swap(refined_indices);
+	}
+	return read;
+}
+
+bool ProgressiveMesh::load(const char * path){
+	return open(path) && readSplits(total_splits) >= 0;
+}
+
+// Applies split current : the new vertex takes over its corners and v0 goes
+// back to where it was before the collapse.
+void ProgressiveMesh::refine(){
+	VertexSplit & split = splits[current];
+	unsigned int v1 = base_vertices + current;
+	for (unsigned int i = 0; i < split.renamed_count; i++)
+		index_buffer[renamed_corners[split.renamed_first + i]] = v1;
+
+	split.coarse_position = positions[split.v0];
+	positions[split.v0] = split.position;
+	if (has_uvs){
+		split.coarse_uv = texcoords[split.v0];
+		texcoords[split.v0] = split.uv;
+	}
+	if (has_normals){
+		split.coarse_normal = vertex_normals[split.v0];
+		vertex_normals[split.v0] = split.normal;
+	}
+	current++;
+}
+
+void ProgressiveMesh::coarsen(){
+	current--;
+	VertexSplit & split = splits[current];
+	for (unsigned int i = 0; i < split.renamed_count; i++)
+		index_buffer[renamed_corners[split.renamed_first + i]] = split.v0;
+
+	positions[split.v0] = split.coarse_position;
+	if (has_uvs)
+		texcoords[split.v0] = split.coarse_uv;
+	if (has_normals)
+		vertex_normals[split.v0] = split.coarse_normal;
+}
+
+void ProgressiveMesh::setLevel(int level){
+	level = std::max(0, std::min(level, levelCount()));
+	while (current < level)
+		refine();
+	while (current > level)
+		coarsen();
+}
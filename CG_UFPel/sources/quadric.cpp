@@ -0,0 +1,136 @@
+#include <vector>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "quadric.hpp"
+
+// SSE2 is part of every x86-64 target and of Win32 builds with /arch:SSE2 or better
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUADRIC_SSE
+#include <emmintrin.h>
+#endif
+
+void quadricZero(Quadric & q){
+	for (int i = 0; i < 12; i++)
+		q.m[i] = 0.0f;
+}
+
+void quadricAdd(Quadric & q, const Quadric & other){
+#ifdef QUADRIC_SSE
+	_mm_storeu_ps(q.m + 0, _mm_add_ps(_mm_loadu_ps(q.m + 0), _mm_loadu_ps(other.m + 0)));
+	_mm_storeu_ps(q.m + 4, _mm_add_ps(_mm_loadu_ps(q.m + 4), _mm_loadu_ps(other.m + 4)));
+	_mm_storeu_ps(q.m + 8, _mm_add_ps(_mm_loadu_ps(q.m + 8), _mm_loadu_ps(other.m + 8)));
+#else
+	for (int i = 0; i < 10; i++)
+		q.m[i] += other.m[i];
+#endif
+}
+
+// Adds w * p p^T for the plane p = (a, b, c, d) to count quadrics, usually
+// the three corners of a face
+static void accumulate_plane(const float plane[4], float w, Quadric * const * qs, int count){
+#ifdef QUADRIC_SSE
+	__m128 p = _mm_loadu_ps(plane);
+	__m128 s = _mm_set1_ps(w);
+	__m128 keep_low = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, 0, 0));
+
+	// [a a a a]*[a b c d], [b b b c]*[b c d c], [c d - -]*[d d - -]
+	__m128 r0 = _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)), p), s);
+	__m128 r1 = _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 1, 1, 1)),
+	                                  _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 2, 1))), s);
+	__m128 r2 = _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 2)),
+	                                  _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3))), s);
+	r2 = _mm_and_ps(r2, keep_low);
+
+	for (int k = 0; k < count; k++){
+		float * m = qs[k]->m;
+		_mm_storeu_ps(m + 0, _mm_add_ps(_mm_loadu_ps(m + 0), r0));
+		_mm_storeu_ps(m + 4, _mm_add_ps(_mm_loadu_ps(m + 4), r1));
+		_mm_storeu_ps(m + 8, _mm_add_ps(_mm_loadu_ps(m + 8), r2));
+	}
+#else
+	float a = plane[0], b = plane[1], c = plane[2], d = plane[3];
+	float r[10] = { a*a, a*b, a*c, a*d, b*b, b*c, b*d, c*c, c*d, d*d };
+	for (int k = 0; k < count; k++)
+		for (int i = 0; i < 10; i++)
+			qs[k]->m[i] += r[i] * w;
+#endif
+}
+
+float quadricError(const Quadric & q, const glm::vec3 & p){
+	const float * m = q.m;
+	double x = p.x, y = p.y, z = p.z;
+	double e = m[0]*x*x + 2*m[1]*x*y + 2*m[2]*x*z + 2*m[3]*x
+	         + m[4]*y*y + 2*m[5]*y*z + 2*m[6]*y
+	         + m[7]*z*z + 2*m[8]*z
+	         + m[9];
+	return e > 0.0 ? (float)e : 0.0f;
+}
+
+bool quadricOptimum(const Quadric & q, glm::vec3 & out){
+	const float * m = q.m;
+
+	// Solve A x = -b with Cramer's rule, A being the upper 3x3 block
+	double a00 = m[0], a01 = m[1], a02 = m[2];
+	double a11 = m[4], a12 = m[5], a22 = m[7];
+	double b0 = -m[3], b1 = -m[6], b2 = -m[8];
+
+	double c00 = a11*a22 - a12*a12;
+	double c01 = a02*a12 - a01*a22;
+	double c02 = a01*a12 - a02*a11;
+	double det = a00*c00 + a01*c01 + a02*c02;
+
+	double scale = fabs(a00) + fabs(a11) + fabs(a22);
+	if (fabs(det) <= 1e-9 * scale * scale * scale || scale == 0.0)
+		return false;
+
+	double c11 = a00*a22 - a02*a02;
+	double c12 = a01*a02 - a00*a12;
+	double c22 = a00*a11 - a01*a01;
+
+	out.x = (float)((c00*b0 + c01*b1 + c02*b2) / det);
+	out.y = (float)((c01*b0 + c11*b1 + c12*b2) / det);
+	out.z = (float)((c02*b0 + c12*b1 + c22*b2) / det);
+	return true;
+}
+
+void computeVertexQuadrics(
+	const HalfEdgeMesh & mesh,
+	const std::vector<glm::vec3> & vertices,
+	std::vector<Quadric> & quadrics
+){
+	quadrics.resize(vertices.size());
+	for (size_t v = 0; v < quadrics.size(); v++)
+		quadricZero(quadrics[v]);
+
+	for (int f = 0; f < mesh.faceCount(); f++){
+		if (mesh.isFaceRemoved(f))
+			continue;
+
+		unsigned int i0 = mesh.origin(3*f), i1 = mesh.origin(3*f+1), i2 = mesh.origin(3*f+2);
+		const glm::vec3 & p0 = vertices[i0];
+		glm::vec3 n = glm::cross(vertices[i1] - p0, vertices[i2] - p0);
+		float len = glm::length(n);
+		if (len == 0.0f)
+			continue;
+
+		// |n| is twice the area : weighting by area keeps big faces important
+		n = n / len;
+		float plane[4] = { n.x, n.y, n.z, -glm::dot(n, p0) };
+		Quadric * corners[3] = { &quadrics[i0], &quadrics[i1], &quadrics[i2] };
+		accumulate_plane(plane, 0.5f * len, corners, 3);
+	}
+}
+
+void quadricAddTriangle(Quadric & q, const glm::vec3 & p0, const glm::vec3 & p1, const glm::vec3 & p2){
+	glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+	float len = glm::length(n);
+	if (len == 0.0f)
+		return;
+
+	n = n / len;
+	float plane[4] = { n.x, n.y, n.z, -glm::dot(n, p0) };
+	Quadric * target = &q;
+	accumulate_plane(plane, 0.5f * len, &target, 1);
+}
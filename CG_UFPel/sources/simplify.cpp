@@ -0,0 +1,114 @@
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+
+#include "halfedge.hpp"
+#include "collapse.hpp"
+#include "compact.hpp"
+#include "weld.hpp"
+#include "simplify.hpp"
+
+SimplifyOptions::SimplifyOptions()
+	: cost(COLLAPSE_QUADRIC), target_triangles(0), target_ratio(0.0f), max_error(-1.0f), pool(NULL), weld_epsilon(-1.0f){
+}
+
+template <typename Index>
+bool simplifyMesh(
+	std::vector<Index> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	const SimplifyOptions & options,
+	SimplifyStats * stats
+){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if ((!uvs.empty() && uvs.size() != vertices.size()) || (!normals.empty() && normals.size() != vertices.size())){
+		printf("simplifyMesh : attributes don't match the %d vertices\n", (int)vertices.size());
+		return false;
+	}
+
+	// Collapses run either on the vertices themselves, or on their welded
+	// positions with remap going from attribute vertex to welded vertex
+	bool weld = options.weld_epsilon >= 0.0f;
+	std::vector<unsigned int> remap;
+	std::vector<glm::vec3> welded;
+	HalfEdgeMesh mesh;
+	if (weld){
+		weldPositions(vertices, options.weld_epsilon, remap, welded);
+		std::vector<unsigned int> welded_indices(indices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+			welded_indices[i] = remap[indices[i]];
+		mesh.build(welded_indices, (unsigned int)welded.size());
+	}else{
+		mesh.build(indices, (unsigned int)vertices.size());
+	}
+
+	CollapseEngine engine(mesh, weld ? welded : vertices, options.cost);
+	if (!weld)
+		engine.setAttributes(uvs.empty() ? NULL : &uvs, normals.empty() ? NULL : &normals);
+	engine.init(options.pool);
+
+	int before = mesh.liveFaceCount();
+	int vertices_before = (int)vertices.size();
+	int target = 0;
+	if (options.target_triangles > 0)
+		target = options.target_triangles;
+	if (options.target_ratio > 0.0f)
+		target = std::max(target, (int)(before * options.target_ratio));
+	float max_cost = options.max_error >= 0.0f ? options.max_error : FLT_MAX;
+
+	// Every collapse removes exactly two triangles
+	int collapses = 0;
+	if (options.pool){
+		while (mesh.liveFaceCount() > target){
+			int n = engine.stepParallel(*options.pool, (mesh.liveFaceCount() - target + 1) / 2, max_cost);
+			if (n == 0)
+				break;
+			collapses += n;
+		}
+	}else{
+		while (mesh.liveFaceCount() > target && engine.step(max_cost))
+			collapses++;
+	}
+
+	if (weld){
+		// Collapses rename a welded vertex everywhere at once, so all the live
+		// corners of an attribute vertex agree on where it ended up
+		for (int f = 0; f < mesh.faceCount(); f++){
+			if (mesh.isFaceRemoved(f)){
+				indices[3*f+1] = indices[3*f+2] = indices[3*f];
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+				vertices[indices[3*f+k]] = welded[mesh.origin(3*f+k)];
+		}
+	}else{
+		mesh.writeIndices(indices);
+	}
+	compactMesh(indices, vertices, uvs, normals, options.pool);
+
+	if (stats){
+		stats->triangles_before = before;
+		stats->triangles_after = mesh.liveFaceCount();
+		stats->vertices_before = vertices_before;
+		stats->vertices_after = (int)vertices.size();
+		stats->topology_vertices = (int)mesh.vertexCount();
+		stats->collapses = collapses;
+		stats->edges_evaluated = engine.edgesEvaluated();
+		stats->max_error = engine.maxCollapsedCost();
+		stats->undo_blocks = (int)engine.undoArena().systemAllocations();
+		stats->undo_records = (int)engine.undoArena().allocations();
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return true;
+}
+
+template bool simplifyMesh<unsigned short>(std::vector<unsigned short> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &, const SimplifyOptions &, SimplifyStats *);
+template bool simplifyMesh<unsigned int>(std::vector<unsigned int> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec2> &, std::vector<glm::vec3> &, const SimplifyOptions &, SimplifyStats *);
@@ -0,0 +1,97 @@
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(unsigned int threads) : stopping(false){
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int i = 1; i < threads; i++)
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+// Runs one queued task on the calling thread, if there is one
+bool ThreadPool::runOne(){
+	std::function<void()> task;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (tasks.empty())
+			return false;
+		task = tasks.front();
+		tasks.pop_front();
+	}
+	task();
+	return true;
+}
+
+void ThreadPool::workerLoop(){
+	while (true){
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this]{ return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return;
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int, int)> & fn, int grain){
+	if (count <= 0)
+		return;
+	grain = std::max(1, grain);
+
+	// A few chunks per thread so uneven chunks even out. Rounding the count
+	// down keeps every chunk at least grain long.
+	int chunks = std::min(count / grain, (int)size() * 4);
+	if (workers.empty() || chunks <= 1){
+		fn(0, count);
+		return;
+	}
+
+	std::atomic<int> remaining(chunks);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (int c = 0; c < chunks; c++){
+			int begin = (int)((long long)count * c / chunks);
+			int end = (int)((long long)count * (c + 1) / chunks);
+			tasks.push_back([&fn, &remaining, begin, end]{
+				fn(begin, end);
+				remaining--;
+			});
+		}
+	}
+	wake.notify_all();
+
+	// Help out instead of sleeping; this also keeps nested loops from deadlocking
+	while (remaining > 0){
+		if (!runOne())
+			std::this_thread::yield();
+	}
+}
+
+void parallelFor(ThreadPool * pool, int count, const std::function<void(int, int)> & fn, int grain){
+	if (pool)
+		pool->parallelFor(count, fn, grain);
+	else if (count > 0)
+		fn(0, count);
+}
@@ -4,8 +4,11 @@
 #include <glm/glm.hpp>
 
 #include "vboindexer.hpp"
+#include "indextype.hpp"
 
 #include <string.h> // for memcmp
+#include <stdio.h>
+#include <math.h>
 
 
 // Returns true iif v1 can be considered equal to v2
@@ -23,7 +26,7 @@ bool getSimilarVertexIndex(
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
-	unsigned short & result
+	unsigned int & result
 ){
 	// Lame linear search
 	for ( unsigned int i=0; i<out_vertices.size(); i++ ){
@@ -51,7 +54,7 @@ void indexVBO_slow(
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<unsigned int> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
@@ -60,7 +63,7 @@ void indexVBO_slow(
 	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
 
 		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
+		unsigned int index;
 		bool found = getSimilarVertexIndex(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
 
 		if ( found ){ // A similar vertex is already in the VBO, use it instead !
@@ -69,7 +72,7 @@ void indexVBO_slow(
 			out_vertices.push_back( in_vertices[i]);
 			out_uvs     .push_back( in_uvs[i]);
 			out_normals .push_back( in_normals[i]);
-			out_indices .push_back( (unsigned short)out_vertices.size() - 1 );
+			out_indices .push_back( (unsigned int)out_vertices.size() - 1 );
 		}
 	}
 }
@@ -85,10 +88,10 @@ struct PackedVertex{
 
 bool getSimilarVertexIndex_fast( 
 	PackedVertex & packed, 
-	std::map<PackedVertex,unsigned short> & VertexToOutIndex,
-	unsigned short & result
+	std::map<PackedVertex,unsigned int> & VertexToOutIndex,
+	unsigned int & result
 ){
-	std::map<PackedVertex,unsigned short>::iterator it = VertexToOutIndex.find(packed);
+	std::map<PackedVertex,unsigned int>::iterator it = VertexToOutIndex.find(packed);
 	if ( it == VertexToOutIndex.end() ){
 		return false;
 	}else{
@@ -97,17 +100,18 @@ bool getSimilarVertexIndex_fast(
 	}
 }
 
-void indexVBO(
+template <typename Index>
+bool indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<Index> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 ){
-	std::map<PackedVertex,unsigned short> VertexToOutIndex;
+	std::map<PackedVertex,unsigned int> VertexToOutIndex;
 
 	// For each input vertex
 	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
@@ -116,20 +120,25 @@ void indexVBO(
 		
 
 		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
+		unsigned int index;
 		bool found = getSimilarVertexIndex_fast( packed, VertexToOutIndex, index);
 
 		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
+			out_indices.push_back( (Index)index );
 		}else{ // If not, it needs to be added in the output data.
+			if ( !indexFits<Index>(out_vertices.size() + 1) ){
+				printf("indexVBO : more than %u unique vertices, use wider indices\n", (unsigned int)out_vertices.size());
+				return false;
+			}
 			out_vertices.push_back( in_vertices[i]);
 			out_uvs     .push_back( in_uvs[i]);
 			out_normals .push_back( in_normals[i]);
-			unsigned short newindex = (unsigned short)out_vertices.size() - 1;
-			out_indices .push_back( newindex );
+			unsigned int newindex = (unsigned int)out_vertices.size() - 1;
+			out_indices .push_back( (Index)newindex );
 			VertexToOutIndex[ packed ] = newindex;
 		}
 	}
+	return true;
 }
 
 
@@ -138,14 +147,15 @@ void indexVBO(
 
 
 
-void indexVBO_TBN(
+template <typename Index>
+bool indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<Index> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
@@ -156,22 +166,41 @@ void indexVBO_TBN(
 	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
 
 		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
+		unsigned int index;
 		bool found = getSimilarVertexIndex(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
 
 		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
+			out_indices.push_back( (Index)index );
 
 			// Average the tangents and the bitangents
 			out_tangents[index] += in_tangents[i];
 			out_bitangents[index] += in_bitangents[i];
 		}else{ // If not, it needs to be added in the output data.
+			if ( !indexFits<Index>(out_vertices.size() + 1) ){
+				printf("indexVBO_TBN : more than %u unique vertices, use wider indices\n", (unsigned int)out_vertices.size());
+				return false;
+			}
 			out_vertices.push_back( in_vertices[i]);
 			out_uvs     .push_back( in_uvs[i]);
 			out_normals .push_back( in_normals[i]);
 			out_tangents .push_back( in_tangents[i]);
 			out_bitangents .push_back( in_bitangents[i]);
-			out_indices .push_back( (unsigned short)out_vertices.size() - 1 );
+			out_indices .push_back( (Index)(out_vertices.size() - 1) );
 		}
 	}
+	return true;
 }
+
+// The two index widths in use
+template bool indexVBO<unsigned short>(std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<unsigned short> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template bool indexVBO<unsigned int>(std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<unsigned int> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template bool indexVBO_TBN<unsigned short>(std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec3> &,
+	std::vector<unsigned short> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec3> &);
+template bool indexVBO_TBN<unsigned int>(std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec3> &,
+	std::vector<unsigned int> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec3> &);
@@ -0,0 +1,96 @@
+#include <vector>
+#include <unordered_map>
+#include <math.h>
+#include <string.h>
+
+#include <glm/glm.hpp>
+
+#include "weld.hpp"
+
+// Grid cell along one axis. Computed in double and clamped, so a coordinate
+// far larger than epsilon (or not finite) can't overflow the integer.
+static long long cell_coord(float value, float inv){
+	double c = floor((double)value * inv);
+	const double limit = 4611686018427387904.0;  // 2^62, room for the +-1 neighbours
+	if (!(c > -limit))
+		return c < 0.0 ? -(long long)limit : 0;  // NaN lands in cell 0
+	return c < limit ? (long long)c : (long long)limit;
+}
+
+// Grid cell of a coordinate, wrapped to 21 bits so three fit in a key
+static unsigned long long cell_key(long long x, long long y, long long z){
+	const unsigned long long mask = (1ull << 21) - 1;
+	return (((unsigned long long)x & mask) << 42) | (((unsigned long long)y & mask) << 21) | ((unsigned long long)z & mask);
+}
+
+// Hash of the exact bits of a position, for epsilon = 0
+static unsigned long long bits_key(const glm::vec3 & p){
+	glm::vec3 q = p + glm::vec3(0.0f);  // -0 and +0 are the same position
+	unsigned int b[3];
+	memcpy(b, &q[0], sizeof(b));
+	unsigned long long h = 14695981039346656037ull;
+	for (int k = 0; k < 3; k++){
+		h ^= b[k];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+unsigned int weldPositions(
+	const std::vector<glm::vec3> & vertices,
+	float epsilon,
+	std::vector<unsigned int> & remap,
+	std::vector<glm::vec3> & welded
+){
+	remap.resize(vertices.size());
+	welded.clear();
+
+	// Each cell holds a chain of the welded vertices that landed in it
+	std::unordered_map<unsigned long long, int> cells;
+	cells.reserve(vertices.size());
+	std::vector<int> next;
+	float eps2 = epsilon * epsilon;
+	float inv = epsilon > 0.0f ? 1.0f / epsilon : 0.0f;
+
+	for (size_t i = 0; i < vertices.size(); i++){
+		const glm::vec3 & p = vertices[i];
+		int found = -1;
+		unsigned long long own;
+
+		if (epsilon > 0.0f){
+			// A match within epsilon is at most one cell away on each axis
+			long long cx = cell_coord(p.x, inv), cy = cell_coord(p.y, inv), cz = cell_coord(p.z, inv);
+			own = cell_key(cx, cy, cz);
+			for (long long dx = -1; dx <= 1; dx++)
+			for (long long dy = -1; dy <= 1; dy++)
+			for (long long dz = -1; dz <= 1; dz++){
+				std::unordered_map<unsigned long long, int>::const_iterator it = cells.find(cell_key(cx + dx, cy + dy, cz + dz));
+				if (it == cells.end())
+					continue;
+				for (int w = it->second; w >= 0; w = next[w]){
+					glm::vec3 d = welded[w] - p;
+					if (glm::dot(d, d) <= eps2 && (found < 0 || w < found))
+						found = w;
+				}
+			}
+		}else{
+			own = bits_key(p);
+			std::unordered_map<unsigned long long, int>::const_iterator it = cells.find(own);
+			if (it != cells.end())
+				for (int w = it->second; w >= 0 && found < 0; w = next[w])
+					if (welded[w] == p)
+						found = w;
+		}
+
+		if (found < 0){
+			found = (int)welded.size();
+			welded.push_back(p);
+			std::pair<std::unordered_map<unsigned long long, int>::iterator, bool> ins = cells.insert(std::make_pair(own, found));
+			next.push_back(ins.second ? -1 : ins.first->second);
+			ins.first->second = found;
+		}
+		remap[i] = (unsigned int)found;
+	}
+
+	return (unsigned int)welded.size();
+}
@@ -0,0 +1,586 @@
+// Headless batch decimation of OBJ and binary PLY files, for running over an
+// asset library as a build step. Needs no window or GL context : it only
+// links the mesh loaders and the simplifier. Build it with the Makefile
+// next to CG_UFPel.sln.
+//
+//   batchsimplify [options] <file.obj | file.ply | directory>...
+//
+// Directories are scanned (not recursively) for .obj and .ply files. Every
+// file is simplified once per target and written as <name>.<target>.obj or
+// .ply, in the format of the input unless -f says otherwise. With several
+// targets, each file instead goes down through all of them in a single run
+// and is written as one LOD set, <name>.lods, unless -w asks for welding,
+// which only the per-target runs do. Files are
+// processed concurrently on a thread pool, and a table of per-file timings
+// is printed at the end. With -P each file is also written as a progressive
+// mesh, <name>.pm, that streams from its base mesh up to the full one. With
+// -d, every output is measured against its input (mean, RMS and Hausdorff
+// distance) and the errors are printed next to its timings. With
+// -g, OBJ files are instead clustered on a grid as they are read, without
+// being loaded, for scans too large to fit in memory.
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "objloader.hpp"
+#include "plyfile.hpp"
+#include "simplify.hpp"
+#include "distance.hpp"
+#include "lodchain.hpp"
+#include "progressive.hpp"
+#include "outofcore.hpp"
+#include "threadpool.hpp"
+
+// One output per target : either a fraction of the input triangles or a
+// triangle count
+struct Target{
+	float ratio;
+	int triangles;
+	std::string tag;   // goes in the output name
+};
+
+struct TargetResult{
+	bool ok;
+	int triangles_after;
+	int vertices_after;
+	double simplify_ms;
+	double write_ms;
+	int undo_blocks;           // allocations of the undo log, -1 when the run has none of its own
+	int undo_records;
+	bool measured;
+	SurfaceDistance distance;  // -d : from the input to the output and back
+};
+
+struct FileResult{
+	bool ok;
+	const char * error;
+	long long triangles_before;
+	long long vertices_before;
+	double load_ms;         // loading and indexing
+	int lods_vertices;      // shared vertices of the .lods written for several targets
+	double lods_ms;         // building and writing the .lods
+	size_t heap_bytes;      // -g : peak memory of the clustering, without the mapped positions
+	std::vector<TargetResult> targets;
+	bool progressive_ok;
+	int progressive_splits;
+	double progressive_ms;  // building and writing the .pm
+	double total_ms;
+};
+
+struct BatchOptions{
+	std::vector<Target> targets;
+	SimplifyOptions simplify;
+	bool parallel_collapses;  // also batch the collapses of each file on the pool
+	bool progressive;         // also write a progressive mesh of each file
+	int grid_resolution;      // above 0, cluster each OBJ out of core instead of loading it
+	int distance_samples;     // above 0, measure each output against its input with this many samples per side
+	std::string output_dir;   // empty writes next to the input
+	std::string format;       // "obj" or "ply", empty writes each output like its input
+	unsigned int threads;
+
+	BatchOptions() : parallel_collapses(false), progressive(false), grid_resolution(0), distance_samples(0), threads(0){}
+};
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// "obj" or "ply" from the extension of name, empty for anything else
+static std::string mesh_format(const std::string & name){
+	if (name.size() < 4 || name[name.size() - 4] != '.')
+		return "";
+	std::string ext = name.substr(name.size() - 3);
+	for (size_t i = 0; i < ext.size(); i++)
+		ext[i] = (char)tolower(ext[i]);
+	return ext == "obj" || ext == "ply" ? ext : "";
+}
+
+// Appends the mesh files of path, or path itself if it is not a directory
+static bool collect_inputs(const std::string & path, std::vector<std::string> & files){
+	std::vector<std::string> found;
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES)
+		return false;
+	if (!(attributes & FILE_ATTRIBUTE_DIRECTORY)){
+		files.push_back(path);
+		return true;
+	}
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((path + "\\*").c_str(), &entry);
+	if (find != INVALID_HANDLE_VALUE){
+		do{
+			if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && !mesh_format(entry.cFileName).empty())
+				found.push_back(path + "\\" + entry.cFileName);
+		}while (FindNextFileA(find, &entry));
+		FindClose(find);
+	}
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return false;
+	if (!S_ISDIR(info.st_mode)){
+		files.push_back(path);
+		return true;
+	}
+	DIR * dir = opendir(path.c_str());
+	if (dir == NULL)
+		return false;
+	while (struct dirent * entry = readdir(dir)){
+		std::string name = path + "/" + entry->d_name;
+		if (!mesh_format(entry->d_name).empty() && stat(name.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+			found.push_back(name);
+	}
+	closedir(dir);
+#endif
+	std::sort(found.begin(), found.end());
+	files.insert(files.end(), found.begin(), found.end());
+	return true;
+}
+
+// Creates the output directory if needed, not its parents
+static bool make_directory(const std::string & path){
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	if (attributes != INVALID_FILE_ATTRIBUTES)
+		return (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+	return _mkdir(path.c_str()) == 0;
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) == 0)
+		return S_ISDIR(info.st_mode);
+	return mkdir(path.c_str(), 0755) == 0;
+#endif
+}
+
+// <output dir or input dir>/<input name without extension>.<tag>.<format>,
+// without .<tag> when tag is empty
+static std::string output_path(const std::string & input, const std::string & output_dir, const std::string & tag, const std::string & format){
+	size_t slash = input.find_last_of("/\\");
+	std::string dir = slash == std::string::npos ? "" : input.substr(0, slash + 1);
+	std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+	if (!mesh_format(name).empty())
+		name.resize(name.size() - 4);
+	if (!output_dir.empty())
+		dir = output_dir + "/";
+	return dir + name + (tag.empty() ? "" : "." + tag) + "." + format;
+}
+
+// -d : compares an output to its input on the pool
+static void measure_target(const BatchOptions & options, ThreadPool & pool,
+	const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices,
+	const std::vector<unsigned int> & out_indices, const std::vector<glm::vec3> & out_vertices, TargetResult & out){
+	out.measured = out.ok && options.distance_samples > 0;
+	if (out.measured)
+		out.distance = measureSurfaceDistance(indices, vertices, out_indices, out_vertices, options.distance_samples, &pool);
+}
+
+// Several targets : cuts them all from one LodChain and writes it as
+// <name>.lods, then reads the file back, so the counts printed and the
+// distances measured are those of what was written. Targets resolve as in
+// simplifyMesh(), the higher of the count and the ratio of the
+// non-degenerate input triangles
+static void chain_file(const std::string & path, const BatchOptions & options, ThreadPool & pool,
+	const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs, const std::vector<glm::vec3> & normals, FileResult & result){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int before = 0;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		if (indices[i] != indices[i + 1] && indices[i + 1] != indices[i + 2] && indices[i] != indices[i + 2])
+			before++;
+
+	// The chain sorts its levels from the finest, level[t] is where target t lands
+	std::vector<int> counts(options.targets.size());
+	std::vector<int> order(options.targets.size());
+	for (size_t t = 0; t < options.targets.size(); t++){
+		const Target & target = options.targets[t];
+		counts[t] = std::max(target.triangles, (int)(before * target.ratio));
+		order[t] = (int)t;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b){ return counts[a] > counts[b]; });
+	std::vector<int> level(options.targets.size());
+	for (size_t i = 0; i < order.size(); i++)
+		level[order[i]] = (int)i + 1;
+
+	LodChain chain, written;
+	std::string name = output_path(path, options.output_dir, "", "lods");
+	bool ok = chain.build(indices, vertices, uvs, normals, counts, options.simplify.cost,
+		options.parallel_collapses ? &pool : NULL, options.simplify.max_error) && chain.save(name.c_str())
+		&& written.load(name.c_str()) && written.levelCount() == chain.levelCount()
+		&& written.indices() == chain.indices() && written.vertices() == chain.vertices();
+	chain = LodChain();  // only the copy read back is used from here
+	result.lods_vertices = (int)written.vertices().size();
+	result.lods_ms = milliseconds_since(start);
+
+	result.targets.resize(options.targets.size());
+	std::vector<unsigned int> level_indices;
+	for (size_t t = 0; t < options.targets.size(); t++){
+		TargetResult & out = result.targets[t];
+		out.ok = ok;
+		out.triangles_after = ok ? written.triangleCount(level[t]) : 0;
+		out.vertices_after = 0;
+		out.undo_blocks = out.undo_records = -1;
+		out.simplify_ms = 0.0;
+		out.write_ms = 0.0;
+		if (ok && options.distance_samples > 0){
+			const unsigned int * first = written.indices().data() + written.firstIndex(level[t]);
+			level_indices.assign(first, first + written.indexCount(level[t]));
+		}
+		measure_target(options, pool, indices, vertices, level_indices, written.vertices(), out);
+	}
+	result.ok = ok;
+}
+
+// -g : clusters an OBJ with simplifyOutOfCore() as it is read, spilling its
+// positions to a temporary file next to the output, and writes the result
+// as the single target
+static void cluster_file(const std::string & path, const BatchOptions & options, ThreadPool & pool, FileResult & result){
+	if (mesh_format(path) != "obj"){
+		result.error = "-g only reads OBJ files";
+		return;
+	}
+
+	OutOfCoreOptions cluster;
+	cluster.grid_resolution = options.grid_resolution;
+	cluster.pool = &pool;
+	std::string spill = output_path(path, options.output_dir, "positions", "tmp");
+	cluster.spill_path = spill.c_str();
+
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices, normals;
+	std::vector<glm::vec2> uvs;
+	OutOfCoreStats stats;
+	result.targets.resize(1);
+	TargetResult & out = result.targets[0];
+	out.ok = simplifyOutOfCore(path.c_str(), cluster, indices, vertices, &stats);
+	out.simplify_ms = out.ok ? stats.seconds * 1000.0 : 0.0;
+	out.triangles_after = (int)indices.size() / 3;
+	out.vertices_after = (int)vertices.size();
+	out.write_ms = 0.0;
+	out.undo_blocks = out.undo_records = -1;
+	out.measured = false;
+	if (out.ok){
+		result.triangles_before = stats.triangles_before;
+		result.vertices_before = stats.vertices_before;
+		result.heap_bytes = stats.peak_bytes;
+
+		std::chrono::steady_clock::time_point write_start = std::chrono::steady_clock::now();
+		std::string format = !options.format.empty() ? options.format : "obj";
+		std::string name = output_path(path, options.output_dir, options.targets[0].tag, format);
+		if (format == "ply")
+			out.ok = savePLY(name.c_str(), indices, vertices, uvs, normals);
+		else
+			out.ok = saveOBJ(name.c_str(), indices, vertices, uvs, normals, &pool);
+		out.write_ms = milliseconds_since(write_start);
+	}
+	result.ok = out.ok;
+	if (!result.ok)
+		result.error = "clustering or output failed";
+}
+
+static void process_file(const std::string & path, const BatchOptions & options, ThreadPool & pool, FileResult & result){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	result.ok = false;
+	result.error = NULL;
+	result.triangles_before = 0;
+	result.vertices_before = 0;
+	result.load_ms = 0.0;
+	result.lods_vertices = 0;
+	result.lods_ms = 0.0;
+	result.heap_bytes = 0;
+	result.progressive_ok = false;
+	result.progressive_splits = 0;
+	result.progressive_ms = 0.0;
+	result.total_ms = 0.0;
+
+	// loadOBJ waits for a key when it can't open the file, so that case is
+	// caught here first
+	FILE * probe = fopen(path.c_str(), "r");
+	if (probe == NULL){
+		result.error = "can't open";
+		return;
+	}
+	fclose(probe);
+
+	if (options.grid_resolution > 0){
+		cluster_file(path, options, pool, result);
+		result.total_ms = milliseconds_since(start);
+		return;
+	}
+
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> indexed_vertices, indexed_normals;
+	std::vector<glm::vec2> indexed_uvs;
+	bool ply = mesh_format(path) == "ply";
+	bool loaded = ply ? loadPLY(path.c_str(), indices, indexed_vertices, indexed_uvs, indexed_normals, &pool)
+		: loadOBJIndexed(path.c_str(), indices, indexed_vertices, indexed_uvs, indexed_normals, &pool);
+	if (!loaded){
+		result.error = "can't parse";
+		return;
+	}
+	result.load_ms = milliseconds_since(start);
+	result.triangles_before = (int)indices.size() / 3;
+	result.vertices_before = (int)indexed_vertices.size();
+
+	SimplifyOptions simplify = options.simplify;
+	simplify.pool = options.parallel_collapses ? &pool : NULL;
+
+	// Several targets are cut from one run, unless welding asks for one run each
+	if (options.targets.size() > 1 && options.simplify.weld_epsilon < 0.0f)
+		chain_file(path, options, pool, indices, indexed_vertices, indexed_uvs, indexed_normals, result);
+	else{
+		result.ok = true;
+		result.targets.resize(options.targets.size());
+		for (size_t t = 0; t < options.targets.size(); t++){
+			const Target & target = options.targets[t];
+			TargetResult & out = result.targets[t];
+			simplify.target_ratio = target.ratio;
+			simplify.target_triangles = target.triangles;
+
+			std::vector<unsigned int> lod_indices = indices;
+			std::vector<glm::vec3> lod_vertices = indexed_vertices, lod_normals = indexed_normals;
+			std::vector<glm::vec2> lod_uvs = indexed_uvs;
+			SimplifyStats stats;
+			out.ok = simplifyMesh(lod_indices, lod_vertices, lod_uvs, lod_normals, simplify, &stats);
+			out.simplify_ms = stats.seconds * 1000.0;
+			out.triangles_after = (int)lod_indices.size() / 3;
+			out.vertices_after = (int)lod_vertices.size();
+			out.undo_blocks = stats.undo_blocks;
+			out.undo_records = stats.undo_records;
+
+			std::chrono::steady_clock::time_point write_start = std::chrono::steady_clock::now();
+			std::string format = !options.format.empty() ? options.format : ply ? "ply" : "obj";
+			std::string name = output_path(path, options.output_dir, target.tag, format);
+			if (out.ok && format == "ply")
+				out.ok = savePLY(name.c_str(), lod_indices, lod_vertices, lod_uvs, lod_normals);
+			else if (out.ok)
+				out.ok = saveOBJ(name.c_str(), lod_indices, lod_vertices, lod_uvs, lod_normals, &pool);
+			out.write_ms = milliseconds_since(write_start);
+			measure_target(options, pool, indices, indexed_vertices, lod_indices, lod_vertices, out);
+			result.ok = result.ok && out.ok;
+		}
+	}
+	if (options.progressive){
+		std::chrono::steady_clock::time_point progressive_start = std::chrono::steady_clock::now();
+		ProgressiveMesh progressive;
+		std::string name = output_path(path, options.output_dir, "", "pm");
+		result.progressive_ok = progressive.build(indices, indexed_vertices, indexed_uvs, indexed_normals, options.simplify.cost)
+			&& progressive.save(name.c_str());
+		result.progressive_splits = progressive.splitCount();
+		result.progressive_ms = milliseconds_since(progressive_start);
+		result.ok = result.ok && result.progressive_ok;
+	}
+	if (!result.ok)
+		result.error = "simplification or output failed";
+	result.total_ms = milliseconds_since(start);
+}
+
+// "0.5,0.25" as ratios or "1000,200" as triangle counts into targets
+static bool parse_targets(const char * list, bool ratios, std::vector<Target> & targets){
+	const char * p = list;
+	while (*p){
+		char * end;
+		double value = strtod(p, &end);
+		if (end == p || (*end != ',' && *end != '\0'))
+			return false;
+		Target target;
+		char tag[32];
+		if (ratios){
+			if (value <= 0.0 || value > 1.0)
+				return false;
+			target.ratio = (float)value;
+			target.triangles = 0;
+			snprintf(tag, sizeof(tag), "r%g", value * 100.0);
+		}else{
+			if (value < 1.0)
+				return false;
+			target.ratio = 0.0f;
+			target.triangles = (int)value;
+			snprintf(tag, sizeof(tag), "t%d", target.triangles);
+		}
+		target.tag = tag;
+		targets.push_back(target);
+		p = *end ? end + 1 : end;
+	}
+	return true;
+}
+
+static void usage(){
+	printf(
+		"Usage : batchsimplify [options] <file.obj | file.ply | directory>...\n"
+		"  -r ratios     keep these fractions of the triangles, comma separated (default 0.5)\n"
+		"  -t counts     keep this many triangles, comma separated\n"
+		"                several targets are cut in one run and written as <name>.lods\n"
+		"  -e error      never collapse an edge costing more than this\n"
+		"  -c cost       quadric (default) or length\n"
+		"  -w epsilon    weld positions closer than this, so uv and normal seams can collapse\n"
+		"                (each target is then simplified and written on its own)\n"
+		"  -o dir        write the outputs there instead of next to each input\n"
+		"  -f format     obj or ply (binary), instead of the format of each input (single target)\n"
+		"  -j threads    size of the thread pool, 0 for one per hardware thread (default)\n"
+		"  -p            also collapse independent edges of each file in parallel batches\n"
+		"  -P            also write each file as a progressive mesh, <name>.pm\n"
+		"  -d samples    measure every output against its input with this many samples per\n"
+		"                side, and print the mean, RMS and Hausdorff distances\n"
+		"  -g cells      cluster OBJ files on a grid with this many cells along the longest\n"
+		"                side as they are read, without loading them (replaces -r, -t, -P and -d)\n"
+	);
+}
+
+int main(int argc, char * argv[]){
+	BatchOptions options;
+	std::vector<std::string> inputs;
+
+	for (int i = 1; i < argc; i++){
+		const char * arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (strcmp(arg, "-r") == 0 && has_value){
+			if (!parse_targets(argv[++i], true, options.targets)){
+				printf("Bad ratios %s\n", argv[i]);
+				return 2;
+			}
+		}else if (strcmp(arg, "-t") == 0 && has_value){
+			if (!parse_targets(argv[++i], false, options.targets)){
+				printf("Bad triangle counts %s\n", argv[i]);
+				return 2;
+			}
+		}else if (strcmp(arg, "-e") == 0 && has_value){
+			options.simplify.max_error = (float)atof(argv[++i]);
+		}else if (strcmp(arg, "-c") == 0 && has_value){
+			const char * cost = argv[++i];
+			if (strcmp(cost, "quadric") == 0)
+				options.simplify.cost = COLLAPSE_QUADRIC;
+			else if (strcmp(cost, "length") == 0)
+				options.simplify.cost = COLLAPSE_EDGE_LENGTH;
+			else{
+				printf("Unknown cost %s\n", cost);
+				return 2;
+			}
+		}else if (strcmp(arg, "-w") == 0 && has_value){
+			options.simplify.weld_epsilon = (float)atof(argv[++i]);
+		}else if (strcmp(arg, "-o") == 0 && has_value){
+			options.output_dir = argv[++i];
+		}else if (strcmp(arg, "-f") == 0 && has_value){
+			options.format = argv[++i];
+			if (options.format != "obj" && options.format != "ply"){
+				printf("Unknown format %s\n", argv[i]);
+				return 2;
+			}
+		}else if (strcmp(arg, "-j") == 0 && has_value){
+			options.threads = (unsigned int)atoi(argv[++i]);
+		}else if (strcmp(arg, "-p") == 0){
+			options.parallel_collapses = true;
+		}else if (strcmp(arg, "-P") == 0){
+			options.progressive = true;
+		}else if (strcmp(arg, "-d") == 0 && has_value){
+			options.distance_samples = atoi(argv[++i]);
+			if (options.distance_samples < 1){
+				printf("Bad sample count %s\n", argv[i]);
+				return 2;
+			}
+		}else if (strcmp(arg, "-g") == 0 && has_value){
+			options.grid_resolution = atoi(argv[++i]);
+			if (options.grid_resolution < 1){
+				printf("Bad grid resolution %s\n", argv[i]);
+				return 2;
+			}
+		}else if (arg[0] == '-'){
+			usage();
+			return 2;
+		}else if (!collect_inputs(arg, inputs)){
+			printf("Can't find %s\n", arg);
+			return 2;
+		}
+	}
+	if (inputs.empty()){
+		usage();
+		return 2;
+	}
+	if (options.grid_resolution > 0){
+		if (!options.targets.empty() || options.progressive || options.distance_samples > 0){
+			printf("-g can't be combined with -r, -t, -P or -d\n");
+			return 2;
+		}
+		Target target;
+		target.ratio = 0.0f;
+		target.triangles = 0;
+		target.tag = "g" + std::to_string(options.grid_resolution);
+		options.targets.push_back(target);
+	}
+	if (options.targets.empty())
+		parse_targets("0.5", true, options.targets);
+	if (!options.output_dir.empty() && !make_directory(options.output_dir)){
+		printf("Can't create %s\n", options.output_dir.c_str());
+		return 2;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ThreadPool pool(options.threads);
+	std::vector<FileResult> results(inputs.size());
+	pool.parallelFor((int)inputs.size(), [&](int begin, int end){
+		for (int i = begin; i < end; i++)
+			process_file(inputs[i], options, pool, results[i]);
+	}, 1);
+	double wall_ms = milliseconds_since(start);
+
+	printf("\n%-32s %10s %10s  per target : triangles after, simplify ms, write ms, undo blocks/records%s\n", "file", "triangles", "load ms",
+		options.distance_samples > 0 ? ", [mean RMS Hausdorff]" : "");
+	int failed = 0;
+	double busy_ms = 0.0;
+	for (size_t i = 0; i < inputs.size(); i++){
+		const FileResult & r = results[i];
+		busy_ms += r.total_ms;
+		if (r.error && r.targets.empty()){
+			printf("%-32s %s\n", inputs[i].c_str(), r.error);
+			failed++;
+			continue;
+		}
+		printf("%-32s %10lld %10.1f ", inputs[i].c_str(), r.triangles_before, r.load_ms);
+		for (size_t t = 0; t < r.targets.size(); t++){
+			const TargetResult & tr = r.targets[t];
+			if (tr.ok && r.lods_ms > 0.0)
+				printf(" %s: %d", options.targets[t].tag.c_str(), tr.triangles_after);
+			else if (tr.ok)
+				printf(" %s: %d %.1f %.1f", options.targets[t].tag.c_str(), tr.triangles_after, tr.simplify_ms, tr.write_ms);
+			if (tr.ok && tr.undo_blocks >= 0)
+				printf(" %d/%d", tr.undo_blocks, tr.undo_records);
+			if (tr.ok && tr.measured){
+				// The worse of both directions
+				const SurfaceDistance & d = tr.distance;
+				printf(" [%.3g %.3g %.3g]", std::max(d.forward.mean, d.backward.mean), std::max(d.forward.rms, d.backward.rms), d.hausdorff);
+			}else if (!tr.ok)
+				printf(" %s: failed", options.targets[t].tag.c_str());
+		}
+		if (r.lods_ms > 0.0 && r.ok)
+			printf(" lods: %d vertices %.1f", r.lods_vertices, r.lods_ms);
+		if (options.grid_resolution > 0 && r.ok)
+			printf(" heap %.1f MB", r.heap_bytes / 1048576.0);
+		if (options.progressive && r.progressive_ok)
+			printf(" pm: %d splits %.1f", r.progressive_splits, r.progressive_ms);
+		else if (options.progressive)
+			printf(" pm: failed");
+		printf("\n");
+		if (!r.ok)
+			failed++;
+	}
+	printf("%d files, %d failed, %.1f ms on %u threads (%.1f ms of work)\n",
+		(int)inputs.size(), failed, wall_ms, pool.size(), busy_ms);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,521 @@
+// Times the mesh pipeline on the bundled models and on generated spheres,
+// tori and terrains of growing size, and writes the results as JSON. Given
+// the JSON of an earlier run it also reports what got slower, so changes in
+// complexity show up as numbers. Build it with the Makefile next to
+// CG_UFPel.sln.
+//
+//   benchmark [options]
+//
+// Every operation is repeated until it has run for about a quarter of a
+// second (at least once, at most 10 times) and its best time is kept, with
+// the time per input triangle so sizes can be compared. An operation that
+// takes more than 10 seconds isn't run again on larger meshes of the same
+// kind (indexVBO_TBN is quadratic).
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glm/glm.hpp>
+
+#include "objloader.hpp"
+#include "vboindexer.hpp"
+#include "tangentspace.hpp"
+#include "halfedge.hpp"
+#include "collapse.hpp"
+#include "simplify.hpp"
+#include "cluster.hpp"
+#include "meshgen.hpp"
+#include "positions.hpp"
+#include "threadpool.hpp"
+
+struct BenchOptions{
+	std::vector<int> sizes;        // triangle counts of the generated meshes
+	std::string mesh_dir;          // bundled models, empty to skip them
+	std::string output;            // JSON results
+	std::string baseline;          // JSON of an earlier run, empty for none
+	std::string scratch;           // where generated meshes are written for loadOBJ()
+	int max_load_triangles;        // generated meshes above this aren't written and loaded
+	double min_seconds;
+	int max_repeats;
+	double skip_seconds;           // an operation slower than this isn't run on larger meshes of the same kind
+	double threshold;              // relative slowdown reported as a regression
+
+	BenchOptions()
+		: mesh_dir("mesh"), output("benchmark.json"), scratch("benchmark_mesh.obj"), max_load_triangles(1000000),
+		  min_seconds(0.25), max_repeats(10), skip_seconds(10.0), threshold(0.10){
+		int defaults[] = { 1000, 10000, 100000, 1000000 };
+		sizes.assign(defaults, defaults + 4);
+	}
+};
+
+struct Result{
+	std::string mesh;     // model name, or generator name
+	int size;             // requested triangles of a generated mesh, 0 for a model
+	int triangles;        // actual input triangles
+	int vertices;         // after indexing
+	std::string op;
+	int repeats;
+	double best_ms;
+	double median_ms;
+	int undo_blocks;      // simplify rows : system allocations of the undo log, -1 for the others
+	int undo_records;     // simplify rows : records taken from those blocks
+};
+
+// Runs setup (untimed) then run (timed) until min_seconds have been spent
+// in run or max_repeats are done. Returns false if run fails.
+static bool measure(const BenchOptions & options, const std::function<void()> & setup, const std::function<bool()> & run,
+	int & repeats, double & best_ms, double & median_ms){
+	std::vector<double> times;
+	double total = 0.0;
+	while ((int)times.size() < options.max_repeats && (times.empty() || total < options.min_seconds)){
+		setup();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool ok = run();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!ok)
+			return false;
+		times.push_back(seconds * 1000.0);
+		total += seconds;
+	}
+	std::sort(times.begin(), times.end());
+	repeats = (int)times.size();
+	best_ms = times[0];
+	median_ms = times[times.size() / 2];
+	return true;
+}
+
+// The mesh one benchmark case runs on : its corners as loadOBJ() returns
+// them, generated or else filled by loading obj_path
+struct Case{
+	std::string mesh;
+	int size;
+	std::string obj_path;  // timed with loadOBJ() if not empty
+	std::vector<glm::vec3> corner_vertices, corner_normals;
+	std::vector<glm::vec2> corner_uvs;
+};
+
+class Bench{
+public:
+	Bench(const BenchOptions & options) : options(options){}
+
+	void run(Case & c){
+		current = &c;
+		triangles = 0;
+		vertex_count = 0;
+
+		if (!c.obj_path.empty()){
+			std::vector<glm::vec3> vertices, normals;
+			std::vector<glm::vec2> uvs;
+			time("loadOBJ", [&](){ vertices.clear(); uvs.clear(); normals.clear(); },
+				[&](){ return loadOBJ(c.obj_path.c_str(), vertices, uvs, normals); });
+			time("loadOBJ (parallel)", [&](){ vertices.clear(); uvs.clear(); normals.clear(); },
+				[&](){ return loadOBJ(c.obj_path.c_str(), vertices, uvs, normals, &pool); });
+
+			std::vector<unsigned int> indexed_indices;
+			std::vector<glm::vec3> indexed_vertices, indexed_normals;
+			std::vector<glm::vec2> indexed_uvs;
+			time("loadOBJIndexed", [](){},
+				[&](){ return loadOBJIndexed(c.obj_path.c_str(), indexed_indices, indexed_vertices, indexed_uvs, indexed_normals); });
+			std::string saved = options.scratch + ".saved";
+			time("saveOBJ (parallel)", [](){},
+				[&](){ return saveOBJ(saved.c_str(), indexed_indices, indexed_vertices, indexed_uvs, indexed_normals, &pool); });
+			remove(saved.c_str());
+			if (c.corner_vertices.empty()){
+				c.corner_vertices.swap(vertices);
+				c.corner_uvs.swap(uvs);
+				c.corner_normals.swap(normals);
+			}
+		}
+		if (c.corner_vertices.empty()){
+			printf("%s : nothing loaded, skipped\n", c.mesh.c_str());
+			report();
+			return;
+		}
+		triangles = (int)c.corner_vertices.size() / 3;
+		fixTriangles();
+
+		std::vector<unsigned int> indices;
+		std::vector<glm::vec3> vertices, normals;
+		std::vector<glm::vec2> uvs;
+		time("indexVBO", [&](){ indices.clear(); vertices.clear(); uvs.clear(); normals.clear(); },
+			[&](){ return indexVBO(c.corner_vertices, c.corner_uvs, c.corner_normals, indices, vertices, uvs, normals); });
+		vertex_count = (int)vertices.size();
+		fixVertices();
+
+		if (!c.corner_uvs.empty() && !c.corner_normals.empty()){
+			std::vector<glm::vec3> tangents, bitangents;
+			time("computeTangentBasis", [&](){ tangents.clear(); bitangents.clear(); },
+				[&](){ computeTangentBasis(c.corner_vertices, c.corner_uvs, c.corner_normals, tangents, bitangents); return true; });
+
+			std::vector<unsigned int> tbn_indices;
+			std::vector<glm::vec3> tbn_vertices, tbn_normals, tbn_tangents, tbn_bitangents;
+			std::vector<glm::vec2> tbn_uvs;
+			time("indexVBO_TBN", [&](){
+				tbn_indices.clear(); tbn_vertices.clear(); tbn_uvs.clear(); tbn_normals.clear(); tbn_tangents.clear(); tbn_bitangents.clear();
+			}, [&](){
+				return indexVBO_TBN(c.corner_vertices, c.corner_uvs, c.corner_normals, tangents, bitangents,
+					tbn_indices, tbn_vertices, tbn_uvs, tbn_normals, tbn_tangents, tbn_bitangents);
+			});
+		}
+
+		HalfEdgeMesh mesh;
+		time("halfedge build", [](){}, [&](){ mesh.build(indices, (unsigned int)vertices.size()); return true; });
+
+		// Scoring every edge by length is what replaced the shortest shared edge search
+		std::vector<glm::vec3> moved;
+		for (int mode = 0; mode < 2; mode++){
+			CollapseCost cost = mode == 0 ? COLLAPSE_EDGE_LENGTH : COLLAPSE_QUADRIC;
+			const char * name = mode == 0 ? "score edges (length)" : "score edges (quadric)";
+			CollapseEngine * engine = NULL;
+			time(name, [&](){
+				delete engine;
+				moved = vertices;
+				engine = new CollapseEngine(mesh, moved, cost);
+			}, [&](){ engine->init(); return true; });
+			delete engine;
+		}
+
+		// Half of the triangles, one step() at a time and in parallel batches
+		SimplifyOptions simplify;
+		simplify.target_ratio = 0.5f;
+		std::vector<unsigned int> lod_indices;
+		std::vector<glm::vec3> lod_vertices, lod_normals;
+		std::vector<glm::vec2> lod_uvs;
+		auto reset = [&](){
+			lod_indices = indices;
+			lod_vertices = vertices;
+			lod_uvs = uvs;
+			lod_normals = normals;
+		};
+		SimplifyStats stats;
+		if (time("simplify 50%", reset, [&](){ return simplifyMesh(lod_indices, lod_vertices, lod_uvs, lod_normals, simplify, &stats); }))
+			countUndo(stats);
+		simplify.pool = &pool;
+		if (time("simplify 50% (parallel)", reset, [&](){ return simplifyMesh(lod_indices, lod_vertices, lod_uvs, lod_normals, simplify, &stats); }))
+			countUndo(stats);
+
+		// The same reset, clustered on a 256 cell grid for a preview or far LOD
+		ClusterOptions cluster;
+		cluster.grid_resolution = 256;
+		time("cluster grid 256", reset, [&](){ return clusterMesh(lod_indices, lod_vertices, lod_uvs, lod_normals, cluster); });
+		cluster.pool = &pool;
+		time("cluster grid 256 (parallel)", reset, [&](){ return clusterMesh(lod_indices, lod_vertices, lod_uvs, lod_normals, cluster); });
+		report();
+	}
+
+	const std::vector<Result> & results() const { return all; }
+	unsigned int threads() const { return pool.size(); }
+
+private:
+	// Returns false when the operation was skipped or failed
+	bool time(const char * op, const std::function<void()> & setup, const std::function<bool()> & run){
+		Result r;
+		r.mesh = current->mesh;
+		r.size = current->size;
+		r.triangles = triangles;
+		r.vertices = vertex_count;
+		r.op = op;
+		r.undo_blocks = -1;
+		r.undo_records = -1;
+
+		// Sizes go up, so this would take even longer than last time
+		std::string key = r.mesh + "/" + op;
+		if (r.size > 0 && last_ms.count(key) && last_ms[key] > options.skip_seconds * 1000.0){
+			printf("%s %s : skipped, took %.1f s on a smaller mesh\n", r.mesh.c_str(), op, last_ms[key] / 1000.0);
+			return false;
+		}
+		if (!measure(options, setup, run, r.repeats, r.best_ms, r.median_ms)){
+			printf("%s %s : failed\n", r.mesh.c_str(), op);
+			return false;
+		}
+		last_ms[key] = r.best_ms;
+		all.push_back(r);
+		return true;
+	}
+
+	// The undo log's allocations of the last run, on the row just timed
+	void countUndo(const SimplifyStats & stats){
+		all.back().undo_blocks = stats.undo_blocks;
+		all.back().undo_records = stats.undo_records;
+	}
+
+	// Prints the results of the current case, once its counts are known
+	void report(){
+		for (size_t i = first_of_case(); i < all.size(); i++){
+			const Result & r = all[i];
+			printf("%-10s %9d %-26s %10.3f ms %9.1f ns/triangle", r.mesh.c_str(), r.triangles, r.op.c_str(), r.best_ms,
+				r.triangles > 0 ? r.best_ms * 1e6 / r.triangles : 0.0);
+			if (r.undo_blocks >= 0)
+				printf("  undo %d blocks %d records", r.undo_blocks, r.undo_records);
+			printf("\n");
+		}
+		fflush(stdout);
+	}
+
+	// loadOBJ() runs before the counts are known
+	void fixTriangles(){
+		for (size_t i = first_of_case(); i < all.size(); i++)
+			all[i].triangles = triangles;
+	}
+	void fixVertices(){
+		for (size_t i = first_of_case(); i < all.size(); i++)
+			all[i].vertices = vertex_count;
+	}
+	size_t first_of_case() const{
+		size_t i = all.size();
+		while (i > 0 && all[i - 1].mesh == current->mesh && all[i - 1].size == current->size)
+			i--;
+		return i;
+	}
+
+	const BenchOptions & options;
+	ThreadPool pool;
+	std::vector<Result> all;
+	std::map<std::string, double> last_ms;  // best time of each generator and operation at the last size
+	Case * current;
+	int triangles;
+	int vertex_count;
+};
+
+// ----------------------------------------------------------------------------
+// JSON
+
+static bool write_json(const char * path, const std::vector<Result> & results, unsigned int threads){
+	FILE * file = fopen(path, "w");
+	if (file == NULL)
+		return false;
+	fprintf(file, "{\n  \"version\": 1,\n  \"simd\": \"%s\",\n  \"threads\": %u,\n  \"results\": [\n", simdLevelName(simdLevel()), threads);
+	for (size_t i = 0; i < results.size(); i++){
+		const Result & r = results[i];
+		char undo[64] = "";
+		if (r.undo_blocks >= 0)
+			snprintf(undo, sizeof(undo), ", \"undo_blocks\": %d, \"undo_records\": %d", r.undo_blocks, r.undo_records);
+		fprintf(file, "    {\"mesh\": \"%s\", \"size\": %d, \"triangles\": %d, \"vertices\": %d, \"op\": \"%s\", "
+			"\"repeats\": %d, \"best_ms\": %.6f, \"median_ms\": %.6f, \"ns_per_triangle\": %.3f%s}%s\n",
+			r.mesh.c_str(), r.size, r.triangles, r.vertices, r.op.c_str(), r.repeats, r.best_ms, r.median_ms,
+			r.triangles > 0 ? r.best_ms * 1e6 / r.triangles : 0.0, undo, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	bool ok = !ferror(file);
+	return fclose(file) == 0 && ok;
+}
+
+// Value of "key": in line, a string or a number
+static bool json_field(const char * line, const char * key, std::string & value){
+	std::string pattern = std::string("\"") + key + "\":";
+	const char * p = strstr(line, pattern.c_str());
+	if (p == NULL)
+		return false;
+	p += pattern.size();
+	while (*p == ' ')
+		p++;
+	const char * end;
+	if (*p == '"'){
+		p++;
+		end = strchr(p, '"');
+	}else{
+		end = p + strcspn(p, ",}");
+	}
+	if (end == NULL)
+		return false;
+	value.assign(p, end);
+	return true;
+}
+
+// Reads the results of a file written by write_json(), one per line
+static bool read_json(const char * path, std::vector<Result> & results){
+	FILE * file = fopen(path, "r");
+	if (file == NULL)
+		return false;
+	char line[1024];
+	while (fgets(line, sizeof(line), file)){
+		std::string mesh, size, op, best;
+		if (!json_field(line, "mesh", mesh) || !json_field(line, "size", size) ||
+			!json_field(line, "op", op) || !json_field(line, "best_ms", best))
+			continue;
+		Result r;
+		r.mesh = mesh;
+		r.size = atoi(size.c_str());
+		r.op = op;
+		r.best_ms = atof(best.c_str());
+		std::string value;
+		r.triangles = json_field(line, "triangles", value) ? atoi(value.c_str()) : 0;
+		r.vertices = json_field(line, "vertices", value) ? atoi(value.c_str()) : 0;
+		r.repeats = 0;
+		r.median_ms = 0.0;
+		r.undo_blocks = json_field(line, "undo_blocks", value) ? atoi(value.c_str()) : -1;
+		r.undo_records = json_field(line, "undo_records", value) ? atoi(value.c_str()) : -1;
+		results.push_back(r);
+	}
+	fclose(file);
+	return true;
+}
+
+// Prints every operation whose best time moved by more than the threshold.
+// Returns the number of regressions.
+static int compare(const std::vector<Result> & results, const std::vector<Result> & baseline, double threshold){
+	int slower = 0, faster = 0, matched = 0;
+	printf("\nAgainst the baseline (changes over %.0f%%) :\n", threshold * 100.0);
+	for (size_t i = 0; i < results.size(); i++){
+		const Result & r = results[i];
+		for (size_t j = 0; j < baseline.size(); j++){
+			const Result & b = baseline[j];
+			if (b.mesh != r.mesh || b.size != r.size || b.op != r.op)
+				continue;
+			matched++;
+			double ratio = b.best_ms > 0.0 ? r.best_ms / b.best_ms : 1.0;
+			if (ratio > 1.0 + threshold || ratio < 1.0 / (1.0 + threshold)){
+				bool worse = ratio > 1.0;
+				printf("  %-7s %-10s %9d %-26s %10.3f -> %10.3f ms  x%.2f\n", worse ? "SLOWER" : "faster",
+					r.mesh.c_str(), r.triangles, r.op.c_str(), b.best_ms, r.best_ms, ratio);
+				if (worse)
+					slower++;
+				else
+					faster++;
+			}
+			break;
+		}
+	}
+	printf("%d compared, %d slower, %d faster\n", matched, slower, faster);
+	return slower;
+}
+
+// ----------------------------------------------------------------------------
+
+static bool parse_sizes(const char * list, std::vector<int> & sizes){
+	sizes.clear();
+	const char * p = list;
+	while (*p){
+		char * end;
+		double value = strtod(p, &end);
+		if (end == p)
+			return false;
+		if (*end == 'K' || *end == 'k'){
+			value *= 1e3;
+			end++;
+		}else if (*end == 'M' || *end == 'm'){
+			value *= 1e6;
+			end++;
+		}
+		if ((*end != ',' && *end != '\0') || value < 1.0)
+			return false;
+		sizes.push_back((int)value);
+		p = *end ? end + 1 : end;
+	}
+	return !sizes.empty();
+}
+
+static void usage(){
+	printf(
+		"Usage : benchmark [options]\n"
+		"  -s sizes      triangles of the generated meshes, e.g. 1K,100K,1M (default 1K,10K,100K,1M)\n"
+		"  -f            full run, adds 10M triangles (needs several GB of memory)\n"
+		"  -m dir        bundled models (default mesh), - to skip them\n"
+		"  -o file       JSON results (default benchmark.json)\n"
+		"  -b file       JSON of an earlier run to compare against\n"
+		"  -t fraction   slowdown reported as a regression (default 0.10)\n"
+		"  -l triangles  largest generated mesh written out and timed with loadOBJ (default 1M)\n"
+		"  -r repeats    most repetitions of each operation (default 10)\n"
+		"  -k seconds    don't run an operation again on larger meshes once it takes this long (default 10)\n"
+		"The exit status is 1 if anything got slower than the baseline.\n"
+	);
+}
+
+int main(int argc, char * argv[]){
+	BenchOptions options;
+	for (int i = 1; i < argc; i++){
+		const char * arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (strcmp(arg, "-s") == 0 && has_value){
+			if (!parse_sizes(argv[++i], options.sizes)){
+				printf("Bad sizes %s\n", argv[i]);
+				return 2;
+			}
+		}else if (strcmp(arg, "-f") == 0){
+			options.sizes.push_back(10000000);
+		}else if (strcmp(arg, "-m") == 0 && has_value){
+			options.mesh_dir = strcmp(argv[++i], "-") == 0 ? "" : argv[i];
+		}else if (strcmp(arg, "-o") == 0 && has_value){
+			options.output = argv[++i];
+		}else if (strcmp(arg, "-b") == 0 && has_value){
+			options.baseline = argv[++i];
+		}else if (strcmp(arg, "-t") == 0 && has_value){
+			options.threshold = atof(argv[++i]);
+		}else if (strcmp(arg, "-l") == 0 && has_value){
+			options.max_load_triangles = atoi(argv[++i]);
+		}else if (strcmp(arg, "-r") == 0 && has_value){
+			options.max_repeats = std::max(1, atoi(argv[++i]));
+		}else if (strcmp(arg, "-k") == 0 && has_value){
+			options.skip_seconds = atof(argv[++i]);
+		}else{
+			usage();
+			return 2;
+		}
+	}
+
+	std::sort(options.sizes.begin(), options.sizes.end());
+
+	std::vector<Result> baseline;
+	if (!options.baseline.empty() && !read_json(options.baseline.c_str(), baseline)){
+		printf("Can't read %s\n", options.baseline.c_str());
+		return 2;
+	}
+
+	Bench bench(options);
+	printf("%s, %u threads\n", simdLevelName(simdLevel()), bench.threads());
+
+	if (!options.mesh_dir.empty()){
+		const char * models[] = { "cube", "esfera", "suzanne", "g1", "g2", "g3", "g4", "g5" };
+		for (size_t i = 0; i < sizeof(models) / sizeof(models[0]); i++){
+			Case c;
+			c.mesh = models[i];
+			c.size = 0;
+			c.obj_path = options.mesh_dir + "/" + models[i] + ".obj";
+			FILE * probe = fopen(c.obj_path.c_str(), "r");
+			if (probe == NULL)
+				continue;
+			fclose(probe);
+			bench.run(c);
+		}
+	}
+
+	const char * generators[] = { "sphere", "torus", "terrain" };
+	for (size_t s = 0; s < options.sizes.size(); s++){
+		for (int g = 0; g < 3; g++){
+			Case c;
+			c.mesh = generators[g];
+			c.size = options.sizes[s];
+			std::vector<unsigned int> indices;
+			std::vector<glm::vec3> vertices, normals;
+			std::vector<glm::vec2> uvs;
+			if (g == 0)
+				generateSphere(c.size, indices, vertices, uvs, normals);
+			else if (g == 1)
+				generateTorus(c.size, indices, vertices, uvs, normals);
+			else
+				generateTerrain(c.size, 1u, indices, vertices, uvs, normals);
+
+			expandCorners(indices, vertices, uvs, normals, c.corner_vertices, c.corner_uvs, c.corner_normals);
+			if (c.size <= options.max_load_triangles && saveOBJ(options.scratch.c_str(), indices, vertices, uvs, normals))
+				c.obj_path = options.scratch;
+			bench.run(c);
+		}
+	}
+	remove(options.scratch.c_str());
+
+	if (!write_json(options.output.c_str(), bench.results(), bench.threads()))
+		printf("Can't write %s\n", options.output.c_str());
+	else
+		printf("Results written to %s\n", options.output.c_str());
+
+	if (!options.baseline.empty())
+		return compare(bench.results(), baseline, options.threshold) > 0 ? 1 : 0;
+	return 0;
+}